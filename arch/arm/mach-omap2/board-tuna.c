@@ -314,6 +314,7 @@ static struct ion_platform_data tuna_ion_data = {
 			.base = PHYS_ADDR_DUCATI_MEM -
 					OMAP_TUNA_ION_HEAP_TILER_SIZE,
 			.size = OMAP_TUNA_ION_HEAP_TILER_SIZE,
+			.flags = ION_HEAP_FLAG_DEFER_FREE,
 		},
 		{	.type = OMAP_ION_HEAP_TYPE_TILER,
 			.id   = OMAP_ION_HEAP_NONSECURE_TILER,
@@ -26,6 +26,8 @@
 #include <linux/compiler.h>
 #include <linux/blktrace_api.h>
 #include <linux/jiffies.h>
+#include <linux/ioprio.h>
+#include <linux/iocontext.h>
 
 /*
  * enum row_queue_prio - Priorities of the ROW queues
@@ -69,10 +71,46 @@ static const int queue_quantum[] = {
 	2	/* ROWQ_PRIO_LOW_SWRITE */
 };
 
+/*
+ * Default completion latency targets (msec, 0 means none). A queue that
+ * misses its target throttles the quanta of lower priority queues.
+ */
+static const int queue_target_latency[] = {
+	10,	/* ROWQ_PRIO_HIGH_READ */
+	30,	/* ROWQ_PRIO_REG_READ */
+	0,	/* ROWQ_PRIO_HIGH_SWRITE */
+	0,	/* ROWQ_PRIO_REG_SWRITE */
+	0,	/* ROWQ_PRIO_REG_WRITE */
+	0,	/* ROWQ_PRIO_LOW_READ */
+	0	/* ROWQ_PRIO_LOW_SWRITE */
+};
+
 /* Default values for idling on read queues */
 #define ROW_IDLE_TIME_MSEC 10	/* msec */
 #define ROW_READ_FREQ_MSEC 25	/* msec */
 
+/* Completions between two adjustments of a queue's throttle */
+#define ROW_ADAPT_INTERVAL	8
+/* Lower priority quanta are divided by at most 1 << ROW_MAX_THROTTLE */
+#define ROW_MAX_THROTTLE	3
+
+/* Names of the queues as used in sysfs */
+static const char * const queue_name[] = {
+	"hp_read",	/* ROWQ_PRIO_HIGH_READ */
+	"rp_read",	/* ROWQ_PRIO_REG_READ */
+	"hp_swrite",	/* ROWQ_PRIO_HIGH_SWRITE */
+	"rp_swrite",	/* ROWQ_PRIO_REG_SWRITE */
+	"rp_write",	/* ROWQ_PRIO_REG_WRITE */
+	"lp_read",	/* ROWQ_PRIO_LOW_READ */
+	"lp_swrite"	/* ROWQ_PRIO_LOW_SWRITE */
+};
+
+/*
+ * Latency histograms have log2 buckets in usec: bucket 0 counts 0us,
+ * bucket i counts [2^(i-1), 2^i) usec and the last one everything above.
+ */
+#define ROW_HIST_BUCKETS	22
+
 /**
  * struct rowq_idling_data -  parameters for idling on the queue
  * @last_insert_time:	time the last request was inserted
@@ -85,6 +123,26 @@ struct rowq_idling_data {
 	bool			begin_idling;
 };
 
+/**
+ * struct rowq_stats - per queue statistics
+ * @dispatched:		requests dispatched
+ * @merged:		bios and requests merged into queued requests
+ * @idle_starts:	times idling was started on the queue
+ * @idle_hits:		requests that arrived while idling on the queue
+ * @insert_dispatch:	histogram of insertion to dispatch latency
+ * @dispatch_complete:	histogram of dispatch to completion latency
+ *
+ * Updated under the queue lock, read without it.
+ */
+struct rowq_stats {
+	unsigned long		dispatched;
+	unsigned long		merged;
+	unsigned long		idle_starts;
+	unsigned long		idle_hits;
+	unsigned long		insert_dispatch[ROW_HIST_BUCKETS];
+	unsigned long		dispatch_complete[ROW_HIST_BUCKETS];
+};
+
 /**
  * struct row_queue - requests grouping structure
  * @rdata:		parent row_data structure
@@ -93,6 +151,14 @@ struct rowq_idling_data {
  * @nr_dispatched:	number of requests already dispatched in
  *			the current dispatch cycle
  * @slice:		number of requests to dispatch in a cycle
+ * @nr_inflight:	number of dispatched requests not yet completed
+ * @target_lat:		completion latency target (msec), 0 for none
+ * @avg_lat:		moving average of the insert to completion
+ *			latency (usec)
+ * @nr_completed:	completions since @throttle was last adjusted
+ * @throttle:		log2 of the factor lower priority quanta are
+ *			divided by while this queue has requests
+ * @stats:		statistics exported through sysfs
  * @idle_data:		data for idling on queues
  *
  */
@@ -104,6 +170,14 @@ struct row_queue {
 	unsigned int		nr_dispatched;
 	unsigned int		slice;
 
+	unsigned int		nr_inflight;
+	int			target_lat;
+	unsigned int		avg_lat;
+	unsigned int		nr_completed;
+	unsigned int		throttle;
+
+	struct rowq_stats	stats;
+
 	/* used only for READ queues */
 	struct rowq_idling_data	idle_data;
 };
@@ -155,6 +229,9 @@ struct row_data {
 };
 
 #define RQ_ROWQ(rq) ((struct row_queue *) ((rq)->elevator_private[0]))
+/* Insertion and dispatch times in usec, truncated to fit the pointer */
+#define RQ_INSERT_TIME(rq) ((unsigned long) ((rq)->elevator_private[1]))
+#define RQ_DISPATCH_TIME(rq) ((unsigned long) ((rq)->elevator_private[2]))
 
 #define row_log(q, fmt, args...)   \
 	blk_add_trace_msg(q, "%s():" fmt , __func__, ##args)
@@ -181,6 +258,42 @@ static inline int row_rowq_unserved(struct row_data *rd,
 }
 
 /******************** Static helper functions ***********************/
+static inline unsigned long row_now_us(void)
+{
+	return (unsigned long)ktime_to_us(ktime_get());
+}
+
+static inline void row_hist_add(unsigned long *hist, unsigned long usec)
+{
+	hist[min_t(int, fls_long(usec), ROW_HIST_BUCKETS - 1)]++;
+}
+
+/*
+ * row_queue_quantum() - dispatch quantum of a queue in the current cycle
+ * @rd:		pointer to struct row_data
+ * @qnum:	queue index
+ *
+ * The configured quantum, divided according to the highest throttle
+ * among the higher priority queues that have requests queued or in
+ * flight.
+ */
+static unsigned int row_queue_quantum(struct row_data *rd,
+				      enum row_queue_prio qnum)
+{
+	unsigned int throttle = 0;
+	int i;
+
+	for (i = 0; i < qnum; i++) {
+		struct row_queue *rqueue = &rd->row_queues[i].rqueue;
+
+		if (rqueue->target_lat && rqueue->throttle > throttle &&
+		    (rqueue->nr_inflight || !list_empty(&rqueue->fifo)))
+			throttle = rqueue->throttle;
+	}
+
+	return max(rd->row_queues[qnum].disp_quantum >> throttle, 1);
+}
+
 /*
  * kick_queue() - Wake up device driver queue thread
  * @work:	pointer to struct work_struct
@@ -237,6 +350,57 @@ static inline void row_get_next_queue(struct row_data *rd)
 		row_restart_disp_cycle(rd);
 }
 
+/*
+ * row_ioprio_class() - I/O priority class of a request
+ *
+ * Taken from the request if set there, otherwise from the io_context of
+ * the task adding it.
+ */
+static int row_ioprio_class(struct request *rq)
+{
+	struct io_context *ioc = current->io_context;
+
+	if (ioprio_valid(req_get_ioprio(rq)))
+		return IOPRIO_PRIO_CLASS(req_get_ioprio(rq));
+	if (ioc && ioprio_valid(ioc->ioprio))
+		return IOPRIO_PRIO_CLASS(ioc->ioprio);
+	return IOPRIO_CLASS_NONE;
+}
+
+/*
+ * get_queue_type() - Get queue type for a given request
+ *
+ * This is a helping function which purpose is to determine what
+ * ROW queue the given request should be added to (and
+ * dispatched from leter on)
+ *
+ * READs flagged REQ_PRIO (e.g. filesystem metadata) and READs and sync
+ * WRITEs from the RT I/O priority class go to the high priority queues;
+ * those from the IDLE class go to the low priority ones.
+ */
+static enum row_queue_prio get_queue_type(struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+	const bool is_sync = rq_is_sync(rq);
+	const int ioprio_class = row_ioprio_class(rq);
+
+	if (data_dir == READ) {
+		if (ioprio_class == IOPRIO_CLASS_RT ||
+		    (rq->cmd_flags & REQ_PRIO))
+			return ROWQ_PRIO_HIGH_READ;
+		if (ioprio_class == IOPRIO_CLASS_IDLE)
+			return ROWQ_PRIO_LOW_READ;
+		return ROWQ_PRIO_REG_READ;
+	} else if (is_sync) {
+		if (ioprio_class == IOPRIO_CLASS_RT)
+			return ROWQ_PRIO_HIGH_SWRITE;
+		if (ioprio_class == IOPRIO_CLASS_IDLE)
+			return ROWQ_PRIO_LOW_SWRITE;
+		return ROWQ_PRIO_REG_SWRITE;
+	} else
+		return ROWQ_PRIO_REG_WRITE;
+}
+
 /******************* Elevator callback functions *********************/
 
 /*
@@ -249,16 +413,27 @@ static void row_add_request(struct request_queue *q,
 			    struct request *rq)
 {
 	struct row_data *rd = (struct row_data *)q->elevator->elevator_data;
-	struct row_queue *rqueue = RQ_ROWQ(rq);
+	struct row_queue *rqueue;
+
+	/*
+	 * The request flags and priority are only known once the bio has
+	 * been attached, so the queue is chosen here.
+	 */
+	rqueue = &rd->row_queues[get_queue_type(rq)].rqueue;
+	rq->elevator_private[0] = rqueue;
+	rq->elevator_private[1] = (void *)row_now_us();
 
 	list_add_tail(&rq->queuelist, &rqueue->fifo);
 	rd->nr_reqs[rq_data_dir(rq)]++;
 	rq_set_fifo_time(rq, jiffies); /* for statistics*/
 
 	if (queue_idling_enabled[rqueue->prio]) {
-		if (delayed_work_pending(&rd->read_idle.idle_work))
+		if (delayed_work_pending(&rd->read_idle.idle_work)) {
+			if (rqueue->prio == rd->curr_queue)
+				rqueue->stats.idle_hits++;
 			(void)cancel_delayed_work(
 				&rd->read_idle.idle_work);
+		}
 		if (ktime_to_ms(ktime_sub(ktime_get(),
 				rqueue->idle_data.last_insert_time)) <
 				rd->read_idle.freq) {
@@ -299,12 +474,18 @@ static void row_remove_request(struct request_queue *q,
  */
 static void row_dispatch_insert(struct row_data *rd)
 {
+	struct row_queue *rqueue = &rd->row_queues[rd->curr_queue].rqueue;
 	struct request *rq;
+	unsigned long now = row_now_us();
 
-	rq = rq_entry_fifo(rd->row_queues[rd->curr_queue].rqueue.fifo.next);
+	rq = rq_entry_fifo(rqueue->fifo.next);
 	row_remove_request(rd->dispatch_queue, rq);
 	elv_dispatch_add_tail(rd->dispatch_queue, rq);
-	rd->row_queues[rd->curr_queue].rqueue.nr_dispatched++;
+	rq->elevator_private[2] = (void *)now;
+	rqueue->nr_dispatched++;
+	rqueue->nr_inflight++;
+	rqueue->stats.dispatched++;
+	row_hist_add(rqueue->stats.insert_dispatch, now - RQ_INSERT_TIME(rq));
 	row_clear_rowq_unserved(rd, rd->curr_queue);
 	row_log_rowq(rd, rd->curr_queue, " Dispatched request nr_disp = %d",
 		     rd->row_queues[rd->curr_queue].rqueue.nr_dispatched);
@@ -359,6 +540,23 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 
 	currq = rd->curr_queue;
 
+	/*
+	 * Urgent requests: anything in the high priority READ queue
+	 * preempts the current queue, as long as it has quantum left in
+	 * this cycle.
+	 */
+	if (currq != ROWQ_PRIO_HIGH_READ &&
+	    !list_empty(&rd->row_queues[ROWQ_PRIO_HIGH_READ].rqueue.fifo) &&
+	    rd->row_queues[ROWQ_PRIO_HIGH_READ].rqueue.nr_dispatched <
+	    row_queue_quantum(rd, ROWQ_PRIO_HIGH_READ)) {
+		row_log_rowq(rd, currq, " Preempting for urgent rowq%d",
+			     ROWQ_PRIO_HIGH_READ);
+		rd->curr_queue = ROWQ_PRIO_HIGH_READ;
+		row_dispatch_insert(rd);
+		ret = 1;
+		goto done;
+	}
+
 	/*
 	 * Find the first unserved queue (with higher priority then currq)
 	 * that is not empty
@@ -376,7 +574,7 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 	}
 
 	if (rd->row_queues[currq].rqueue.nr_dispatched >=
-	    rd->row_queues[currq].disp_quantum) {
+	    row_queue_quantum(rd, currq)) {
 		rd->row_queues[currq].rqueue.nr_dispatched = 0;
 		row_log_rowq(rd, currq, "Expiring rqueue");
 		ret = row_choose_queue(rd);
@@ -409,9 +607,11 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 				row_log_rowq(rd, currq,
 					     "Work already on queue!");
 				pr_err("ROW_BUG: Work already on queue!");
-			} else
+			} else {
+				rd->row_queues[currq].rqueue.stats.idle_starts++;
 				row_log_rowq(rd, currq,
 				     "Scheduled delayed work. exiting");
+			}
 			goto done;
 		} else {
 			row_log_rowq(rd, currq,
@@ -451,6 +651,8 @@ static void *row_init_queue(struct request_queue *q)
 	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
 		INIT_LIST_HEAD(&rdata->row_queues[i].rqueue.fifo);
 		rdata->row_queues[i].disp_quantum = queue_quantum[i];
+		rdata->row_queues[i].rqueue.target_lat =
+			queue_target_latency[i];
 		rdata->row_queues[i].rqueue.rdata = rdata;
 		rdata->row_queues[i].rqueue.prio = i;
 		rdata->row_queues[i].rqueue.idle_data.begin_idling = false;
@@ -512,52 +714,69 @@ static void row_merged_requests(struct request_queue *q, struct request *rq,
 	struct row_queue   *rqueue = RQ_ROWQ(next);
 
 	list_del_init(&next->queuelist);
+	RQ_ROWQ(rq)->stats.merged++;
 
 	rqueue->rdata->nr_reqs[rq_data_dir(rq)]--;
 }
 
 /*
- * get_queue_type() - Get queue type for a given request
- *
- * This is a helping function which purpose is to determine what
- * ROW queue the given request should be added to (and
- * dispatched from leter on)
- *
- * TODO: Right now only 3 queues are used REG_READ, REG_WRITE
- * and REG_SWRITE
+ * row_bio_merged() - Called when a bio is merged into a queued request
+ * @q:		requests queue
+ * @rq:		request the bio was merged into
+ * @bio:	merged bio
  */
-static enum row_queue_prio get_queue_type(struct request *rq)
+static void row_bio_merged(struct request_queue *q, struct request *rq,
+			   struct bio *bio)
 {
-	const int data_dir = rq_data_dir(rq);
-	const bool is_sync = rq_is_sync(rq);
-
-	if (data_dir == READ)
-		return ROWQ_PRIO_REG_READ;
-	else if (is_sync)
-		return ROWQ_PRIO_REG_SWRITE;
-	else
-		return ROWQ_PRIO_REG_WRITE;
+	RQ_ROWQ(rq)->stats.merged++;
 }
 
 /*
- * row_set_request() - Set ROW data structures associated with this request.
+ * row_completed_request() - Called when a request has completed
  * @q:		requests queue
- * @rq:		pointer to the request
- * @gfp_mask:	ignored
+ * @rq:		completed request
  *
+ * Tracks the completion latency of queues with a latency target and
+ * adjusts how much they throttle lower priority queues.
  */
-static int
-row_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
+static void row_completed_request(struct request_queue *q,
+				  struct request *rq)
 {
-	struct row_data *rd = (struct row_data *)q->elevator->elevator_data;
-	unsigned long flags;
-
-	spin_lock_irqsave(q->queue_lock, flags);
-	rq->elevator_private[0] =
-		(void *)(&rd->row_queues[get_queue_type(rq)]);
-	spin_unlock_irqrestore(q->queue_lock, flags);
-
-	return 0;
+	struct row_queue *rqueue = RQ_ROWQ(rq);
+	unsigned long now = row_now_us();
+	unsigned long lat = now - RQ_INSERT_TIME(rq);
+
+	rqueue->nr_inflight--;
+	row_hist_add(rqueue->stats.dispatch_complete,
+		     now - RQ_DISPATCH_TIME(rq));
+	if (!rqueue->target_lat)
+		return;
+
+	if (rqueue->avg_lat)
+		rqueue->avg_lat = rqueue->avg_lat - rqueue->avg_lat / 8 +
+				  lat / 8;
+	else
+		rqueue->avg_lat = lat;
+
+	if (++rqueue->nr_completed < ROW_ADAPT_INTERVAL)
+		return;
+	rqueue->nr_completed = 0;
+
+	if (rqueue->avg_lat > rqueue->target_lat * USEC_PER_MSEC) {
+		if (rqueue->throttle < ROW_MAX_THROTTLE) {
+			rqueue->throttle++;
+			row_log_rowq(rqueue->rdata, rqueue->prio,
+				     "avg latency %uus, throttle %u",
+				     rqueue->avg_lat, rqueue->throttle);
+		}
+	} else if (rqueue->avg_lat < rqueue->target_lat * USEC_PER_MSEC / 2) {
+		if (rqueue->throttle) {
+			rqueue->throttle--;
+			row_log_rowq(rqueue->rdata, rqueue->prio,
+				     "avg latency %uus, throttle %u",
+				     rqueue->avg_lat, rqueue->throttle);
+		}
+	}
 }
 
 /********** Helping sysfs functions/defenitions for ROW attributes ******/
@@ -597,6 +816,20 @@ SHOW_FUNCTION(row_lp_read_quantum_show,
 	rowd->row_queues[ROWQ_PRIO_LOW_READ].disp_quantum, 0);
 SHOW_FUNCTION(row_lp_swrite_quantum_show,
 	rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].disp_quantum, 0);
+SHOW_FUNCTION(row_hp_read_target_latency_show,
+	rowd->row_queues[ROWQ_PRIO_HIGH_READ].rqueue.target_lat, 0);
+SHOW_FUNCTION(row_rp_read_target_latency_show,
+	rowd->row_queues[ROWQ_PRIO_REG_READ].rqueue.target_lat, 0);
+SHOW_FUNCTION(row_hp_swrite_target_latency_show,
+	rowd->row_queues[ROWQ_PRIO_HIGH_SWRITE].rqueue.target_lat, 0);
+SHOW_FUNCTION(row_rp_swrite_target_latency_show,
+	rowd->row_queues[ROWQ_PRIO_REG_SWRITE].rqueue.target_lat, 0);
+SHOW_FUNCTION(row_rp_write_target_latency_show,
+	rowd->row_queues[ROWQ_PRIO_REG_WRITE].rqueue.target_lat, 0);
+SHOW_FUNCTION(row_lp_read_target_latency_show,
+	rowd->row_queues[ROWQ_PRIO_LOW_READ].rqueue.target_lat, 0);
+SHOW_FUNCTION(row_lp_swrite_target_latency_show,
+	rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].rqueue.target_lat, 0);
 SHOW_FUNCTION(row_read_idle_show, rowd->read_idle.idle_time, 1);
 SHOW_FUNCTION(row_read_idle_freq_show, rowd->read_idle.freq, 0);
 #undef SHOW_FUNCTION
@@ -637,11 +870,84 @@ STORE_FUNCTION(row_lp_read_quantum_store,
 STORE_FUNCTION(row_lp_swrite_quantum_store,
 			&rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].disp_quantum,
 			1, INT_MAX, 1);
+STORE_FUNCTION(row_hp_read_target_latency_store,
+		&rowd->row_queues[ROWQ_PRIO_HIGH_READ].rqueue.target_lat,
+		0, INT_MAX / USEC_PER_MSEC, 0);
+STORE_FUNCTION(row_rp_read_target_latency_store,
+		&rowd->row_queues[ROWQ_PRIO_REG_READ].rqueue.target_lat,
+		0, INT_MAX / USEC_PER_MSEC, 0);
+STORE_FUNCTION(row_hp_swrite_target_latency_store,
+		&rowd->row_queues[ROWQ_PRIO_HIGH_SWRITE].rqueue.target_lat,
+		0, INT_MAX / USEC_PER_MSEC, 0);
+STORE_FUNCTION(row_rp_swrite_target_latency_store,
+		&rowd->row_queues[ROWQ_PRIO_REG_SWRITE].rqueue.target_lat,
+		0, INT_MAX / USEC_PER_MSEC, 0);
+STORE_FUNCTION(row_rp_write_target_latency_store,
+		&rowd->row_queues[ROWQ_PRIO_REG_WRITE].rqueue.target_lat,
+		0, INT_MAX / USEC_PER_MSEC, 0);
+STORE_FUNCTION(row_lp_read_target_latency_store,
+		&rowd->row_queues[ROWQ_PRIO_LOW_READ].rqueue.target_lat,
+		0, INT_MAX / USEC_PER_MSEC, 0);
+STORE_FUNCTION(row_lp_swrite_target_latency_store,
+		&rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].rqueue.target_lat,
+		0, INT_MAX / USEC_PER_MSEC, 0);
 STORE_FUNCTION(row_read_idle_store, &rowd->read_idle.idle_time, 1, INT_MAX, 1);
 STORE_FUNCTION(row_read_idle_freq_store, &rowd->read_idle.freq, 1, INT_MAX, 0);
 
 #undef STORE_FUNCTION
 
+static ssize_t row_stats_show(struct elevator_queue *e, char *page)
+{
+	struct row_data *rowd = e->elevator_data;
+	ssize_t len;
+	int i;
+
+	len = scnprintf(page, PAGE_SIZE,
+			"queue dispatched merged idle_starts idle_hits\n");
+	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+		struct rowq_stats *st = &rowd->row_queues[i].rqueue.stats;
+
+		len += scnprintf(page + len, PAGE_SIZE - len,
+				 "%s %lu %lu %lu %lu\n", queue_name[i],
+				 st->dispatched, st->merged,
+				 st->idle_starts, st->idle_hits);
+	}
+	return len;
+}
+
+static ssize_t row_hist_show(struct row_data *rowd, char *page,
+			     bool complete)
+{
+	ssize_t len = 0;
+	int i, b;
+
+	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+		struct rowq_stats *st = &rowd->row_queues[i].rqueue.stats;
+		unsigned long *hist = complete ? st->dispatch_complete :
+						 st->insert_dispatch;
+
+		len += scnprintf(page + len, PAGE_SIZE - len, "%s",
+				 queue_name[i]);
+		for (b = 0; b < ROW_HIST_BUCKETS; b++)
+			len += scnprintf(page + len, PAGE_SIZE - len, " %lu",
+					 hist[b]);
+		len += scnprintf(page + len, PAGE_SIZE - len, "\n");
+	}
+	return len;
+}
+
+static ssize_t row_insert_dispatch_hist_show(struct elevator_queue *e,
+					     char *page)
+{
+	return row_hist_show(e->elevator_data, page, false);
+}
+
+static ssize_t row_dispatch_complete_hist_show(struct elevator_queue *e,
+					       char *page)
+{
+	return row_hist_show(e->elevator_data, page, true);
+}
+
 #define ROW_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
 				      row_##name##_store)
@@ -654,8 +960,20 @@ static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(rp_write_quantum),
 	ROW_ATTR(lp_read_quantum),
 	ROW_ATTR(lp_swrite_quantum),
+	ROW_ATTR(hp_read_target_latency),
+	ROW_ATTR(rp_read_target_latency),
+	ROW_ATTR(hp_swrite_target_latency),
+	ROW_ATTR(rp_swrite_target_latency),
+	ROW_ATTR(rp_write_target_latency),
+	ROW_ATTR(lp_read_target_latency),
+	ROW_ATTR(lp_swrite_target_latency),
 	ROW_ATTR(read_idle),
 	ROW_ATTR(read_idle_freq),
+	__ATTR(stats, S_IRUGO, row_stats_show, NULL),
+	__ATTR(insert_dispatch_hist, S_IRUGO, row_insert_dispatch_hist_show,
+	       NULL),
+	__ATTR(dispatch_complete_hist, S_IRUGO,
+	       row_dispatch_complete_hist_show, NULL),
 	__ATTR_NULL
 };
 
@@ -666,7 +984,8 @@ static struct elevator_type iosched_row = {
 		.elevator_add_req_fn		= row_add_request,
 		.elevator_former_req_fn		= elv_rb_former_request,
 		.elevator_latter_req_fn		= elv_rb_latter_request,
-		.elevator_set_req_fn		= row_set_request,
+		.elevator_bio_merged_fn		= row_bio_merged,
+		.elevator_completed_req_fn	= row_completed_request,
 		.elevator_init_fn		= row_init_queue,
 		.elevator_exit_fn		= row_exit_queue,
 	},
@@ -168,6 +168,72 @@ u64 get_cpu_idle_time(unsigned int cpu, u64 *wall, int io_busy)
 }
 EXPORT_SYMBOL_GPL(get_cpu_idle_time);
 
+/**
+ * cpufreq_load_sample_init - start sampling the load of a CPU
+ * @sample: sampling state to (re)initialise
+ * @cpu: CPU to sample
+ * @io_busy: count time waiting for I/O as busy rather than idle
+ *
+ * Also to be called whenever @io_busy changes, so that the next sample does
+ * not mix the two ways of accounting iowait.
+ */
+void cpufreq_load_sample_init(struct cpufreq_load_sample *sample,
+			      unsigned int cpu, int io_busy)
+{
+	sample->idle = get_cpu_idle_time(cpu, &sample->wall, io_busy);
+	sample->nice = kstat_cpu(cpu).cpustat.nice;
+}
+EXPORT_SYMBOL_GPL(cpufreq_load_sample_init);
+
+/**
+ * cpufreq_load_sample - load of a CPU since the previous sample
+ * @sample: sampling state, updated to the current times
+ * @cpu: CPU to sample
+ * @io_busy: count time waiting for I/O as busy rather than idle
+ * @ignore_nice: count time spent running niced tasks as idle
+ *
+ * Returns the percentage of wall time @cpu was busy since the previous call
+ * (or cpufreq_load_sample_init()), or -EAGAIN if no usable time has passed.
+ *
+ * With @io_busy, iowait is left out of the idle time once, by
+ * get_cpu_idle_time().  ondemand, lazy, wheatley and hotplug used to
+ * subtract it from that a second time, so they read higher loads under I/O.
+ */
+int cpufreq_load_sample(struct cpufreq_load_sample *sample, unsigned int cpu,
+			int io_busy, int ignore_nice)
+{
+	cputime64_t cur_nice = kstat_cpu(cpu).cpustat.nice;
+	unsigned int idle_time, wall_time;
+	u64 cur_idle, cur_wall;
+
+	cur_idle = get_cpu_idle_time(cpu, &cur_wall, io_busy);
+
+	wall_time = (unsigned int) (cur_wall - sample->wall);
+	idle_time = (unsigned int) (cur_idle - sample->idle);
+
+	if (ignore_nice) {
+		/*
+		 * Assumption: nice time between sampling periods will
+		 * be less than 2^32 jiffies for 32 bit sys
+		 */
+		unsigned long nice_jiffies = (unsigned long)
+			cputime64_to_jiffies64(cputime64_sub(cur_nice,
+							     sample->nice));
+
+		idle_time += jiffies_to_usecs(nice_jiffies);
+	}
+
+	sample->idle = cur_idle;
+	sample->wall = cur_wall;
+	sample->nice = cur_nice;
+
+	if (unlikely(!wall_time || wall_time < idle_time))
+		return -EAGAIN;
+
+	return 100 * (wall_time - idle_time) / wall_time;
+}
+EXPORT_SYMBOL_GPL(cpufreq_load_sample);
+
 struct cpufreq_policy *cpufreq_cpu_get(unsigned int cpu)
 {
 	struct cpufreq_policy *data;
@@ -62,9 +62,7 @@ struct cpufreq_governor cpufreq_gov_hotplug = {
 };
 
 struct cpu_dbs_info_s {
-	cputime64_t prev_cpu_idle;
-	cputime64_t prev_cpu_wall;
-	cputime64_t prev_cpu_nice;
+	struct cpufreq_load_sample sample;
 	struct cpufreq_policy *cur_policy;
 	struct delayed_work work;
 	struct cpufreq_frequency_table *freq_table;
@@ -111,32 +109,6 @@ static struct dbs_tuners {
 	.io_is_busy =			0,
 };
 
-/*
- * A corner case exists when switching io_is_busy at run-time: comparing idle
- * times from a non-io_is_busy period to an io_is_busy period (or vice-versa)
- * will misrepresent the actual change in system idleness.  We ignore this
- * corner case: enabling io_is_busy might cause freq increase and disabling
- * might cause freq decrease, which probably matches the original intent.
- */
-static inline cputime64_t get_cpu_idle_time(unsigned int cpu, cputime64_t *wall)
-{
-        u64 idle_time;
-        u64 iowait_time;
-
-        /* cpufreq-hotplug always assumes CONFIG_NO_HZ */
-        idle_time = get_cpu_idle_time_us(cpu, wall);
-
-	/* add time spent doing I/O to idle time */
-        if (dbs_tuners_ins.io_is_busy) {
-                iowait_time = get_cpu_iowait_time_us(cpu, wall);
-                /* cpufreq-hotplug always assumes CONFIG_NO_HZ */
-                if (iowait_time != -1ULL && idle_time >= iowait_time)
-                        idle_time -= iowait_time;
-        }
-
-        return idle_time;
-}
-
 /************************** sysfs interface ************************/
 
 /* XXX look at global sysfs macros in cpufreq.h, can those be used here? */
@@ -346,15 +318,12 @@ static ssize_t store_ignore_nice_load(struct kobject *a, struct attribute *b,
 	}
 	dbs_tuners_ins.ignore_nice = input;
 
-	/* we need to re-evaluate prev_cpu_idle */
+	/* we need to re-evaluate the load samples */
 	for_each_online_cpu(j) {
 		struct cpu_dbs_info_s *dbs_info;
 		dbs_info = &per_cpu(hp_cpu_dbs_info, j);
-		dbs_info->prev_cpu_idle = get_cpu_idle_time(j,
-						&dbs_info->prev_cpu_wall);
-		if (dbs_tuners_ins.ignore_nice)
-			dbs_info->prev_cpu_nice = kstat_cpu(j).cpustat.nice;
-
+		cpufreq_load_sample_init(&dbs_info->sample, j,
+					 dbs_tuners_ins.io_is_busy);
 	}
 	mutex_unlock(&dbs_mutex);
 
@@ -367,12 +336,27 @@ static ssize_t store_io_is_busy(struct kobject *a, struct attribute *b,
 	unsigned int input;
 	int ret;
 
+	unsigned int j;
+
 	ret = sscanf(buf, "%u", &input);
 	if (ret != 1)
 		return -EINVAL;
 
+	input = !!input;
 	mutex_lock(&dbs_mutex);
-	dbs_tuners_ins.io_is_busy = !!input;
+	if (input == dbs_tuners_ins.io_is_busy) { /* nothing to do */
+		mutex_unlock(&dbs_mutex);
+		return count;
+	}
+	dbs_tuners_ins.io_is_busy = input;
+
+	/* iowait moves between busy and idle time, restart the samples */
+	for_each_online_cpu(j) {
+		struct cpu_dbs_info_s *dbs_info;
+		dbs_info = &per_cpu(hp_cpu_dbs_info, j);
+		cpufreq_load_sample_init(&dbs_info->sample, j,
+					 dbs_tuners_ins.io_is_busy);
+	}
 	mutex_unlock(&dbs_mutex);
 
 	return count;
@@ -432,31 +416,17 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	 * get highest load, total load and average load across all CPUs
 	 */
 	for_each_cpu(j, policy->cpus) {
-		unsigned int load;
-		unsigned int idle_time, wall_time;
-		cputime64_t cur_wall_time, cur_idle_time;
 		struct cpu_dbs_info_s *j_dbs_info;
+		int load;
 
 		j_dbs_info = &per_cpu(hp_cpu_dbs_info, j);
 
-		/* update both cur_idle_time and cur_wall_time */
-		cur_idle_time = get_cpu_idle_time(j, &cur_wall_time);
-
-		/* how much wall time has passed since last iteration? */
-		wall_time = (unsigned int) cputime64_sub(cur_wall_time,
-				j_dbs_info->prev_cpu_wall);
-		j_dbs_info->prev_cpu_wall = cur_wall_time;
-
-		/* how much idle time has passed since last iteration? */
-		idle_time = (unsigned int) cputime64_sub(cur_idle_time,
-				j_dbs_info->prev_cpu_idle);
-		j_dbs_info->prev_cpu_idle = cur_idle_time;
-
-		if (unlikely(!wall_time || wall_time < idle_time))
-			continue;
-
 		/* load is the percentage of time not spent in idle */
-		load = 100 * (wall_time - idle_time) / wall_time;
+		load = cpufreq_load_sample(&j_dbs_info->sample, j,
+					   dbs_tuners_ins.io_is_busy,
+					   dbs_tuners_ins.ignore_nice);
+		if (load < 0)
+			continue;
 
 		/* keep track of combined load across all CPUs */
 		total_load += load;
@@ -626,12 +596,8 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 			j_dbs_info = &per_cpu(hp_cpu_dbs_info, j);
 			j_dbs_info->cur_policy = policy;
 
-			j_dbs_info->prev_cpu_idle = get_cpu_idle_time(j,
-						&j_dbs_info->prev_cpu_wall);
-			if (dbs_tuners_ins.ignore_nice) {
-				j_dbs_info->prev_cpu_nice =
-						kstat_cpu(j).cpustat.nice;
-			}
+			cpufreq_load_sample_init(&j_dbs_info->sample, j,
+						 dbs_tuners_ins.io_is_busy);
 
 			max_periods = max(DEFAULT_HOTPLUG_IN_SAMPLING_PERIODS,
 					DEFAULT_HOTPLUG_OUT_SAMPLING_PERIODS);
@@ -19,6 +19,7 @@
 #include <linux/cpu.h>
 #include <linux/cpumask.h>
 #include <linux/cpufreq.h>
+#include <linux/irq_work.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
 #include <linux/rwsem.h>
@@ -57,6 +58,7 @@ struct cpufreq_interactive_cpuinfo {
 	u64 hispeed_validate_time;
 	struct rw_semaphore enable_sem;
 	int governor_enabled;
+	unsigned long evaluating; /* bit 0 set while the load is evaluated */
 };
 
 static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
@@ -124,6 +126,17 @@ static int timer_slack_val = DEFAULT_TIMER_SLACK;
 
 static bool io_is_busy;
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+/*
+ * Also use the load the scheduler sees on the cpu, and evaluate the speed
+ * as soon as that goes up rather than at the next timer.
+ */
+static bool use_sched_load = true;
+
+static cpumask_t sched_eval_cpumask;
+static struct irq_work sched_eval_work;
+#endif
+
 /* Round to starting jiffy of next evaluation window */
 static u64 round_to_nw_start(u64 jif)
 {
@@ -141,8 +154,8 @@ static void cpufreq_interactive_timer_resched(unsigned long cpu)
 
 	spin_lock_irqsave(&pcpu->load_lock, flags);
 	pcpu->time_in_idle =
-		get_cpu_idle_time(smp_processor_id(),
-				  &pcpu->time_in_idle_timestamp, io_is_busy);
+		get_cpu_idle_time(cpu, &pcpu->time_in_idle_timestamp,
+				  io_is_busy);
 	pcpu->cputime_speedadj = 0;
 	pcpu->cputime_speedadj_timestamp = pcpu->time_in_idle_timestamp;
 	expires = round_to_nw_start(pcpu->last_evaluated_jiffy);
@@ -355,6 +368,13 @@ static void cpufreq_interactive_timer(unsigned long data)
 		return;
 	if (!pcpu->governor_enabled)
 		goto exit;
+	/*
+	 * The scheduler load input can have another cpu evaluate this one.
+	 * Whoever gets here second leaves it to the first, which rearms the
+	 * timer.
+	 */
+	if (test_and_set_bit(0, &pcpu->evaluating))
+		goto exit;
 
 	spin_lock_irqsave(&pcpu->load_lock, flags);
 	now = update_load(data);
@@ -369,6 +389,11 @@ static void cpufreq_interactive_timer(unsigned long data)
 	spin_lock_irqsave(&pcpu->target_freq_lock, flags);
 	do_div(cputime_speedadj, delta_time);
 	loadadjfreq = (unsigned int)cputime_speedadj * 100;
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	if (use_sched_load)
+		loadadjfreq = max(loadadjfreq,
+				  sched_get_cpu_load(data) * pcpu->policy->cur);
+#endif
 	cpu_load = loadadjfreq / pcpu->target_freq;
 	boosted = now < (get_input_time() + boostpulse_duration_val);
 
@@ -465,12 +490,15 @@ rearm_if_notmax:
 	 * wait until next idle to re-evaluate, don't need timer.
 	 */
 	if (pcpu->target_freq == pcpu->policy->max)
-		goto exit;
+		goto done;
 
 rearm:
 	if (!timer_pending(&pcpu->cpu_timer))
 		cpufreq_interactive_timer_resched(data);
 
+done:
+	smp_mb__before_clear_bit();
+	clear_bit(0, &pcpu->evaluating);
 exit:
 	up_read(&pcpu->enable_sem);
 	return;
@@ -533,6 +561,59 @@ static void cpufreq_interactive_idle_end(void)
 	up_read(&pcpu->enable_sem);
 }
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+static void cpufreq_interactive_sched_eval(struct irq_work *work)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu;
+	unsigned int cpu;
+
+	for_each_cpu(cpu, &sched_eval_cpumask) {
+		if (!cpumask_test_and_clear_cpu(cpu, &sched_eval_cpumask))
+			continue;
+
+		pcpu = &per_cpu(cpuinfo, cpu);
+		if (!down_read_trylock(&pcpu->enable_sem))
+			continue;
+		if (pcpu->governor_enabled) {
+			del_timer(&pcpu->cpu_timer);
+			del_timer(&pcpu->cpu_slack_timer);
+			cpufreq_interactive_timer(cpu);
+		}
+		up_read(&pcpu->enable_sem);
+	}
+}
+
+/*
+ * Called by the scheduler, with the runqueue locked, whenever the load it
+ * sees on a cpu changes. Only going faster needs to happen before the next
+ * timer, so this just checks whether the load is above the target load at
+ * the current target speed and if so has the speed evaluated from irq
+ * context.
+ */
+static int cpufreq_interactive_sched_notifier(struct notifier_block *nb,
+					      unsigned long cpu, void *data)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+	unsigned int target_freq = pcpu->target_freq;
+
+	if (!use_sched_load || !pcpu->governor_enabled ||
+	    target_freq >= pcpu->policy->max)
+		return NOTIFY_DONE;
+
+	if (sched_get_cpu_load(cpu) * pcpu->policy->cur <=
+	    target_freq * freq_to_targetload(target_freq))
+		return NOTIFY_DONE;
+
+	cpumask_set_cpu(cpu, &sched_eval_cpumask);
+	irq_work_queue(&sched_eval_work);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block cpufreq_interactive_sched_nb = {
+	.notifier_call = cpufreq_interactive_sched_notifier,
+};
+#endif
+
 static int cpufreq_interactive_speedchange_task(void *data)
 {
 	unsigned int cpu;
@@ -958,6 +1039,30 @@ static ssize_t store_io_is_busy(struct kobject *kobj,
 static struct global_attr io_is_busy_attr = __ATTR(io_is_busy, 0644,
 		show_io_is_busy, store_io_is_busy);
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+static ssize_t show_use_sched_load(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", use_sched_load);
+}
+
+static ssize_t store_use_sched_load(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	use_sched_load = val;
+	return count;
+}
+
+static struct global_attr use_sched_load_attr = __ATTR(use_sched_load, 0644,
+		show_use_sched_load, store_use_sched_load);
+#endif
+
 static struct attribute *interactive_attributes[] = {
 	&target_loads_attr.attr,
 	&above_hispeed_delay_attr.attr,
@@ -969,6 +1074,9 @@ static struct attribute *interactive_attributes[] = {
 	&timer_slack.attr,
 	&boostpulse_duration.attr,
 	&io_is_busy_attr.attr,
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	&use_sched_load_attr.attr,
+#endif
 	NULL,
 };
 
@@ -1057,6 +1165,10 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		idle_notifier_register(&cpufreq_interactive_idle_nb);
 		cpufreq_register_notifier(
 			&cpufreq_notifier_block, CPUFREQ_TRANSITION_NOTIFIER);
+#ifdef CONFIG_SCHED_FREQ_INPUT
+		sched_freq_input_register_notifier(
+			&cpufreq_interactive_sched_nb);
+#endif
 		mutex_unlock(&gov_lock);
 		break;
 
@@ -1077,6 +1189,11 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			return 0;
 		}
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+		sched_freq_input_unregister_notifier(
+			&cpufreq_interactive_sched_nb);
+		irq_work_sync(&sched_eval_work);
+#endif
 		cpufreq_unregister_notifier(
 			&cpufreq_notifier_block, CPUFREQ_TRANSITION_NOTIFIER);
 		idle_notifier_unregister(&cpufreq_interactive_idle_nb);
@@ -1169,6 +1286,9 @@ static int __init cpufreq_interactive_init(void)
 	spin_lock_init(&speedchange_cpumask_lock);
 	spin_lock_init(&above_hispeed_delay_lock);
 	mutex_init(&gov_lock);
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	init_irq_work(&sched_eval_work, cpufreq_interactive_sched_eval);
+#endif
 	speedchange_task =
 		kthread_create(cpufreq_interactive_speedchange_task, NULL,
 			       "cfinteractive");
@@ -78,10 +78,7 @@ struct cpufreq_governor cpufreq_gov_lazy = {
 enum {DBS_NORMAL_SAMPLE, DBS_SUB_SAMPLE};
 
 struct cpu_dbs_info_s {
-    cputime64_t prev_cpu_idle;
-    cputime64_t prev_cpu_iowait;
-    cputime64_t prev_cpu_wall;
-    cputime64_t prev_cpu_nice;
+    struct cpufreq_load_sample sample;
     struct cpufreq_policy *cur_policy;
     struct delayed_work work;
     struct cpufreq_frequency_table *freq_table;
@@ -151,49 +148,6 @@ static struct early_suspend lazy_suspend = {
 };
 #endif
 
-static inline cputime64_t get_cpu_idle_time_jiffy(unsigned int cpu,
-						  cputime64_t *wall)
-{
-    cputime64_t idle_time;
-    cputime64_t cur_wall_time;
-    cputime64_t busy_time;
-
-    cur_wall_time = jiffies64_to_cputime64(get_jiffies_64());
-    busy_time = cputime64_add(kstat_cpu(cpu).cpustat.user,
-			      kstat_cpu(cpu).cpustat.system);
-
-    busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.irq);
-    busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.softirq);
-    busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.steal);
-    busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.nice);
-
-    idle_time = cputime64_sub(cur_wall_time, busy_time);
-    if (wall)
-	*wall = (cputime64_t)jiffies_to_usecs(cur_wall_time);
-
-    return (cputime64_t)jiffies_to_usecs(idle_time);
-}
-
-static inline cputime64_t get_cpu_idle_time(unsigned int cpu, cputime64_t *wall)
-{
-    u64 idle_time = get_cpu_idle_time_us(cpu, wall);
-
-    if (idle_time == -1ULL)
-	return get_cpu_idle_time_jiffy(cpu, wall);
-
-    return idle_time;
-}
-
-static inline cputime64_t get_cpu_iowait_time(unsigned int cpu, cputime64_t *wall)
-{
-    u64 iowait_time = get_cpu_iowait_time_us(cpu, wall);
-
-    if (iowait_time == -1ULL)
-	return 0;
-
-    return iowait_time;
-}
-
 /*
  * Find right freq to be set now with powersave_bias on.
  * Returns the freq_hi to be used right now and will set freq_hi_jiffies,
@@ -310,10 +264,24 @@ static ssize_t store_io_is_busy(struct kobject *a, struct attribute *b,
     unsigned int input;
     int ret;
 
+    unsigned int j;
+
     ret = sscanf(buf, "%u", &input);
     if (ret != 1)
 	return -EINVAL;
-    dbs_tuners_ins.io_is_busy = !!input;
+
+    input = !!input;
+    if (input == dbs_tuners_ins.io_is_busy) /* nothing to do */
+	return count;
+    dbs_tuners_ins.io_is_busy = input;
+
+    /* iowait moves between busy and idle time, restart the samples */
+    for_each_online_cpu(j) {
+	struct cpu_dbs_info_s *dbs_info;
+	dbs_info = &per_cpu(od_cpu_dbs_info, j);
+	cpufreq_load_sample_init(&dbs_info->sample, j,
+				 dbs_tuners_ins.io_is_busy);
+    }
     return count;
 }
 
@@ -353,15 +321,12 @@ static ssize_t store_ignore_nice_load(struct kobject *a, struct attribute *b,
     }
     dbs_tuners_ins.ignore_nice = input;
 
-    /* we need to re-evaluate prev_cpu_idle */
+    /* we need to re-evaluate the load samples */
     for_each_online_cpu(j) {
 	struct cpu_dbs_info_s *dbs_info;
 	dbs_info = &per_cpu(od_cpu_dbs_info, j);
-	dbs_info->prev_cpu_idle = get_cpu_idle_time(j,
-						    &dbs_info->prev_cpu_wall);
-	if (dbs_tuners_ins.ignore_nice)
-	    dbs_info->prev_cpu_nice = kstat_cpu(j).cpustat.nice;
-
+	cpufreq_load_sample_init(&dbs_info->sample, j,
+				 dbs_tuners_ins.io_is_busy);
     }
     return count;
 }
@@ -490,60 +455,17 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 
     for_each_cpu(j, policy->cpus) {
 	struct cpu_dbs_info_s *j_dbs_info;
-	cputime64_t cur_wall_time, cur_idle_time, cur_iowait_time;
-	unsigned int idle_time, wall_time, iowait_time;
-	unsigned int load, load_freq;
-	int freq_avg;
+	unsigned int load_freq;
+	int load, freq_avg;
 
 	j_dbs_info = &per_cpu(od_cpu_dbs_info, j);
 
-	cur_idle_time = get_cpu_idle_time(j, &cur_wall_time);
-	cur_iowait_time = get_cpu_iowait_time(j, &cur_wall_time);
-
-	wall_time = (unsigned int) cputime64_sub(cur_wall_time,
-						 j_dbs_info->prev_cpu_wall);
-	j_dbs_info->prev_cpu_wall = cur_wall_time;
-
-	idle_time = (unsigned int) cputime64_sub(cur_idle_time,
-						 j_dbs_info->prev_cpu_idle);
-	j_dbs_info->prev_cpu_idle = cur_idle_time;
-
-	iowait_time = (unsigned int) cputime64_sub(cur_iowait_time,
-						   j_dbs_info->prev_cpu_iowait);
-	j_dbs_info->prev_cpu_iowait = cur_iowait_time;
-
-	if (dbs_tuners_ins.ignore_nice) {
-	    cputime64_t cur_nice;
-	    unsigned long cur_nice_jiffies;
-
-	    cur_nice = cputime64_sub(kstat_cpu(j).cpustat.nice,
-				     j_dbs_info->prev_cpu_nice);
-	    /*
-	     * Assumption: nice time between sampling periods will
-	     * be less than 2^32 jiffies for 32 bit sys
-	     */
-	    cur_nice_jiffies = (unsigned long)
-		cputime64_to_jiffies64(cur_nice);
-
-	    j_dbs_info->prev_cpu_nice = kstat_cpu(j).cpustat.nice;
-	    idle_time += jiffies_to_usecs(cur_nice_jiffies);
-	}
-
-	/*
-	 * For the purpose of lazy, waiting for disk IO is an
-	 * indication that you're performance critical, and not that
-	 * the system is actually idle. So subtract the iowait time
-	 * from the cpu idle time.
-	 */
-
-	if (dbs_tuners_ins.io_is_busy && idle_time >= iowait_time)
-	    idle_time -= iowait_time;
-
-	if (unlikely(!wall_time || wall_time < idle_time))
+	load = cpufreq_load_sample(&j_dbs_info->sample, j,
+				   dbs_tuners_ins.io_is_busy,
+				   dbs_tuners_ins.ignore_nice);
+	if (load < 0)
 	    continue;
 
-	load = 100 * (wall_time - idle_time) / wall_time;
-
 	freq_avg = __cpufreq_driver_getavg(policy, j);
 	if (freq_avg <= 0)
 	    freq_avg = policy->cur;
@@ -698,17 +620,16 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 	mutex_lock(&dbs_mutex);
 
 	dbs_enable++;
+	/* the samples started below depend on io_is_busy */
+	if (dbs_enable == 1)
+	    dbs_tuners_ins.io_is_busy = should_io_be_busy();
 	for_each_cpu(j, policy->cpus) {
 	    struct cpu_dbs_info_s *j_dbs_info;
 	    j_dbs_info = &per_cpu(od_cpu_dbs_info, j);
 	    j_dbs_info->cur_policy = policy;
 
-	    j_dbs_info->prev_cpu_idle = get_cpu_idle_time(j,
-							  &j_dbs_info->prev_cpu_wall);
-	    if (dbs_tuners_ins.ignore_nice) {
-		j_dbs_info->prev_cpu_nice =
-		    kstat_cpu(j).cpustat.nice;
-	    }
+	    cpufreq_load_sample_init(&j_dbs_info->sample, j,
+				     dbs_tuners_ins.io_is_busy);
 	}
 	this_dbs_info->cpu = cpu;
 	lazy_powersave_bias_init_cpu(cpu);
@@ -737,7 +658,6 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 	    current_sampling_rate = dbs_tuners_ins.sampling_rate;
 	    dbs_tuners_ins.min_timeinstate = latency * LATENCY_MULTIPLIER;
 	    dbs_tuners_ins.min_timeinstate = max(dbs_tuners_ins.sampling_rate, dbs_tuners_ins.min_timeinstate);
-	    dbs_tuners_ins.io_is_busy = should_io_be_busy();
 	}
 	mutex_unlock(&dbs_mutex);
 
@@ -138,6 +138,7 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 				     unsigned long flags)
 {
 	struct ion_buffer *buffer;
+	ktime_t start = ktime_get();
 	int ret;
 
 	buffer = kzalloc(sizeof(struct ion_buffer), GFP_KERNEL);
@@ -148,6 +149,13 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	kref_init(&buffer->ref);
 
 	ret = heap->ops->allocate(heap, buffer, len, align, flags);
+	/* the memory may just be waiting to be freed, try again without it */
+	if (ret && (heap->flags & ION_HEAP_FLAG_DEFER_FREE) &&
+	    ion_heap_freelist_drain(heap, 0))
+		ret = heap->ops->allocate(heap, buffer, len, align, flags);
+	/* zero length buffers are sized, and accounted, by their heap */
+	if (len)
+		ion_heap_stats_alloc(heap, len, start, ret);
 	if (ret) {
 		kfree(buffer);
 		return ERR_PTR(ret);
@@ -159,16 +167,31 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	return buffer;
 }
 
+void ion_buffer_free(struct ion_buffer *buffer)
+{
+	/* a leftover kernel mapping would alias pages going back to the heap */
+	if (WARN_ON(buffer->kmap_cnt > 0))
+		buffer->heap->ops->unmap_kernel(buffer->heap, buffer);
+	if (buffer->size)
+		ion_heap_stats_free(buffer->heap, buffer->size);
+	buffer->heap->ops->free(buffer);
+	kfree(buffer);
+}
+
 static void ion_buffer_destroy(struct kref *kref)
 {
 	struct ion_buffer *buffer = container_of(kref, struct ion_buffer, ref);
 	struct ion_device *dev = buffer->dev;
+	struct ion_heap *heap = buffer->heap;
 
-	buffer->heap->ops->free(buffer);
 	mutex_lock(&dev->lock);
 	rb_erase(&buffer->node, &dev->buffers);
 	mutex_unlock(&dev->lock);
-	kfree(buffer);
+
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		ion_heap_freelist_add(heap, buffer);
+	else
+		ion_buffer_free(buffer);
 }
 
 static void ion_buffer_get(struct ion_buffer *buffer)
@@ -1085,6 +1108,7 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 	struct ion_device *dev = heap->dev;
 	struct rb_node *n;
 
+	mutex_lock(&dev->lock);
 	seq_printf(s, "%16.s %16.s %16.s\n", "client", "pid", "size");
 	for (n = rb_first(&dev->user_clients); n; n = rb_next(n)) {
 		struct ion_client *client = rb_entry(n, struct ion_client,
@@ -1108,6 +1132,14 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 		seq_printf(s, "%16.s %16u %16u\n", client->name, client->pid,
 			   size);
 	}
+	mutex_unlock(&dev->lock);
+
+	seq_printf(s, "\n");
+	ion_heap_stats_show(heap, s);
+	if (heap->ops->debug_show) {
+		seq_printf(s, "\n");
+		heap->ops->debug_show(heap, s);
+	}
 	return 0;
 }
 
@@ -1123,6 +1155,81 @@ static const struct file_operations debug_heap_fops = {
 	.release = single_release,
 };
 
+static size_t ion_debug_client_heap_total(struct ion_client *client,
+					  struct ion_heap *heap)
+{
+	size_t size = 0;
+	struct rb_node *n;
+
+	mutex_lock(&client->lock);
+	for (n = rb_first(&client->handles); n; n = rb_next(n)) {
+		struct ion_handle *handle = rb_entry(n,
+						     struct ion_handle,
+						     node);
+		if (handle->buffer->heap == heap)
+			size += handle->buffer->size;
+	}
+	mutex_unlock(&client->lock);
+	return size;
+}
+
+static void ion_debug_clients_show_one(struct seq_file *s,
+				       struct ion_client *client,
+				       const char *name)
+{
+	struct ion_device *dev = client->dev;
+	struct rb_node *n;
+
+	for (n = rb_first(&dev->heaps); n; n = rb_next(n)) {
+		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
+		size_t size = ion_debug_client_heap_total(client, heap);
+
+		if (!size)
+			continue;
+		seq_printf(s, "%16s %16u %16s %16zu\n", name, client->pid,
+			   heap->name, size);
+	}
+}
+
+/* what every client holds, broken down by heap */
+static int ion_debug_clients_show(struct seq_file *s, void *unused)
+{
+	struct ion_device *dev = s->private;
+	struct rb_node *n;
+
+	seq_printf(s, "%16s %16s %16s %16s\n", "client", "pid", "heap",
+		   "size");
+	mutex_lock(&dev->lock);
+	for (n = rb_first(&dev->user_clients); n; n = rb_next(n)) {
+		struct ion_client *client = rb_entry(n, struct ion_client,
+						     node);
+		char task_comm[TASK_COMM_LEN];
+
+		get_task_comm(task_comm, client->task);
+		ion_debug_clients_show_one(s, client, task_comm);
+	}
+	for (n = rb_first(&dev->kernel_clients); n; n = rb_next(n)) {
+		struct ion_client *client = rb_entry(n, struct ion_client,
+						     node);
+
+		ion_debug_clients_show_one(s, client, client->name);
+	}
+	mutex_unlock(&dev->lock);
+	return 0;
+}
+
+static int ion_debug_clients_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ion_debug_clients_show, inode->i_private);
+}
+
+static const struct file_operations debug_clients_fops = {
+	.open = ion_debug_clients_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 {
 	struct rb_node **p = &dev->heaps.rb_node;
@@ -1130,6 +1237,7 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 	struct ion_heap *entry;
 
 	heap->dev = dev;
+	spin_lock_init(&heap->stats.lock);
 	mutex_lock(&dev->lock);
 	while (*p) {
 		parent = *p;
@@ -1146,6 +1254,13 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 		}
 	}
 
+	if ((heap->flags & ION_HEAP_FLAG_DEFER_FREE) &&
+	    ion_heap_init_deferred_free(heap)) {
+		pr_err("%s: failed to start deferred free for heap %s, "
+		       "freeing synchronously\n", __func__, heap->name);
+		heap->flags &= ~ION_HEAP_FLAG_DEFER_FREE;
+	}
+
 	rb_link_node(&heap->node, parent, p);
 	rb_insert_color(&heap->node, &dev->heaps);
 	debugfs_create_file(heap->name, 0664, dev->debug_root, heap,
@@ -1186,6 +1301,8 @@ struct ion_device *ion_device_create(long (*custom_ioctl)
 	idev->heaps = RB_ROOT;
 	idev->user_clients = RB_ROOT;
 	idev->kernel_clients = RB_ROOT;
+	debugfs_create_file("clients", 0444, idev->debug_root, idev,
+			    &debug_clients_fops);
 	return idev;
 }
 
@@ -21,6 +21,7 @@
 #include <linux/ion.h>
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include "ion_priv.h"
@@ -120,6 +121,17 @@ int ion_carveout_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 			       pgprot_noncached(vma->vm_page_prot));
 }
 
+void ion_carveout_heap_debug_show(struct ion_heap *heap, struct seq_file *s)
+{
+	struct ion_carveout_heap *carveout_heap =
+		container_of(heap, struct ion_carveout_heap, heap);
+	size_t avail, largest;
+
+	avail = gen_pool_avail(carveout_heap->pool, &largest);
+	seq_printf(s, "carveout size %zu free %zu largest free chunk %zu\n",
+		   gen_pool_size(carveout_heap->pool), avail, largest);
+}
+
 static struct ion_heap_ops carveout_heap_ops = {
 	.allocate = ion_carveout_heap_allocate,
 	.free = ion_carveout_heap_free,
@@ -127,6 +139,7 @@ static struct ion_heap_ops carveout_heap_ops = {
 	.map_user = ion_carveout_heap_map_user,
 	.map_kernel = ion_carveout_heap_map_kernel,
 	.unmap_kernel = ion_carveout_heap_unmap_kernel,
+	.debug_show = ion_carveout_heap_debug_show,
 };
 
 struct ion_heap *ion_carveout_heap_create(struct ion_platform_heap *heap_data)
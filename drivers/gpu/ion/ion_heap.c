@@ -15,7 +15,14 @@
  */
 
 #include <linux/err.h>
+#include <linux/freezer.h>
 #include <linux/ion.h>
+#include <linux/kthread.h>
+#include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 #include "ion_priv.h"
 
 struct ion_heap *ion_heap_create(struct ion_platform_heap *heap_data)
@@ -47,6 +54,7 @@ struct ion_heap *ion_heap_create(struct ion_platform_heap *heap_data)
 
 	heap->name = heap_data->name;
 	heap->id = heap_data->id;
+	heap->flags = heap_data->flags;
 	return heap;
 }
 
@@ -70,3 +78,191 @@ void ion_heap_destroy(struct ion_heap *heap)
 		       heap->type);
 	}
 }
+
+static int ion_stat_bucket(unsigned long val)
+{
+	int bucket = val > 1 ? ilog2(val - 1) + 1 : 0;
+
+	return min(bucket, ION_STAT_BUCKETS - 1);
+}
+
+void ion_heap_stats_alloc(struct ion_heap *heap, size_t size, ktime_t start,
+			  int ret)
+{
+	struct ion_heap_stats *stats = &heap->stats;
+	s64 us = ktime_us_delta(ktime_get(), start);
+
+	spin_lock(&stats->lock);
+	stats->latency_hist[ion_stat_bucket(us)]++;
+	if (ret) {
+		stats->failed++;
+	} else {
+		stats->allocs++;
+		stats->size_hist[ion_stat_bucket(PAGE_ALIGN(size) >>
+						 PAGE_SHIFT)]++;
+		stats->in_use += size;
+		stats->peak = max(stats->peak, stats->in_use);
+	}
+	spin_unlock(&stats->lock);
+}
+
+void ion_heap_stats_free(struct ion_heap *heap, size_t size)
+{
+	struct ion_heap_stats *stats = &heap->stats;
+
+	spin_lock(&stats->lock);
+	stats->frees++;
+	stats->in_use -= size;
+	spin_unlock(&stats->lock);
+}
+
+void ion_heap_stats_show(struct ion_heap *heap, struct seq_file *s)
+{
+	struct ion_heap_stats stats;
+	int i;
+
+	spin_lock(&heap->stats.lock);
+	stats = heap->stats;
+	spin_unlock(&heap->stats.lock);
+
+	seq_printf(s, "allocs %lu failed %lu frees %lu\n",
+		   stats.allocs, stats.failed, stats.frees);
+	seq_printf(s, "in use %zu peak %zu\n", stats.in_use, stats.peak);
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		seq_printf(s, "waiting to be freed %zu\n",
+			   ion_heap_freelist_size(heap));
+
+	seq_printf(s, "\n%16s %16s %16s %16s\n", "size <=", "allocs",
+		   "latency <= us", "allocs");
+	for (i = 0; i < ION_STAT_BUCKETS; i++) {
+		if (i < ION_STAT_BUCKETS - 1)
+			seq_printf(s, "%16lu %16lu %16lu %16lu\n",
+				   PAGE_SIZE << i, stats.size_hist[i],
+				   1UL << i, stats.latency_hist[i]);
+		else
+			seq_printf(s, "%16s %16lu %16s %16lu\n", "more",
+				   stats.size_hist[i], "more",
+				   stats.latency_hist[i]);
+	}
+}
+
+void ion_heap_freelist_add(struct ion_heap *heap, struct ion_buffer *buffer)
+{
+	spin_lock(&heap->free_lock);
+	list_add_tail(&buffer->list, &heap->free_list);
+	heap->free_list_size += buffer->size;
+	spin_unlock(&heap->free_lock);
+	wake_up(&heap->waitqueue);
+}
+
+size_t ion_heap_freelist_size(struct ion_heap *heap)
+{
+	size_t size;
+
+	spin_lock(&heap->free_lock);
+	size = heap->free_list_size;
+	spin_unlock(&heap->free_lock);
+
+	return size;
+}
+
+/*
+ * Buffers are taken off the list in one go and freed with free_lock
+ * dropped, so queueing a free never waits for the heap.
+ */
+static size_t _ion_heap_freelist_drain(struct ion_heap *heap, size_t size,
+				       bool trylock)
+{
+	struct ion_buffer *buffer, *tmp;
+	LIST_HEAD(batch);
+	size_t freed = 0;
+
+	if (trylock) {
+		if (!mutex_trylock(&heap->free_mutex))
+			return 0;
+	} else {
+		mutex_lock(&heap->free_mutex);
+	}
+
+	spin_lock(&heap->free_lock);
+	list_for_each_entry_safe(buffer, tmp, &heap->free_list, list) {
+		if (size && freed >= size)
+			break;
+		list_move_tail(&buffer->list, &batch);
+		freed += buffer->size;
+	}
+	heap->free_list_size -= freed;
+	spin_unlock(&heap->free_lock);
+
+	list_for_each_entry_safe(buffer, tmp, &batch, list) {
+		list_del(&buffer->list);
+		ion_buffer_free(buffer);
+	}
+
+	mutex_unlock(&heap->free_mutex);
+
+	return freed;
+}
+
+size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size)
+{
+	return _ion_heap_freelist_drain(heap, size, false);
+}
+
+static int ion_heap_deferred_free(void *data)
+{
+	struct ion_heap *heap = data;
+
+	set_freezable();
+	while (!kthread_should_stop()) {
+		wait_event_freezable(heap->waitqueue,
+				     ion_heap_freelist_size(heap) > 0 ||
+				     kthread_should_stop());
+		ion_heap_freelist_drain(heap, 0);
+	}
+
+	return 0;
+}
+
+/*
+ * Under memory pressure, don't wait for the (idle priority) thread to get
+ * around to the queued buffers. Counts are in pages.
+ */
+static int ion_heap_shrink(struct shrinker *shrinker,
+			   struct shrink_control *sc)
+{
+	struct ion_heap *heap = container_of(shrinker, struct ion_heap,
+					     shrinker);
+
+	if (sc->nr_to_scan)
+		_ion_heap_freelist_drain(heap, sc->nr_to_scan * PAGE_SIZE,
+					 true);
+
+	return ion_heap_freelist_size(heap) / PAGE_SIZE;
+}
+
+int ion_heap_init_deferred_free(struct ion_heap *heap)
+{
+	struct sched_param param = { .sched_priority = 0 };
+
+	INIT_LIST_HEAD(&heap->free_list);
+	heap->free_list_size = 0;
+	spin_lock_init(&heap->free_lock);
+	mutex_init(&heap->free_mutex);
+	init_waitqueue_head(&heap->waitqueue);
+
+	heap->task = kthread_run(ion_heap_deferred_free, heap,
+				 "ion_%s", heap->name);
+	if (IS_ERR(heap->task)) {
+		pr_err("%s: creating thread for deferred free failed\n",
+		       __func__);
+		return PTR_ERR(heap->task);
+	}
+	sched_setscheduler(heap->task, SCHED_IDLE, &param);
+
+	heap->shrinker.shrink = ion_heap_shrink;
+	heap->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&heap->shrinker);
+
+	return 0;
+}
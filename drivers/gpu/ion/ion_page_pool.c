@@ -0,0 +1,175 @@
+/*
+ * drivers/gpu/ion/ion_page_pool.c
+ *
+ * Copyright (C) 2011 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/err.h>
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include "ion_priv.h"
+
+/*
+ * Pages in the pool are kept on lists through page->lru, which is unused
+ * for pages that came straight from the page allocator.
+ */
+
+static void ion_page_pool_zero(struct ion_page_pool *pool, struct page *page)
+{
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++) {
+		clear_highpage(page + i);
+		if (pool->order)
+			cond_resched();
+	}
+}
+
+static void ion_page_pool_zero_work(struct work_struct *work)
+{
+	struct ion_page_pool *pool = container_of(work, struct ion_page_pool,
+						  zero_work);
+	struct page *page;
+
+	mutex_lock(&pool->mutex);
+	while (pool->dirty_count) {
+		page = list_first_entry(&pool->dirty_items, struct page, lru);
+		list_del(&page->lru);
+		pool->dirty_count--;
+		mutex_unlock(&pool->mutex);
+
+		ion_page_pool_zero(pool, page);
+
+		mutex_lock(&pool->mutex);
+		list_add_tail(&page->lru, &pool->clean_items);
+		pool->clean_count++;
+	}
+	mutex_unlock(&pool->mutex);
+}
+
+/**
+ * ion_page_pool_alloc - get a zeroed page of the pool's order
+ *
+ * Pages zeroed in the background are used first, then pages still waiting
+ * to be zeroed, and only then new pages from the page allocator.
+ */
+struct page *ion_page_pool_alloc(struct ion_page_pool *pool)
+{
+	struct page *page = NULL;
+	bool dirty = false;
+
+	mutex_lock(&pool->mutex);
+	if (pool->clean_count) {
+		page = list_first_entry(&pool->clean_items, struct page, lru);
+		pool->clean_count--;
+	} else if (pool->dirty_count) {
+		page = list_first_entry(&pool->dirty_items, struct page, lru);
+		pool->dirty_count--;
+		dirty = true;
+	}
+	if (page)
+		list_del(&page->lru);
+	mutex_unlock(&pool->mutex);
+
+	if (!page)
+		return alloc_pages(pool->gfp_mask | __GFP_ZERO, pool->order);
+
+	if (dirty)
+		ion_page_pool_zero(pool, page);
+	return page;
+}
+
+/**
+ * ion_page_pool_free - return a page to the pool
+ *
+ * The page is zeroed in the background before it is handed out again.
+ */
+void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
+{
+	mutex_lock(&pool->mutex);
+	list_add_tail(&page->lru, &pool->dirty_items);
+	pool->dirty_count++;
+	mutex_unlock(&pool->mutex);
+
+	schedule_work(&pool->zero_work);
+}
+
+/**
+ * ion_page_pool_shrink - free up to nr_to_scan pages from the pool
+ *
+ * Pages waiting to be zeroed go first. Counts are in order-0 pages; returns
+ * the number of pages freed, or with nr_to_scan == 0 the number of pages in
+ * the pool. This runs from reclaim, so it gives up rather than wait for the
+ * pool.
+ */
+int ion_page_pool_shrink(struct ion_page_pool *pool, int nr_to_scan)
+{
+	struct page *page;
+	int freed = 0;
+
+	if (!mutex_trylock(&pool->mutex))
+		return 0;
+
+	if (!nr_to_scan) {
+		freed = (pool->dirty_count + pool->clean_count) << pool->order;
+		mutex_unlock(&pool->mutex);
+		return freed;
+	}
+
+	while (freed < nr_to_scan && (pool->dirty_count || pool->clean_count)) {
+		if (pool->dirty_count) {
+			page = list_first_entry(&pool->dirty_items,
+						struct page, lru);
+			pool->dirty_count--;
+		} else {
+			page = list_first_entry(&pool->clean_items,
+						struct page, lru);
+			pool->clean_count--;
+		}
+		list_del(&page->lru);
+		__free_pages(page, pool->order);
+		freed += 1 << pool->order;
+	}
+	mutex_unlock(&pool->mutex);
+
+	return freed;
+}
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
+{
+	struct ion_page_pool *pool = kmalloc(sizeof(struct ion_page_pool),
+					     GFP_KERNEL);
+	if (!pool)
+		return NULL;
+	pool->clean_count = 0;
+	pool->dirty_count = 0;
+	INIT_LIST_HEAD(&pool->clean_items);
+	INIT_LIST_HEAD(&pool->dirty_items);
+	pool->gfp_mask = gfp_mask;
+	pool->order = order;
+	mutex_init(&pool->mutex);
+	INIT_WORK(&pool->zero_work, ion_page_pool_zero_work);
+
+	return pool;
+}
+
+void ion_page_pool_destroy(struct ion_page_pool *pool)
+{
+	cancel_work_sync(&pool->zero_work);
+	ion_page_pool_shrink(pool, INT_MAX);
+	kfree(pool);
+}
@@ -18,9 +18,16 @@
 #define _ION_PRIV_H
 
 #include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
 #include <linux/rbtree.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <linux/ion.h>
 
 struct ion_mapping;
@@ -54,6 +61,7 @@ struct ion_buffer *ion_handle_buffer(struct ion_handle *handle);
  * @vaddr:		the kenrel mapping if kmap_cnt is not zero
  * @dmap_cnt:		number of times the buffer is mapped for dma
  * @sglist:		the scatterlist for the buffer is dmap_cnt is not zero
+ * @list:		entry in the heap's free_list once the buffer is freed
 */
 struct ion_buffer {
 	struct kref ref;
@@ -71,6 +79,7 @@ struct ion_buffer {
 	void *vaddr;
 	int dmap_cnt;
 	struct scatterlist *sglist;
+	struct list_head list;
 };
 
 /**
@@ -84,6 +93,8 @@ struct ion_buffer {
  * @map_kernel		map memory to the kernel
  * @unmap_kernel	unmap memory to the kernel
  * @map_user		map memory to userspace
+ * @debug_show		print heap specific state, such as fragmentation, to
+ *			the heap's debugfs file
  */
 struct ion_heap_ops {
 	int (*allocate) (struct ion_heap *heap,
@@ -99,6 +110,33 @@ struct ion_heap_ops {
 	void (*unmap_kernel) (struct ion_heap *heap, struct ion_buffer *buffer);
 	int (*map_user) (struct ion_heap *mapper, struct ion_buffer *buffer,
 			 struct vm_area_struct *vma);
+	void (*debug_show) (struct ion_heap *heap, struct seq_file *s);
+};
+
+#define ION_STAT_BUCKETS	16
+
+/**
+ * struct ion_heap_stats - allocation statistics of a heap, for debugfs
+ * @lock:		protects the fields below
+ * @allocs:		number of successful allocations
+ * @failed:		number of failed allocations
+ * @frees:		number of buffers given back to the heap
+ * @in_use:		bytes allocated and not yet given back
+ * @peak:		highest in_use seen
+ * @size_hist:		allocations by size, bucket i counts sizes up to
+ *			PAGE_SIZE << i and the last bucket everything larger
+ * @latency_hist:	allocations by time taken, bucket i counts times up to
+ *			2^i microseconds and the last bucket everything longer
+ */
+struct ion_heap_stats {
+	spinlock_t lock;
+	unsigned long allocs;
+	unsigned long failed;
+	unsigned long frees;
+	size_t in_use;
+	size_t peak;
+	unsigned long size_hist[ION_STAT_BUCKETS];
+	unsigned long latency_hist[ION_STAT_BUCKETS];
 };
 
 /**
@@ -111,6 +149,15 @@ struct ion_heap_ops {
  *			allocating.  These are specified by platform data and
  *			MUST be unique
  * @name:		used for debugging
+ * @flags:		ION_HEAP_FLAG_* flags, from the platform data
+ * @free_list:		buffers waiting to be freed, if ION_HEAP_FLAG_DEFER_FREE
+ * @free_list_size:	total size of the buffers on free_list
+ * @free_lock:		protects free_list and free_list_size
+ * @free_mutex:		held while buffers taken off free_list are freed
+ * @waitqueue:		wakes the deferred free thread
+ * @task:		the deferred free thread
+ * @shrinker:		drains free_list under memory pressure
+ * @stats:		allocation statistics
  *
  * Represents a pool of memory from which buffers can be made.  In some
  * systems the only heap is regular system memory allocated via vmalloc.
@@ -124,6 +171,15 @@ struct ion_heap {
 	struct ion_heap_ops *ops;
 	int id;
 	const char *name;
+	unsigned long flags;
+	struct list_head free_list;
+	size_t free_list_size;
+	spinlock_t free_lock;
+	struct mutex free_mutex;
+	wait_queue_head_t waitqueue;
+	struct task_struct *task;
+	struct shrinker shrinker;
+	struct ion_heap_stats stats;
 };
 
 /**
@@ -150,6 +206,74 @@ void ion_device_destroy(struct ion_device *dev);
  */
 void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap);
 
+/**
+ * ion_buffer_free - release a buffer's memory back to its heap
+ * @buffer:		a buffer nobody holds a reference to anymore
+ *
+ * Called either when the last reference is dropped or, for heaps with
+ * ION_HEAP_FLAG_DEFER_FREE, later from the heap's deferred free thread.
+ */
+void ion_buffer_free(struct ion_buffer *buffer);
+
+/**
+ * ion_heap_init_deferred_free - start the deferred free thread of a heap
+ * @heap:		a heap with ION_HEAP_FLAG_DEFER_FREE set
+ *
+ * Called by ion_device_add_heap.
+ */
+int ion_heap_init_deferred_free(struct ion_heap *heap);
+
+/**
+ * ion_heap_freelist_add - queue a buffer to be freed
+ * @heap:		the heap
+ * @buffer:		the buffer
+ */
+void ion_heap_freelist_add(struct ion_heap *heap, struct ion_buffer *buffer);
+
+/**
+ * ion_heap_freelist_drain - free the buffers queued on a heap
+ * @heap:		the heap
+ * @size:		stop once this many bytes are freed, 0 for all
+ *
+ * Returns the number of bytes freed. Waits for buffers the deferred free
+ * thread is freeing at the same time, so that after draining everything
+ * the memory really is back in the heap.
+ */
+size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size);
+
+/**
+ * ion_heap_freelist_size - total size of the buffers queued to be freed
+ * @heap:		the heap
+ */
+size_t ion_heap_freelist_size(struct ion_heap *heap);
+
+/**
+ * ion_heap_stats_alloc - account an allocation attempt
+ * @heap:		the heap
+ * @size:		the size of the buffer
+ * @start:		when the allocation started
+ * @ret:		the result of the allocation
+ *
+ * Called by ion_buffer_create. Heaps that size their buffers themselves
+ * after creating them with a length of zero account for them here instead.
+ */
+void ion_heap_stats_alloc(struct ion_heap *heap, size_t size, ktime_t start,
+			  int ret);
+
+/**
+ * ion_heap_stats_free - account a buffer given back to the heap
+ * @heap:		the heap
+ * @size:		the size of the buffer
+ */
+void ion_heap_stats_free(struct ion_heap *heap, size_t size);
+
+/**
+ * ion_heap_stats_show - print the statistics of a heap
+ * @heap:		the heap
+ * @s:			the seq_file of the heap's debugfs file
+ */
+void ion_heap_stats_show(struct ion_heap *heap, struct seq_file *s);
+
 /**
  * functions for creating and destroying the built in ion heaps.
  * architectures can add their own custom architecture specific
@@ -175,6 +299,39 @@ ion_phys_addr_t ion_carveout_allocate(struct ion_heap *heap, unsigned long size,
 				      unsigned long align);
 void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
 		       unsigned long size);
+void ion_carveout_heap_debug_show(struct ion_heap *heap, struct seq_file *s);
+/**
+ * struct ion_page_pool - pool of pages of one order
+ * @clean_count:	number of zeroed pages in the pool
+ * @dirty_count:	number of pages waiting to be zeroed
+ * @clean_items:	list of zeroed pages
+ * @dirty_items:	list of pages waiting to be zeroed
+ * @mutex:		lock protecting this struct and especially the counts
+ * @gfp_mask:		gfp_mask to use when the pool is empty
+ * @order:		order of pages in the pool
+ * @zero_work:		zeroes freed pages in the background
+ *
+ * Keeps freed pages around so that heaps need not go back to the page
+ * allocator, and zero the pages, on every allocation. Pools are drained by
+ * the heap's shrinker.
+ */
+struct ion_page_pool {
+	int clean_count;
+	int dirty_count;
+	struct list_head clean_items;
+	struct list_head dirty_items;
+	struct mutex mutex;
+	gfp_t gfp_mask;
+	unsigned int order;
+	struct work_struct zero_work;
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
+void ion_page_pool_destroy(struct ion_page_pool *);
+struct page *ion_page_pool_alloc(struct ion_page_pool *);
+void ion_page_pool_free(struct ion_page_pool *, struct page *);
+int ion_page_pool_shrink(struct ion_page_pool *pool, int nr_to_scan);
+
 /**
  * The carveout heap returns physical addresses, since 0 may be a valid
  * physical address, this is used to indicate allocation failed
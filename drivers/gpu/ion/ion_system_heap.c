@@ -15,6 +15,7 @@
  */
 
 #include <linux/err.h>
+#include <linux/highmem.h>
 #include <linux/ion.h>
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
@@ -22,48 +23,183 @@
 #include <linux/vmalloc.h>
 #include "ion_priv.h"
 
+/*
+ * The system heap builds buffers out of the largest pages it can get, from
+ * per-order pools of freed pages first and then from the page allocator.
+ * High-order allocations must not stall or trigger reclaim; order-0 pages
+ * are the fallback.
+ */
+static const unsigned int orders[] = {8, 4, 0};
+#define NUM_ORDERS ARRAY_SIZE(orders)
+
+static const gfp_t high_order_gfp_flags = (GFP_HIGHUSER | __GFP_NOWARN |
+					   __GFP_NORETRY | __GFP_NO_KSWAPD) &
+					  ~__GFP_WAIT;
+static const gfp_t low_order_gfp_flags = GFP_HIGHUSER;
+
+struct ion_system_heap {
+	struct ion_heap heap;
+	struct ion_page_pool *pools[NUM_ORDERS];
+	struct shrinker shrinker;
+};
+
+struct page_info {
+	struct page *page;
+	unsigned int order;
+	struct list_head list;
+};
+
+/**
+ * struct ion_system_buffer - what a system heap buffer's priv_virt points to
+ * @pages:		list of page_info, in buffer order
+ * @nchunks:		number of entries in @pages
+ * @npages:		size of the buffer in order-0 pages
+ */
+struct ion_system_buffer {
+	struct list_head pages;
+	int nchunks;
+	unsigned long npages;
+};
+
+static int order_to_index(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		if (order == orders[i])
+			return i;
+	BUG();
+	return -1;
+}
+
+static struct page_info *alloc_largest_available(struct ion_system_heap *heap,
+						 unsigned long size,
+						 unsigned int max_order)
+{
+	struct page_info *info;
+	struct page *page;
+	int i;
+
+	info = kmalloc(sizeof(struct page_info), GFP_KERNEL);
+	if (!info)
+		return NULL;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (size < (PAGE_SIZE << orders[i]))
+			continue;
+		if (max_order < orders[i])
+			continue;
+
+		page = ion_page_pool_alloc(heap->pools[i]);
+		if (!page)
+			continue;
+
+		info->page = page;
+		info->order = orders[i];
+		return info;
+	}
+
+	kfree(info);
+	return NULL;
+}
+
+static void free_buffer_pages(struct ion_system_heap *heap,
+			      struct ion_system_buffer *sbuf)
+{
+	struct page_info *info, *tmp;
+
+	list_for_each_entry_safe(info, tmp, &sbuf->pages, list) {
+		ion_page_pool_free(heap->pools[order_to_index(info->order)],
+				   info->page);
+		list_del(&info->list);
+		kfree(info);
+	}
+}
+
 static int ion_system_heap_allocate(struct ion_heap *heap,
 				     struct ion_buffer *buffer,
 				     unsigned long size, unsigned long align,
 				     unsigned long flags)
 {
-	buffer->priv_virt = vmalloc_user(size);
-	if (!buffer->priv_virt)
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	struct ion_system_buffer *sbuf;
+	struct page_info *info;
+	unsigned long size_remaining = PAGE_ALIGN(size);
+	unsigned int max_order = orders[0];
+
+	sbuf = kmalloc(sizeof(struct ion_system_buffer), GFP_KERNEL);
+	if (!sbuf)
 		return -ENOMEM;
+	INIT_LIST_HEAD(&sbuf->pages);
+	sbuf->nchunks = 0;
+	sbuf->npages = size_remaining >> PAGE_SHIFT;
+
+	while (size_remaining > 0) {
+		info = alloc_largest_available(sys_heap, size_remaining,
+					       max_order);
+		if (!info)
+			goto err;
+		list_add_tail(&info->list, &sbuf->pages);
+		size_remaining -= PAGE_SIZE << info->order;
+		/* if this order failed, larger ones will too */
+		max_order = info->order;
+		sbuf->nchunks++;
+	}
+
+	buffer->priv_virt = sbuf;
 	return 0;
+
+err:
+	free_buffer_pages(sys_heap, sbuf);
+	kfree(sbuf);
+	return -ENOMEM;
 }
 
 void ion_system_heap_free(struct ion_buffer *buffer)
 {
-	vfree(buffer->priv_virt);
+	struct ion_system_heap *sys_heap = container_of(buffer->heap,
+							struct ion_system_heap,
+							heap);
+	struct ion_system_buffer *sbuf = buffer->priv_virt;
+
+	free_buffer_pages(sys_heap, sbuf);
+	kfree(sbuf);
 }
 
+/*
+ * The scatterlist has one entry per physically contiguous run of pages,
+ * which is usually one per high-order page.
+ */
 struct scatterlist *ion_system_heap_map_dma(struct ion_heap *heap,
 					    struct ion_buffer *buffer)
 {
-	struct scatterlist *sglist;
-	struct page *page;
-	int i;
-	int npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
-	void *vaddr = buffer->priv_virt;
+	struct ion_system_buffer *sbuf = buffer->priv_virt;
+	struct scatterlist *sglist, *sg = NULL;
+	struct page_info *info;
+	unsigned long next_pfn = 0;
 
-	sglist = vmalloc(npages * sizeof(struct scatterlist));
+	sglist = vmalloc(sbuf->nchunks * sizeof(struct scatterlist));
 	if (!sglist)
 		return ERR_PTR(-ENOMEM);
-	memset(sglist, 0, npages * sizeof(struct scatterlist));
-	sg_init_table(sglist, npages);
-	for (i = 0; i < npages; i++) {
-		page = vmalloc_to_page(vaddr);
-		if (!page)
-			goto end;
-		sg_set_page(&sglist[i], page, PAGE_SIZE, 0);
-		vaddr += PAGE_SIZE;
+	memset(sglist, 0, sbuf->nchunks * sizeof(struct scatterlist));
+	sg_init_table(sglist, sbuf->nchunks);
+
+	list_for_each_entry(info, &sbuf->pages, list) {
+		unsigned long len = PAGE_SIZE << info->order;
+
+		if (sg && page_to_pfn(info->page) == next_pfn) {
+			sg->length += len;
+		} else {
+			sg = sg ? sg_next(sg) : sglist;
+			sg_set_page(sg, info->page, len, 0);
+		}
+		next_pfn = page_to_pfn(info->page) + (1 << info->order);
 	}
+	sg_mark_end(sg);
 	/* XXX do cache maintenance for dma? */
 	return sglist;
-end:
-	vfree(sglist);
-	return NULL;
 }
 
 void ion_system_heap_unmap_dma(struct ion_heap *heap,
@@ -77,21 +213,68 @@ void ion_system_heap_unmap_dma(struct ion_heap *heap,
 void *ion_system_heap_map_kernel(struct ion_heap *heap,
 				 struct ion_buffer *buffer)
 {
-	return buffer->priv_virt;
+	struct ion_system_buffer *sbuf = buffer->priv_virt;
+	struct page_info *info;
+	struct page **pages;
+	void *vaddr;
+	int i, j = 0;
+
+	pages = vmalloc(sbuf->npages * sizeof(struct page *));
+	if (!pages)
+		return ERR_PTR(-ENOMEM);
+
+	list_for_each_entry(info, &sbuf->pages, list)
+		for (i = 0; i < (1 << info->order); i++)
+			pages[j++] = info->page + i;
+
+	vaddr = vmap(pages, sbuf->npages, VM_MAP, PAGE_KERNEL);
+	vfree(pages);
+
+	return vaddr ? vaddr : ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_unmap_kernel(struct ion_heap *heap,
 				  struct ion_buffer *buffer)
 {
+	vunmap(buffer->vaddr);
 }
 
 int ion_system_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 			     struct vm_area_struct *vma)
 {
-	return remap_vmalloc_range(vma, buffer->priv_virt, vma->vm_pgoff);
+	struct ion_system_buffer *sbuf = buffer->priv_virt;
+	struct page_info *info;
+	unsigned long addr = vma->vm_start;
+	unsigned long offset = vma->vm_pgoff;
+	int ret;
+
+	list_for_each_entry(info, &sbuf->pages, list) {
+		unsigned long npages = 1 << info->order;
+		unsigned long len;
+
+		if (offset >= npages) {
+			offset -= npages;
+			continue;
+		}
+
+		len = min((npages - offset) << PAGE_SHIFT,
+			  vma->vm_end - addr);
+		ret = remap_pfn_range(vma, addr,
+				      page_to_pfn(info->page) + offset, len,
+				      vma->vm_page_prot);
+		if (ret)
+			return ret;
+
+		offset = 0;
+		addr += len;
+		if (addr >= vma->vm_end)
+			return 0;
+	}
+
+	return addr < vma->vm_end ? -EINVAL : 0;
 }
 
-static struct ion_heap_ops vmalloc_ops = {
+static struct ion_heap_ops system_heap_ops = {
 	.allocate = ion_system_heap_allocate,
 	.free = ion_system_heap_free,
 	.map_dma = ion_system_heap_map_dma,
@@ -101,21 +284,71 @@ static struct ion_heap_ops vmalloc_ops = {
 	.map_user = ion_system_heap_map_user,
 };
 
+static int ion_system_heap_shrink(struct shrinker *shrinker,
+				  struct shrink_control *sc)
+{
+	struct ion_system_heap *sys_heap = container_of(shrinker,
+							struct ion_system_heap,
+							shrinker);
+	int nr_to_scan = sc->nr_to_scan;
+	int count = 0;
+	int i;
+
+	/* drain the large pages last, they are the hardest to get back */
+	for (i = NUM_ORDERS - 1; i >= 0 && nr_to_scan > 0; i--)
+		nr_to_scan -= ion_page_pool_shrink(sys_heap->pools[i],
+						   nr_to_scan);
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		count += ion_page_pool_shrink(sys_heap->pools[i], 0);
+
+	return count;
+}
+
 struct ion_heap *ion_system_heap_create(struct ion_platform_heap *unused)
 {
-	struct ion_heap *heap;
+	struct ion_system_heap *heap;
+	int i;
 
-	heap = kzalloc(sizeof(struct ion_heap), GFP_KERNEL);
+	heap = kzalloc(sizeof(struct ion_system_heap), GFP_KERNEL);
 	if (!heap)
 		return ERR_PTR(-ENOMEM);
-	heap->ops = &vmalloc_ops;
-	heap->type = ION_HEAP_TYPE_SYSTEM;
-	return heap;
+	heap->heap.ops = &system_heap_ops;
+	heap->heap.type = ION_HEAP_TYPE_SYSTEM;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		gfp_t gfp_flags = orders[i] ? high_order_gfp_flags :
+					      low_order_gfp_flags;
+
+		heap->pools[i] = ion_page_pool_create(gfp_flags, orders[i]);
+		if (!heap->pools[i])
+			goto err;
+	}
+
+	heap->shrinker.shrink = ion_system_heap_shrink;
+	heap->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&heap->shrinker);
+
+	return &heap->heap;
+
+err:
+	while (--i >= 0)
+		ion_page_pool_destroy(heap->pools[i]);
+	kfree(heap);
+	return ERR_PTR(-ENOMEM);
 }
 
 void ion_system_heap_destroy(struct ion_heap *heap)
 {
-	kfree(heap);
+	struct ion_system_heap *sys_heap = container_of(heap,
+							struct ion_system_heap,
+							heap);
+	int i;
+
+	unregister_shrinker(&sys_heap->shrinker);
+	for (i = 0; i < NUM_ORDERS; i++)
+		ion_page_pool_destroy(sys_heap->pools[i]);
+	kfree(sys_heap);
 }
 
 static int ion_system_contig_heap_allocate(struct ion_heap *heap,
@@ -168,14 +401,25 @@ int ion_system_contig_heap_map_user(struct ion_heap *heap,
 
 }
 
+void *ion_system_contig_heap_map_kernel(struct ion_heap *heap,
+					struct ion_buffer *buffer)
+{
+	return buffer->priv_virt;
+}
+
+void ion_system_contig_heap_unmap_kernel(struct ion_heap *heap,
+					 struct ion_buffer *buffer)
+{
+}
+
 static struct ion_heap_ops kmalloc_ops = {
 	.allocate = ion_system_contig_heap_allocate,
 	.free = ion_system_contig_heap_free,
 	.phys = ion_system_contig_heap_phys,
 	.map_dma = ion_system_contig_heap_map_dma,
 	.unmap_dma = ion_system_heap_unmap_dma,
-	.map_kernel = ion_system_heap_map_kernel,
-	.unmap_kernel = ion_system_heap_unmap_kernel,
+	.map_kernel = ion_system_contig_heap_map_kernel,
+	.unmap_kernel = ion_system_contig_heap_unmap_kernel,
 	.map_user = ion_system_contig_heap_map_user,
 };
 
@@ -31,10 +31,26 @@ struct ion_heap **heaps;
 struct ion_heap *tiler_heap;
 static struct ion_heap *nonsecure_tiler_heap;
 
+/*
+ * Every tiler buffer belongs to tiler_heap, so that is where their frees
+ * are deferred to. If an allocation fails, finish those and try again.
+ */
+static int omap_ion_tiler_alloc_from(struct ion_heap *heap,
+				     struct ion_client *client,
+				     struct omap_ion_tiler_alloc_data *data)
+{
+	int ret = omap_tiler_alloc(heap, client, data);
+
+	if (ret && (tiler_heap->flags & ION_HEAP_FLAG_DEFER_FREE) &&
+	    ion_heap_freelist_drain(tiler_heap, 0))
+		ret = omap_tiler_alloc(heap, client, data);
+	return ret;
+}
+
 int omap_ion_tiler_alloc(struct ion_client *client,
 			 struct omap_ion_tiler_alloc_data *data)
 {
-	return omap_tiler_alloc(tiler_heap, client, data);
+	return omap_ion_tiler_alloc_from(tiler_heap, client, data);
 }
 
 int omap_ion_nonsecure_tiler_alloc(struct ion_client *client,
@@ -42,7 +58,7 @@ int omap_ion_nonsecure_tiler_alloc(struct ion_client *client,
 {
 	if (!nonsecure_tiler_heap)
 		return -ENOMEM;
-	return omap_tiler_alloc(nonsecure_tiler_heap, client, data);
+	return omap_ion_tiler_alloc_from(nonsecure_tiler_heap, client, data);
 }
 
 long omap_ion_ioctl(struct ion_client *client, unsigned int cmd,
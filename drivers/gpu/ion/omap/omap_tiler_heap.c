@@ -66,6 +66,7 @@ int omap_tiler_alloc(struct ion_heap *heap,
 	u32 n_phys_pages;
 	u32 n_tiler_pages;
 	ion_phys_addr_t addr;
+	ktime_t start = ktime_get();
 	int i, ret;
 
 	if (data->fmt == TILER_PIXEL_FMT_PAGE && data->h != 1) {
@@ -148,6 +149,7 @@ int omap_tiler_alloc(struct ion_heap *heap,
 	buffer->size = info->n_tiler_pages * PAGE_SIZE;
 	buffer->priv_virt = info;
 	data->handle = handle;
+	ion_heap_stats_alloc(buffer->heap, buffer->size, start, 0);
 	return 0;
 
 err:
@@ -161,6 +163,7 @@ err_alloc:
 			ion_carveout_free(heap, info->phys_addrs[i], PAGE_SIZE);
 err_nomem:
 	kfree(info);
+	ion_heap_stats_alloc(heap, 0, start, ret);
 	return ret;
 }
 
@@ -238,6 +241,7 @@ static struct ion_heap_ops omap_tiler_ops = {
 	.free = omap_tiler_heap_free,
 	.phys = omap_tiler_phys,
 	.map_user = omap_tiler_heap_map_user,
+	.debug_show = ion_carveout_heap_debug_show,
 };
 
 struct ion_heap *omap_tiler_heap_create(struct ion_platform_heap *data)
@@ -251,6 +255,7 @@ struct ion_heap *omap_tiler_heap_create(struct ion_platform_heap *data)
 	heap->type = OMAP_ION_HEAP_TYPE_TILER;
 	heap->name = data->name;
 	heap->id = data->id;
+	heap->flags = data->flags;
 	return heap;
 }
 
@@ -25,45 +25,86 @@
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/lzo.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
+#include <asm/io.h>
 
 /*
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting.
+ *
+ * Positions in the log are sequence numbers: byte counts since the log was
+ * created, wrapping at 2^32. logger_offset() turns them into buffer offsets.
+ * Writers reserve [resv_seq, resv_seq + len) under 'lock', copy their entry
+ * in without holding it, and then commit. 'w_seq' only advances over
+ * contiguous committed entries, so everything before it is readable.
+ * Everything before 'head' may be overwritten at any time.
+ *
+ * With CONFIG_ANDROID_LOGGER_ARCHIVE, entries are also compressed into the
+ * log's archive before they are overwritten, so readers can go back further
+ * than 'head'.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
+	struct logger_ring_info	*info;	/* page shared with mmap readers */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
-	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
-	size_t			head;	/* new readers start here */
+	wait_queue_head_t	commit_wq; /* writers waiting for free space */
+	spinlock_t		lock;	/* lock protecting the positions */
+	u32			w_seq;	/* end of the committed entries */
+	u32			resv_seq; /* end of the reserved space */
+	u32			head;	/* oldest entry in the ring */
 	size_t			size;	/* size of the log */
+#ifdef CONFIG_ANDROID_LOGGER_ARCHIVE
+	struct list_head	archive; /* compressed segments, oldest first */
+	size_t			archive_bytes; /* compressed size of archive */
+	u32			archive_start; /* oldest archived entry */
+	bool			archived; /* archive_start is valid */
+	u32			a_seq;	/* end of the archived entries */
+	struct work_struct	archive_work; /* fills the archive */
+#endif
 };
 
 /*
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. The structure is protected by 'mutex'.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
-	struct list_head	list;	/* entry in logger_log's list */
-	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* serializes users of this reader */
+	u32			r_seq;	/* current read position */
 	bool			r_all;	/* reader can read all entries */
+	bool			r_batch; /* read() returns as many as fit */
 	int			r_ver;	/* reader ABI version */
+	unsigned char		*r_msg;	/* payload bounce buffer for read() */
+#ifdef CONFIG_ANDROID_LOGGER_ARCHIVE
+	unsigned char		*r_cache; /* last decompressed segment */
+	u32			r_cache_start; /* its position */
+	u32			r_cache_end; /* its end, equal to start if none */
+#endif
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
+/* seq_before - is sequence number 'a' older than 'b'? */
+static inline bool seq_before(u32 a, u32 b)
+{
+	return (s32) (a - b) < 0;
+}
+
+#define LOGGER_ENTRY_MAX_LEN \
+	(sizeof(struct logger_entry) + LOGGER_ENTRY_MAX_PAYLOAD)
+
 /*
  * file_get_log - Given a file structure, return the associated log
  *
@@ -112,7 +153,7 @@ static struct logger_entry *get_entry_header(struct logger_log *log,
  * get_entry_msg_len - Grabs the length of the message of the entry
  * starting from from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_msg_len(struct logger_log *log, size_t off)
 {
@@ -156,78 +197,497 @@ static ssize_t copy_header_to_user(int ver, struct logger_entry *entry,
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * struct logger_view - entries laid out in a power-of-two sized buffer, such
+ * as the ring itself or a decompressed archive segment. Position 'n' is at
+ * offset (n - base) & (size - 1).
+ */
+struct logger_view {
+	unsigned char		*buffer;
+	size_t			size;
+	u32			base;
+};
+
+#define view_offset(v, n)	(((n) - (v)->base) & ((v)->size - 1))
+
+/* view_copy - copy 'len' bytes starting at position 'seq' to 'dst' */
+static void view_copy(struct logger_view *v, u32 seq, void *dst, size_t len)
+{
+	size_t off = view_offset(v, seq);
+	size_t first = min(len, v->size - off);
+
+	memcpy(dst, v->buffer + off, first);
+	if (first != len)
+		memcpy(dst + first, v->buffer, len - first);
+}
+
+/* view_get_header - copy the header of the entry at 'seq' to 'entry' */
+static void view_get_header(struct logger_view *v, u32 seq,
+			    struct logger_entry *entry)
+{
+	view_copy(v, seq, entry, sizeof(struct logger_entry));
+}
+
+/*
+ * entry_overwritten - whether the entry at 'seq' of 'log', read without
+ * the lock, may have been overwritten meanwhile. Writers move the head
+ * past an entry before they touch any of it. A NULL 'log' is a view that
+ * does not change, such as a decompressed archive segment.
+ */
+static bool entry_overwritten(struct logger_log *log, u32 seq)
+{
+	bool ret;
+
+	if (!log)
+		return false;
+
+	spin_lock(&log->lock);
+	ret = seq_before(seq, log->head);
+	spin_unlock(&log->lock);
+	return ret;
+}
+
+/*
+ * do_read_entries - copies the entries from 'seq' up to 'end' that 'reader'
+ * may see into the user-space buffer 'buf' of 'count' bytes: exactly one,
+ * or as many whole entries as fit if the reader asked for batches. The
+ * position after the last entry copied or skipped is stored in 'next'.
+ *
+ * 'v' is read without any lock. If it is the ring of 'log', each header
+ * and payload is copied into the kernel and checked against the head
+ * before the euid filter looks at it or it goes to userspace, so a reader
+ * never sees an entry that was overwritten while it was being copied.
  *
- * Caller must hold log->mutex.
+ * Returns the number of bytes copied, which is zero if every entry was
+ * skipped, -EAGAIN if the first entry was overwritten, or -EINVAL if the
+ * first entry does not fit.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static ssize_t do_read_entries(struct logger_log *log, struct logger_view *v,
+			       struct logger_reader *reader, u32 seq, u32 end,
+			       char __user *buf, size_t count, u32 *next)
 {
-	struct logger_entry scratch;
-	struct logger_entry *entry;
-	size_t len;
-	size_t msg_start;
-
-	/*
-	 * First, copy the header to userspace, using the version of
-	 * the header requested
-	 */
-	entry = get_entry_header(log, reader->r_off, &scratch);
-	if (copy_header_to_user(reader->r_ver, entry, buf))
-		return -EFAULT;
+	struct logger_entry entry;
+	uid_t euid = current_euid();
+	size_t hdr_len = get_user_hdr_len(reader->r_ver);
+	size_t done = 0;
+	ssize_t ret = 0;
 
-	count -= get_user_hdr_len(reader->r_ver);
-	buf += get_user_hdr_len(reader->r_ver);
-	msg_start = logger_offset(reader->r_off + sizeof(struct logger_entry));
-
-	/*
-	 * We read from the msg in two disjoint operations. First, we read from
-	 * the current msg head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
-	 */
-	len = min(count, log->size - msg_start);
-	if (copy_to_user(buf, log->buffer + msg_start, len))
-		return -EFAULT;
+	while (seq_before(seq, end)) {
+		u32 msg = seq + sizeof(struct logger_entry);
 
-	/*
-	 * Second, we read any remaining bytes, starting back at the head of
-	 * the log.
-	 */
-	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+		view_get_header(v, seq, &entry);
+		if (entry_overwritten(log, seq)) {
+			if (!done)
+				ret = -EAGAIN;
+			break;
+		}
 
-	reader->r_off = logger_offset(reader->r_off +
-		sizeof(struct logger_entry) + count);
+		if (!reader->r_all && entry.euid != euid) {
+			seq = msg + entry.len;
+			continue;
+		}
 
-	return count + get_user_hdr_len(reader->r_ver);
+		if (count - done < hdr_len + entry.len) {
+			if (!done)
+				ret = -EINVAL;
+			break;
+		}
+
+		view_copy(v, msg, reader->r_msg, entry.len);
+		if (entry_overwritten(log, seq)) {
+			if (!done)
+				ret = -EAGAIN;
+			break;
+		}
+
+		if (copy_header_to_user(reader->r_ver, &entry, buf + done) ||
+		    copy_to_user(buf + done + hdr_len, reader->r_msg,
+				 entry.len)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		done += hdr_len + entry.len;
+		seq = msg + entry.len;
+		if (!reader->r_batch)
+			break;
+	}
+
+	*next = seq;
+	return ret < 0 ? ret : done;
 }
 
 /*
- * get_next_entry_by_uid - Starting at 'off', returns an offset into
- * 'log->buffer' which contains the first entry readable by 'euid'
+ * get_next_entry_by_uid - Starting at 'seq', returns the position of the
+ * first entry readable by 'euid'
+ *
+ * Caller needs to hold log->lock.
  */
-static size_t get_next_entry_by_uid(struct logger_log *log,
-		size_t off, uid_t euid)
+static u32 get_next_entry_by_uid(struct logger_log *log, u32 seq, uid_t euid)
 {
-	while (off != log->w_off) {
+	while (seq != log->w_seq) {
 		struct logger_entry *entry;
 		struct logger_entry scratch;
-		size_t next_len;
 
-		entry = get_entry_header(log, off, &scratch);
+		entry = get_entry_header(log, logger_offset(seq), &scratch);
 
 		if (entry->euid == euid)
-			return off;
+			return seq;
 
-		next_len = sizeof(struct logger_entry) + entry->len;
-		off = logger_offset(off + next_len);
+		seq += sizeof(struct logger_entry) + entry->len;
 	}
 
-	return off;
+	return seq;
+}
+
+#ifdef CONFIG_ANDROID_LOGGER_ARCHIVE
+
+/*
+ * Entries are archived in segments of at most this many bytes, which must
+ * be a power of two. Only entries in the older half of the ring are
+ * archived, which leaves the worker half the ring's worth of writes to get
+ * to them before they are overwritten.
+ */
+#define LOGGER_SEGMENT_SIZE	(16 * 1024)
+
+struct logger_segment {
+	struct list_head	list;	/* entry in logger_log's archive */
+	u32			start;	/* position of the first entry */
+	u32			end;	/* position after the last entry */
+	size_t			clen;	/* size of the compressed data */
+	unsigned char		data[0];
+};
+
+/* limit on the compressed size of each log's archive, 0 disables it */
+static unsigned int archive_kb;
+static bool logger_initialized;
+
+/* protects every log's archive and the buffers below */
+static DEFINE_MUTEX(archive_mutex);
+static unsigned char *archive_src;
+static unsigned char *archive_dst;
+static void *archive_wrkmem;
+
+/*
+ * logger_oldest - the oldest position a reader can still read from.
+ *
+ * Caller needs to hold log->lock.
+ */
+static u32 logger_oldest(struct logger_log *log)
+{
+	if (log->archived && seq_before(log->archive_start, log->head))
+		return log->archive_start;
+	return log->head;
+}
+
+/* archive_drop - free the oldest archived segment */
+static void archive_drop(struct logger_log *log)
+{
+	struct logger_segment *seg;
+
+	seg = list_first_entry(&log->archive, struct logger_segment, list);
+	list_del(&seg->list);
+	log->archive_bytes -= seg->clen;
+	kfree(seg);
+
+	spin_lock(&log->lock);
+	if (list_empty(&log->archive))
+		log->archived = false;
+	else
+		log->archive_start = list_first_entry(&log->archive,
+				struct logger_segment, list)->start;
+	spin_unlock(&log->lock);
+}
+
+/*
+ * archive_one - compress the next segment of old entries into the archive.
+ * Returns false if there is nothing to do or on failure.
+ *
+ * Caller needs to hold archive_mutex.
+ */
+static bool archive_one(struct logger_log *log)
+{
+	struct logger_segment *seg;
+	bool lapped, full = false;
+	u32 start, end;
+	size_t len, clen;
+
+	spin_lock(&log->lock);
+	/* the writers got here first, leave a hole in the archive */
+	if (seq_before(log->a_seq, log->head))
+		log->a_seq = log->head;
+
+	start = end = log->a_seq;
+	while (log->w_seq - end > log->size / 2) {
+		len = sizeof(struct logger_entry) +
+			get_entry_msg_len(log, logger_offset(end));
+		if (end - start + len > LOGGER_SEGMENT_SIZE) {
+			full = true;
+			break;
+		}
+		end += len;
+	}
+	spin_unlock(&log->lock);
+
+	if (!full)
+		return false;
+
+	/* copy the entries out first, the writers may be about to reuse them */
+	len = min_t(size_t, end - start, log->size - logger_offset(start));
+	memcpy(archive_src, log->buffer + logger_offset(start), len);
+	memcpy(archive_src + len, log->buffer, end - start - len);
+
+	spin_lock(&log->lock);
+	lapped = seq_before(start, log->head);
+	spin_unlock(&log->lock);
+	if (lapped)
+		return true;
+
+	if (lzo1x_1_compress(archive_src, end - start, archive_dst, &clen,
+			     archive_wrkmem) != LZO_E_OK)
+		return false;
+
+	seg = kmalloc(sizeof(struct logger_segment) + clen, GFP_KERNEL);
+	if (!seg)
+		return false;
+
+	seg->start = start;
+	seg->end = end;
+	seg->clen = clen;
+	memcpy(seg->data, archive_dst, clen);
+
+	list_add_tail(&seg->list, &log->archive);
+	log->archive_bytes += clen;
+	log->a_seq = end;
+
+	spin_lock(&log->lock);
+	if (!log->archived) {
+		log->archive_start = start;
+		log->archived = true;
+	}
+	spin_unlock(&log->lock);
+
+	return true;
+}
+
+static void logger_archive_work(struct work_struct *work)
+{
+	struct logger_log *log = container_of(work, struct logger_log,
+					      archive_work);
+
+	mutex_lock(&archive_mutex);
+
+	if (archive_kb && !archive_src) {
+		archive_src = vmalloc(LOGGER_SEGMENT_SIZE);
+		archive_dst = vmalloc(lzo1x_worst_compress(LOGGER_SEGMENT_SIZE));
+		archive_wrkmem = vmalloc(LZO1X_MEM_COMPRESS);
+		if (!archive_src || !archive_dst || !archive_wrkmem) {
+			vfree(archive_src);
+			vfree(archive_dst);
+			vfree(archive_wrkmem);
+			archive_src = NULL;
+		}
+	}
+
+	while (archive_kb && archive_src && archive_one(log))
+		;
+
+	while (!list_empty(&log->archive) &&
+	       log->archive_bytes > (size_t) archive_kb << 10)
+		archive_drop(log);
+
+	mutex_unlock(&archive_mutex);
+}
+
+/*
+ * logger_archive_kick - start archiving once a full segment of entries is in
+ * the older half of the ring. a_seq is only read as a hint here.
+ */
+static void logger_archive_kick(struct logger_log *log)
+{
+	if (archive_kb && ACCESS_ONCE(log->w_seq) - ACCESS_ONCE(log->a_seq) >
+			log->size / 2 + LOGGER_SEGMENT_SIZE)
+		schedule_work(&log->archive_work);
+}
+
+/* logger_archive_flush - drop the whole archive of 'log' */
+static void logger_archive_flush(struct logger_log *log)
+{
+	mutex_lock(&archive_mutex);
+	while (!list_empty(&log->archive))
+		archive_drop(log);
+	spin_lock(&log->lock);
+	log->a_seq = log->w_seq;
+	spin_unlock(&log->lock);
+	mutex_unlock(&archive_mutex);
+}
+
+/*
+ * archive_load - decompress the archived segment holding 'reader->r_seq'
+ * into the reader's cache, moving the reader to the segment's start if it
+ * was in a hole. Returns zero and the end of the segment in 'end', or
+ * -EAGAIN if the reader was moved past the segment instead.
+ *
+ * Caller needs to hold archive_mutex and reader->mutex.
+ */
+static int archive_load(struct logger_log *log, struct logger_reader *reader,
+			u32 *end)
+{
+	struct logger_segment *seg;
+
+	list_for_each_entry(seg, &log->archive, list)
+		if (seq_before(reader->r_seq, seg->end))
+			goto found;
+
+	/* dropped from the archive while we were looking, go to the ring */
+	spin_lock(&log->lock);
+	if (seq_before(reader->r_seq, log->head))
+		reader->r_seq = log->head;
+	spin_unlock(&log->lock);
+	return -EAGAIN;
+
+found:
+	if (seq_before(reader->r_seq, seg->start))
+		reader->r_seq = seg->start;
+
+	if (!reader->r_cache) {
+		reader->r_cache = vmalloc(LOGGER_SEGMENT_SIZE);
+		if (!reader->r_cache)
+			return -ENOMEM;
+	}
+
+	if (reader->r_cache_start != seg->start ||
+	    reader->r_cache_end != seg->end) {
+		size_t len = LOGGER_SEGMENT_SIZE;
+
+		reader->r_cache_end = reader->r_cache_start;
+		if (lzo1x_decompress_safe(seg->data, seg->clen,
+					  reader->r_cache, &len) != LZO_E_OK ||
+		    len != seg->end - seg->start) {
+			/* should never happen; skip the segment */
+			reader->r_seq = seg->end;
+			return -EAGAIN;
+		}
+		reader->r_cache_start = seg->start;
+		reader->r_cache_end = seg->end;
+	}
+
+	*end = seg->end;
+	return 0;
+}
+
+/*
+ * logger_read_archive - read() for a reader that is behind the ring's head.
+ * Returns the number of bytes read, or zero if nothing was read but the
+ * reader moved forward.
+ */
+static ssize_t logger_read_archive(struct logger_log *log,
+				   struct logger_reader *reader,
+				   char __user *buf, size_t count)
+{
+	struct logger_view v;
+	u32 end, next;
+	ssize_t ret;
+
+	mutex_lock(&archive_mutex);
+	ret = archive_load(log, reader, &end);
+	mutex_unlock(&archive_mutex);
+	if (ret)
+		return ret == -EAGAIN ? 0 : ret;
+
+	v.buffer = reader->r_cache;
+	v.size = LOGGER_SEGMENT_SIZE;
+	v.base = reader->r_cache_start;
+
+	ret = do_read_entries(NULL, &v, reader, reader->r_seq, end, buf, count,
+			      &next);
+	reader->r_seq = next;
+
+	return ret;
+}
+
+/*
+ * logger_archive_entry_len - LOGGER_GET_NEXT_ENTRY_LEN for a reader that is
+ * behind the ring's head. Skips the entries the reader may not see, like
+ * read() does, and returns -EAGAIN if it moved past the segment.
+ */
+static long logger_archive_entry_len(struct logger_log *log,
+				     struct logger_reader *reader)
+{
+	struct logger_entry entry;
+	struct logger_view v;
+	uid_t euid = current_euid();
+	u32 end;
+	int ret;
+
+	mutex_lock(&archive_mutex);
+	ret = archive_load(log, reader, &end);
+	mutex_unlock(&archive_mutex);
+	if (ret)
+		return ret;
+
+	v.buffer = reader->r_cache;
+	v.size = LOGGER_SEGMENT_SIZE;
+	v.base = reader->r_cache_start;
+
+	while (seq_before(reader->r_seq, end)) {
+		view_get_header(&v, reader->r_seq, &entry);
+		if (reader->r_all || entry.euid == euid)
+			return get_user_hdr_len(reader->r_ver) + entry.len;
+		reader->r_seq += sizeof(struct logger_entry) + entry.len;
+	}
+
+	return -EAGAIN;
+}
+
+#else
+
+static inline u32 logger_oldest(struct logger_log *log)
+{
+	return log->head;
+}
+
+static inline void logger_archive_kick(struct logger_log *log)
+{
+}
+
+static inline void logger_archive_flush(struct logger_log *log)
+{
+}
+
+static inline ssize_t logger_read_archive(struct logger_log *log,
+					  struct logger_reader *reader,
+					  char __user *buf, size_t count)
+{
+	reader->r_seq = log->head;
+	return 0;
+}
+
+static inline long logger_archive_entry_len(struct logger_log *log,
+					    struct logger_reader *reader)
+{
+	reader->r_seq = log->head;
+	return -EAGAIN;
+}
+
+#endif /* CONFIG_ANDROID_LOGGER_ARCHIVE */
+
+/*
+ * fix_up_reader - "pull forward" a reader that was lapped by the writers to
+ * the oldest entry still in the log, then skip entries it may not read.
+ *
+ * Caller needs to hold log->lock.
+ */
+static void fix_up_reader(struct logger_log *log, struct logger_reader *reader)
+{
+	u32 oldest = logger_oldest(log);
+
+	if (seq_before(reader->r_seq, oldest))
+		reader->r_seq = oldest;
+
+	/* entries in the archive are filtered as they are read */
+	if (!reader->r_all && !seq_before(reader->r_seq, log->head))
+		reader->r_seq = get_next_entry_by_uid(log, reader->r_seq,
+						      current_euid());
 }
 
 /*
@@ -237,7 +697,8 @@ static size_t get_next_entry_by_uid(struct logger_log *log,
  *
  * 	- O_NONBLOCK works
  * 	- If there are no log entries to read, blocks until log is written to
- * 	- Atomically reads exactly one log entry
+ * 	- Atomically reads exactly one log entry, or as many whole entries as
+ * 	  fit after ioctl(LOGGER_SET_READ_BATCH)
  *
  * Will set errno to EINVAL if read
  * buffer is insufficient to hold next entry.
@@ -247,16 +708,25 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	struct logger_view v = {
+		.buffer = log->buffer,
+		.size = log->size,
+		.base = 0,
+	};
 	ssize_t ret;
+	u32 seq, end, next;
 	DEFINE_WAIT(wait);
 
 start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		mutex_lock(&reader->mutex);
+		spin_lock(&log->lock);
+		fix_up_reader(log, reader);
+		ret = (log->w_seq == reader->r_seq);
+		spin_unlock(&log->lock);
+		mutex_unlock(&reader->mutex);
 		if (!ret)
 			break;
 
@@ -277,152 +747,213 @@ start:
 	if (ret)
 		return ret;
 
-	mutex_lock(&log->mutex);
+	mutex_lock(&reader->mutex);
+	spin_lock(&log->lock);
 
-	if (!reader->r_all)
-		reader->r_off = get_next_entry_by_uid(log,
-			reader->r_off, current_euid());
+	fix_up_reader(log, reader);
+
+	if (seq_before(reader->r_seq, log->head)) {
+		spin_unlock(&log->lock);
+		ret = logger_read_archive(log, reader, buf, count);
+		if (!ret) {
+			mutex_unlock(&reader->mutex);
+			goto start;
+		}
+		goto out;
+	}
 
 	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+	if (unlikely(log->w_seq == reader->r_seq)) {
+		spin_unlock(&log->lock);
+		mutex_unlock(&reader->mutex);
 		goto start;
 	}
 
-	/* get the size of the next entry */
-	ret = get_user_hdr_len(reader->r_ver) +
-		get_entry_msg_len(log, reader->r_off);
-	if (count < ret) {
-		ret = -EINVAL;
-		goto out;
+	seq = reader->r_seq;
+	end = log->w_seq;
+	spin_unlock(&log->lock);
+
+	ret = do_read_entries(log, &v, reader, seq, end, buf, count, &next);
+
+	/* overwritten before we got to it, start over from the new head */
+	if (unlikely(ret == -EAGAIN)) {
+		mutex_unlock(&reader->mutex);
+		goto start;
 	}
+	reader->r_seq = next;
 
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	/* everything up to 'end' was for other users */
+	if (!ret) {
+		mutex_unlock(&reader->mutex);
+		goto start;
+	}
 
 out:
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
 
 /*
- * get_next_entry - return the offset of the first valid entry at least 'len'
- * bytes after 'off'.
+ * fix_up_head - move the head past every entry that overlaps the space
+ * about to be reserved, which ends at 'end'. Readers behind the new head
+ * are pulled forward when they next look at the log.
  *
- * Caller must hold log->mutex.
+ * The caller needs to hold log->lock.
  */
-static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
+static void fix_up_head(struct logger_log *log, u32 end)
 {
-	size_t count = 0;
+	u32 oldest = end - log->size;
+
+	if (!seq_before(log->head, oldest))
+		return;
 
 	do {
-		size_t nr = sizeof(struct logger_entry) +
-			get_entry_msg_len(log, off);
-		off = logger_offset(off + nr);
-		count += nr;
-	} while (count < len);
+		log->head += sizeof(struct logger_entry) +
+			get_entry_msg_len(log, logger_offset(log->head));
+	} while (seq_before(log->head, oldest));
 
-	return off;
+	/* mmap readers must see the new head before the old data changes */
+	log->info->head = log->head;
+	smp_wmb();
 }
 
 /*
- * clock_interval - is a < c < b in mod-space? Put another way, does the line
- * from a to b cross c?
+ * do_write_log - writes 'count' bytes from 'buf' to 'log' at offset 'off'
+ *
+ * The caller needs to own the reservation covering the destination.
  */
-static inline int clock_interval(size_t a, size_t b, size_t c)
+static void do_write_log(struct logger_log *log, size_t off,
+			 const void *buf, size_t count)
 {
-	if (b < a) {
-		if (a < c || b >= c)
-			return 1;
-	} else {
-		if (a < c && b >= c)
-			return 1;
-	}
+	size_t len;
 
-	return 0;
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
+
+	if (count != len)
+		memcpy(log->buffer, buf + len, count - len);
 }
 
 /*
- * fix_up_readers - walk the list of all readers and "fix up" any who were
- * lapped by the writer; also do the same for the default "start head".
- * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
+ * do_write_log_user - writes 'count' bytes from the user-space buffer 'buf'
+ * to the log 'log' at offset 'off'
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to own the reservation covering the destination.
+ *
+ * Returns 'count' on success, negative error code on failure.
  */
-static void fix_up_readers(struct logger_log *log, size_t len)
+static ssize_t do_write_log_from_user(struct logger_log *log, size_t off,
+				      const void __user *buf, size_t count)
 {
-	size_t old = log->w_off;
-	size_t new = logger_offset(old + len);
-	struct logger_reader *reader;
+	size_t len;
+
+	len = min(count, log->size - off);
+	if (len && copy_from_user(log->buffer + off, buf, len))
+		return -EFAULT;
 
-	if (clock_interval(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
+	if (count != len)
+		if (copy_from_user(log->buffer, buf + len, count - len))
+			return -EFAULT;
 
-	list_for_each_entry(reader, &log->readers, list)
-		if (clock_interval(old, new, reader->r_off))
-			reader->r_off = get_next_entry(log, reader->r_off, len);
+	return count;
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
- *
- * The caller needs to hold log->mutex.
+ * logger_space_ok - can 'len' more bytes be reserved without the head
+ * having to move into entries that are still being written?
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static inline bool logger_space_ok(struct logger_log *log, size_t len)
 {
-	size_t len;
-
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	return log->resv_seq + len - log->w_seq <=
+		log->size - LOGGER_ENTRY_MAX_LEN;
+}
 
-	if (count != len)
-		memcpy(log->buffer, buf + len, count - len);
+/*
+ * logger_reserve - reserve room for an entry of 'len' bytes, including the
+ * header, and write the uncommitted 'header' into it. Returns the position
+ * of the entry.
+ *
+ * Only this is serialized against other writers; the payload is copied in
+ * afterwards without any lock held.
+ */
+static u32 logger_reserve(struct logger_log *log, struct logger_entry *header,
+			  size_t len)
+{
+	u32 seq;
+
+	spin_lock(&log->lock);
+	while (unlikely(!logger_space_ok(log, len))) {
+		/* only possible with many writers stalled in copy_from_user */
+		spin_unlock(&log->lock);
+		wait_event(log->commit_wq, logger_space_ok(log, len));
+		spin_lock(&log->lock);
+	}
 
-	log->w_off = logger_offset(log->w_off + count);
+	seq = log->resv_seq;
+	log->resv_seq += len;
+	fix_up_head(log, log->resv_seq);
+	do_write_log(log, logger_offset(seq), header,
+		     sizeof(struct logger_entry));
+	spin_unlock(&log->lock);
 
+	return seq;
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
- *
- * The caller needs to hold log->mutex.
- *
- * Returns 'count' on success, negative error code on failure.
+ * logger_commit - mark the entry at 'seq' as completely written and make
+ * every committed entry up to the first one still being written visible to
+ * readers.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
+static void logger_commit(struct logger_log *log, u32 seq)
 {
-	size_t len;
+	__u16 hdr_size = sizeof(struct logger_entry);
+	struct logger_entry scratch;
+	struct logger_entry *entry;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
+	spin_lock(&log->lock);
+	do_write_log(log, logger_offset(seq +
+				offsetof(struct logger_entry, hdr_size)),
+		     &hdr_size, sizeof(hdr_size));
+
+	if (seq == log->w_seq) {
+		while (log->w_seq != log->resv_seq) {
+			entry = get_entry_header(log, logger_offset(log->w_seq),
+						 &scratch);
+			if (!entry->hdr_size)
+				break;
+			log->w_seq += sizeof(struct logger_entry) + entry->len;
+		}
 
-	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
-			return -EFAULT;
+		/* publish the data before the position that covers it */
+		smp_wmb();
+		log->info->w_seq = log->w_seq;
+	}
+	spin_unlock(&log->lock);
 
-	log->w_off = logger_offset(log->w_off + count);
+	if (unlikely(waitqueue_active(&log->commit_wq)))
+		wake_up(&log->commit_wq);
 
-	return count;
+	logger_archive_kick(log);
 }
 
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * Writers only serialize against each other to reserve space; the entries
+ * themselves are copied in parallel.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
 	struct timespec now;
+	size_t off;
 	ssize_t ret = 0;
+	u32 seq;
 
 	now = current_kernel_time();
 
@@ -432,23 +963,16 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	header.nsec = now.tv_nsec;
 	header.euid = current_euid();
 	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
-	header.hdr_size = sizeof(struct logger_entry);
+	/* a zero hdr_size marks the entry as not yet committed */
+	header.hdr_size = 0;
 
 	/* null writes succeed, return zero */
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
-	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
-	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
-
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	seq = logger_reserve(log, &header,
+			     sizeof(struct logger_entry) + header.len);
+	off = logger_offset(seq + sizeof(struct logger_entry));
 
 	while (nr_segs-- > 0) {
 		size_t len;
@@ -458,18 +982,26 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 		len = min_t(size_t, iov->iov_len, header.len - ret);
 
 		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
+		nr = do_write_log_from_user(log, off, iov->iov_base, len);
 		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
+			/*
+			 * The space cannot be handed back once reserved, so
+			 * commit the entry with the rest of it cleared.
+			 */
+			len = min_t(size_t, header.len - ret,
+				    log->size - off);
+			memset(log->buffer + off, 0, len);
+			memset(log->buffer, 0, header.len - ret - len);
+			ret = nr;
+			break;
 		}
 
+		off = logger_offset(off + nr);
 		iov++;
 		ret += nr;
 	}
 
-	mutex_unlock(&log->mutex);
+	logger_commit(log, seq);
 
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log->wq);
@@ -504,17 +1036,27 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->r_msg = kmalloc(LOGGER_ENTRY_MAX_PAYLOAD, GFP_KERNEL);
+		if (!reader->r_msg) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
 		reader->r_ver = 1;
+		reader->r_batch = false;
+#ifdef CONFIG_ANDROID_LOGGER_ARCHIVE
+		reader->r_cache = NULL;
+		reader->r_cache_start = reader->r_cache_end = 0;
+#endif
 		reader->r_all = in_egroup_p(inode->i_gid) ||
 			capable(CAP_SYSLOG);
 
-		INIT_LIST_HEAD(&reader->list);
+		mutex_init(&reader->mutex);
 
-		mutex_lock(&log->mutex);
-		reader->r_off = log->head;
-		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_lock(&log->lock);
+		reader->r_seq = logger_oldest(log);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -532,12 +1074,11 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
-		struct logger_log *log = reader->log;
-
-		mutex_lock(&log->mutex);
-		list_del(&reader->list);
-		mutex_unlock(&log->mutex);
 
+#ifdef CONFIG_ANDROID_LOGGER_ARCHIVE
+		vfree(reader->r_cache);
+#endif
+		kfree(reader->r_msg);
 		kfree(reader);
 	}
 
@@ -567,14 +1108,113 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
-	if (!reader->r_all)
-		reader->r_off = get_next_entry_by_uid(log,
-			reader->r_off, current_euid());
+	mutex_lock(&reader->mutex);
+	spin_lock(&log->lock);
+	fix_up_reader(log, reader);
 
-	if (log->w_off != reader->r_off)
+	if (log->w_seq != reader->r_seq)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
+	mutex_unlock(&reader->mutex);
+
+	return ret;
+}
+
+/*
+ * logger_remap - map 'size' bytes of kernel memory at 'addr' to 'uaddr'. The
+ * buffers live in the kernel image or, when built as a module, in module
+ * space, so look up each page.
+ */
+static int logger_remap(struct vm_area_struct *vma, unsigned long uaddr,
+			void *addr, size_t size)
+{
+	unsigned long pfn;
+	size_t done;
+	int ret;
+
+	for (done = 0; done < size; done += PAGE_SIZE) {
+		if (is_vmalloc_or_module_addr(addr + done))
+			pfn = vmalloc_to_pfn(addr + done);
+		else
+			pfn = virt_to_phys(addr + done) >> PAGE_SHIFT;
+
+		ret = remap_pfn_range(vma, uaddr + done, pfn, PAGE_SIZE,
+				      vma->vm_page_prot);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * logger_mmap - map the log read-only: the logger_ring_info page followed by
+ * the ring buffer itself. See logger.h for how to consume it. Only readers
+ * that may read every entry can map the log.
+ */
+static int logger_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct logger_reader *reader;
+	struct logger_log *log;
+	int ret;
+
+	if (!(file->f_mode & FMODE_READ))
+		return -EBADF;
+
+	reader = file->private_data;
+	log = reader->log;
+
+	if (!reader->r_all)
+		return -EPERM;
+
+	if (vma->vm_pgoff ||
+	    vma->vm_end - vma->vm_start != PAGE_SIZE + log->size)
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND | VM_RESERVED;
+
+	ret = logger_remap(vma, vma->vm_start, log->info, PAGE_SIZE);
+	if (ret)
+		return ret;
+
+	return logger_remap(vma, vma->vm_start + PAGE_SIZE, log->buffer,
+			    log->size);
+}
+
+/*
+ * logger_next_entry_len - LOGGER_GET_NEXT_ENTRY_LEN: the size read() needs
+ * for the next entry 'reader' may see, or zero if there is none.
+ *
+ * Caller needs to hold reader->mutex.
+ */
+static long logger_next_entry_len(struct logger_log *log,
+				  struct logger_reader *reader)
+{
+	long ret;
+
+	while (1) {
+		spin_lock(&log->lock);
+		fix_up_reader(log, reader);
+		if (!seq_before(reader->r_seq, log->head))
+			break;
+		spin_unlock(&log->lock);
+
+		/* the ring no longer has it, look in the archive */
+		ret = logger_archive_entry_len(log, reader);
+		if (ret != -EAGAIN)
+			return ret;
+	}
+
+	if (log->w_seq != reader->r_seq)
+		ret = get_user_hdr_len(reader->r_ver) +
+			get_entry_msg_len(log, logger_offset(reader->r_seq));
+	else
+		ret = 0;
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -595,73 +1235,96 @@ static long logger_set_version(struct logger_reader *reader, void __user *arg)
 static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
-	struct logger_reader *reader;
+	struct logger_reader *reader = NULL;
 	long ret = -EINVAL;
 	void __user *argp = (void __user *) arg;
 
-	mutex_lock(&log->mutex);
+	if (file->f_mode & FMODE_READ) {
+		reader = file->private_data;
+		mutex_lock(&reader->mutex);
+	}
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
 		ret = log->size;
 		break;
 	case LOGGER_GET_LOG_LEN:
-		if (!(file->f_mode & FMODE_READ)) {
+		if (!reader) {
 			ret = -EBADF;
 			break;
 		}
-		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
-		else
-			ret = (log->size - reader->r_off) + log->w_off;
+		spin_lock(&log->lock);
+		if (seq_before(reader->r_seq, logger_oldest(log)))
+			reader->r_seq = logger_oldest(log);
+		ret = log->w_seq - reader->r_seq;
+		spin_unlock(&log->lock);
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
-		if (!(file->f_mode & FMODE_READ)) {
+		if (!reader) {
 			ret = -EBADF;
 			break;
 		}
-		reader = file->private_data;
-
-		if (!reader->r_all)
-			reader->r_off = get_next_entry_by_uid(log,
-				reader->r_off, current_euid());
-
-		if (log->w_off != reader->r_off)
-			ret = get_user_hdr_len(reader->r_ver) +
-				get_entry_msg_len(log, reader->r_off);
-		else
-			ret = 0;
+		ret = logger_next_entry_len(log, reader);
 		break;
 	case LOGGER_FLUSH_LOG:
 		if (!(file->f_mode & FMODE_WRITE)) {
 			ret = -EBADF;
 			break;
 		}
-		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+		logger_archive_flush(log);
+
+		/* readers catch up with the head the next time they look */
+		spin_lock(&log->lock);
+		log->head = log->w_seq;
+		log->info->head = log->head;
+		spin_unlock(&log->lock);
 		ret = 0;
 		break;
 	case LOGGER_GET_VERSION:
-		if (!(file->f_mode & FMODE_READ)) {
+		if (!reader) {
 			ret = -EBADF;
 			break;
 		}
-		reader = file->private_data;
 		ret = reader->r_ver;
 		break;
 	case LOGGER_SET_VERSION:
-		if (!(file->f_mode & FMODE_READ)) {
+		if (!reader) {
 			ret = -EBADF;
 			break;
 		}
-		reader = file->private_data;
 		ret = logger_set_version(reader, argp);
 		break;
+	case LOGGER_SET_READ_BATCH:
+		if (!reader) {
+			ret = -EBADF;
+			break;
+		}
+		reader->r_batch = !!arg;
+		ret = 0;
+		break;
+	case LOGGER_SET_READ_SEQ:
+		if (!reader) {
+			ret = -EBADF;
+			break;
+		}
+		/* only readers that can map the log may skip entries */
+		if (!reader->r_all) {
+			ret = -EPERM;
+			break;
+		}
+		spin_lock(&log->lock);
+		if (seq_before(log->w_seq, (u32) arg))
+			ret = -EINVAL;
+		else {
+			reader->r_seq = arg;
+			ret = 0;
+		}
+		spin_unlock(&log->lock);
+		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	if (reader)
+		mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -671,21 +1334,42 @@ static const struct file_operations logger_fops = {
 	.read = logger_read,
 	.aio_write = logger_aio_write,
 	.poll = logger_poll,
+	.mmap = logger_mmap,
 	.unlocked_ioctl = logger_ioctl,
 	.compat_ioctl = logger_ioctl,
 	.open = logger_open,
 	.release = logger_release,
 };
 
+/*
+ * The page shared with mmap readers. It is padded to a full page so that
+ * nothing else ends up in what userspace can see.
+ */
+union logger_info_page {
+	struct logger_ring_info	info;
+	unsigned char		page[PAGE_SIZE];
+};
+
+#ifdef CONFIG_ANDROID_LOGGER_ARCHIVE
+#define LOGGER_ARCHIVE_INIT(VAR) \
+	.archive = LIST_HEAD_INIT(VAR .archive), \
+	.archive_work = __WORK_INITIALIZER(VAR .archive_work, \
+					   logger_archive_work),
+#else
+#define LOGGER_ARCHIVE_INIT(VAR)
+#endif
+
 /*
  * Defines a log structure with name 'NAME' and a size of 'SIZE' bytes, which
- * must be a power of two, and greater than
- * (LOGGER_ENTRY_MAX_PAYLOAD + sizeof(struct logger_entry)).
+ * must be a power of two, a multiple of PAGE_SIZE, and greater than
+ * 2 * (LOGGER_ENTRY_MAX_PAYLOAD + sizeof(struct logger_entry)).
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
+static unsigned char _buf_ ## VAR[SIZE] __aligned(PAGE_SIZE); \
+static union logger_info_page _info_ ## VAR __aligned(PAGE_SIZE); \
 static struct logger_log VAR = { \
 	.buffer = _buf_ ## VAR, \
+	.info = &_info_ ## VAR .info, \
 	.misc = { \
 		.minor = MISC_DYNAMIC_MINOR, \
 		.name = NAME, \
@@ -693,11 +1377,13 @@ static struct logger_log VAR = { \
 		.parent = NULL, \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
-	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
-	.w_off = 0, \
+	.commit_wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .commit_wq), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
+	.w_seq = 0, \
+	.resv_seq = 0, \
 	.head = 0, \
 	.size = SIZE, \
+	LOGGER_ARCHIVE_INIT(VAR) \
 };
 
 DEFINE_LOGGER_DEVICE(log_main, LOGGER_LOG_MAIN, 256*1024)
@@ -718,10 +1404,32 @@ static struct logger_log *get_log_from_minor(int minor)
 	return NULL;
 }
 
+#ifdef CONFIG_ANDROID_LOGGER_ARCHIVE
+/* changing the limit trims the archives right away */
+static int logger_set_archive_kb(const char *val, struct kernel_param *kp)
+{
+	int ret = param_set_uint(val, kp);
+
+	if (ret || !logger_initialized)
+		return ret;
+
+	schedule_work(&log_main.archive_work);
+	schedule_work(&log_events.archive_work);
+	schedule_work(&log_radio.archive_work);
+	schedule_work(&log_system.archive_work);
+	return 0;
+}
+module_param_call(archive_kb, logger_set_archive_kb, param_get_uint,
+		  &archive_kb, S_IWUSR | S_IRUGO);
+#endif
+
 static int __init init_log(struct logger_log *log)
 {
 	int ret;
 
+	log->info->size = log->size;
+	log->info->data_offset = PAGE_SIZE;
+
 	ret = misc_register(&log->misc);
 	if (unlikely(ret)) {
 		printk(KERN_ERR "logger: failed to register misc "
@@ -755,6 +1463,9 @@ static int __init logger_init(void)
 	if (unlikely(ret))
 		goto out;
 
+#ifdef CONFIG_ANDROID_LOGGER_ARCHIVE
+	logger_initialized = true;
+#endif
 out:
 	return ret;
 }
@@ -51,6 +51,35 @@ struct logger_entry {
 	char		msg[0];		/* the entry's payload */
 };
 
+/*
+ * The first page of a read-only mmap() of a log, which must map the whole
+ * log. The ring buffer itself follows at 'data_offset'.
+ *
+ * Positions are sequence numbers that count bytes written to the log and
+ * wrap at 2^32; the entry at position 's' starts at ring offset
+ * (s & (size - 1)). Entries are a struct logger_entry followed by the
+ * payload, and may wrap around the end of the ring.
+ *
+ * To consume entries from position 'r' (start at 'head'):
+ *
+ *	1) read 'w_seq', then issue a read barrier
+ *	2) copy out the entries from 'r' up to 'w_seq'
+ *	3) issue a read barrier, then read 'head'
+ *	4) any copied entry starting before 'head' may have been overwritten
+ *	   while it was copied and must be dropped; continue from 'head' if it
+ *	   is past 'r', else from the old 'w_seq'
+ *
+ * Compare positions with signed 32-bit differences. To sleep until there is
+ * more to read, pass the new position to ioctl(LOGGER_SET_READ_SEQ) and
+ * poll() the same descriptor.
+ */
+struct logger_ring_info {
+	__u32		size;		/* size of the ring, a power of two */
+	__u32		data_offset;	/* offset of the ring in the mapping */
+	__u32		w_seq;		/* end of the readable entries */
+	__u32		head;		/* oldest entry not being overwritten */
+};
+
 #define LOGGER_LOG_RADIO	"log_radio"	/* radio-related messages */
 #define LOGGER_LOG_EVENTS	"log_events"	/* system/hardware events */
 #define LOGGER_LOG_SYSTEM	"log_system"	/* system/framework messages */
@@ -66,5 +95,7 @@ struct logger_entry {
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
 #define LOGGER_GET_VERSION		_IO(__LOGGERIO, 5) /* abi version */
 #define LOGGER_SET_VERSION		_IO(__LOGGERIO, 6) /* abi version */
+#define LOGGER_SET_READ_SEQ		_IO(__LOGGERIO, 7) /* mmap read pos */
+#define LOGGER_SET_READ_BATCH		_IO(__LOGGERIO, 8) /* many per read */
 
 #endif /* _LINUX_LOGGER_H */
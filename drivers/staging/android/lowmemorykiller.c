@@ -16,6 +16,30 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * To avoid walking every process on each shrinker call, processes are kept
+ * in an index bucketed by oom_adj, which is updated when a process is forked
+ * with its parent's oom_adj and whenever oom_adj or oom_score_adj is written
+ * through /proc. Exec keeps the process and its oom_adj, so the entry stays
+ * valid. A victim is picked from the highest non-empty bucket at or above
+ * the minimum adj, using an RSS value that is cached for a short while.
+ * Processes that were forked before the driver registered are not indexed;
+ * they are only found by a fallback walk of the task list when the index
+ * has no candidate.
+ *
+ * Scan time and kills per adj level are reported in
+ * <debugfs>/lowmemorykiller/stats.
+ *
+ * Memory pressure is estimated from the ratio of pages reclaimed to pages
+ * scanned by vmscan, sampled every LOWMEM_PRESSURE_WINDOW scanned pages,
+ * and exported as a percentage in /proc/lowmemorykiller/pressure. That file
+ * can be poll()ed and becomes readable whenever a new sample is taken;
+ * seek back to the start to read it again.
+ *
+ * With /sys/module/lowmemorykiller/parameters/kill_thread set, the shrinker
+ * no longer selects and kills inline: it only wakes a dedicated thread, and
+ * only while pressure is at least the kill_pressure parameter. Reclaiming
+ * allocators then never pay for the scan nor wait out a pending death.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -35,6 +59,24 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/hash.h>
+#include <linux/list.h>
+#include <linux/pid.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/proc_fs.h>
+#include <linux/uaccess.h>
+#include <linux/vmstat.h>
+#include <linux/swap.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/lowmemorykiller.h>
 
 static uint32_t lowmem_debug_level = 2;
 static int lowmem_adj[6] = {
@@ -54,6 +96,13 @@ static int lowmem_minfree_size = 4;
 
 static struct task_struct *lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
+static DECLARE_WAIT_QUEUE_HEAD(lowmem_death_wait);
+
+static bool lowmem_kill_thread_enabled;
+static uint32_t lowmem_kill_pressure;
+static struct task_struct *lowmem_kill_task;
+static atomic_t lowmem_kill_requested = ATOMIC_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(lowmem_kill_wait);
 
 #define lowmem_print(level, x...)			\
 	do {						\
@@ -61,6 +110,126 @@ static unsigned long lowmem_deathpending_timeout;
 			printk(x);			\
 	} while (0)
 
+#define LOWMEM_ADJ_LEVELS	(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+#define LOWMEM_HASH_BITS	6
+/* how long a sampled RSS is trusted when ranking candidates */
+#define LOWMEM_RSS_TTL		(HZ / 20)
+/* freed processes tolerated before dead index entries are pruned */
+#define LOWMEM_PRUNE_THRESHOLD	32
+/* pages scanned by vmscan per pressure sample */
+#define LOWMEM_PRESSURE_WINDOW	(SWAP_CLUSTER_MAX * 16)
+
+/*
+ * One indexed process. The process is referenced through its tgid pid so
+ * that the entry stays safe to look at after the process is gone; such
+ * entries are dropped when they are next encountered or pruned.
+ */
+struct lowmem_task {
+	struct hlist_node hash;		/* in lowmem_task_hash, keyed by pid */
+	struct list_head bucket;	/* in lowmem_buckets[oom_adj] */
+	struct pid *pid;
+	int oom_adj;
+	int rss;			/* cached get_mm_rss() in pages */
+	unsigned long rss_stamp;	/* jiffies when rss was sampled */
+};
+
+static DEFINE_SPINLOCK(lowmem_index_lock);
+static struct list_head lowmem_buckets[LOWMEM_ADJ_LEVELS];
+static struct hlist_head lowmem_task_hash[1 << LOWMEM_HASH_BITS];
+static int lowmem_index_size;
+static atomic_t lowmem_index_stale = ATOMIC_INIT(0);
+
+/* skip the task list walk for a while after it found nothing */
+static unsigned long lowmem_fallback_next;
+static int lowmem_fallback_min_adj = OOM_ADJUST_MAX + 1;
+
+/* protected by lowmem_index_lock */
+static struct {
+	unsigned long scans;
+	unsigned long fallback_scans;
+	u64 scan_ns;
+	u64 max_scan_ns;
+	unsigned long kills[LOWMEM_ADJ_LEVELS];
+} lowmem_stats;
+
+static struct dentry *lowmem_debugfs_root;
+
+static DEFINE_SPINLOCK(lowmem_pressure_lock);
+static unsigned long lowmem_pressure_scanned;	/* vmscan counters when */
+static unsigned long lowmem_pressure_reclaimed;	/* the window started */
+static unsigned int lowmem_pressure;		/* percent */
+static unsigned long lowmem_pressure_seq;	/* bumped on each sample */
+static DECLARE_WAIT_QUEUE_HEAD(lowmem_pressure_wait);
+static struct proc_dir_entry *lowmem_proc_root;
+
+static inline struct list_head *lowmem_bucket(int oom_adj)
+{
+	return &lowmem_buckets[oom_adj - OOM_DISABLE];
+}
+
+static inline struct hlist_head *lowmem_hash_head(struct pid *pid)
+{
+	return &lowmem_task_hash[hash_ptr(pid, LOWMEM_HASH_BITS)];
+}
+
+static struct lowmem_task *lowmem_index_find(struct pid *pid)
+{
+	struct lowmem_task *lt;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(lt, node, lowmem_hash_head(pid), hash)
+		if (lt->pid == pid)
+			return lt;
+	return NULL;
+}
+
+static void lowmem_index_remove(struct lowmem_task *lt)
+{
+	hlist_del(&lt->hash);
+	list_del(&lt->bucket);
+	put_pid(lt->pid);
+	kfree(lt);
+	lowmem_index_size--;
+}
+
+/* Drop entries of processes that have exited. Called with the index lock. */
+static void lowmem_index_prune(void)
+{
+	struct lowmem_task *lt;
+	struct hlist_node *node, *tmp;
+	int i;
+
+	atomic_set(&lowmem_index_stale, 0);
+	rcu_read_lock();
+	for (i = 0; i < ARRAY_SIZE(lowmem_task_hash); i++)
+		hlist_for_each_entry_safe(lt, node, tmp,
+					  &lowmem_task_hash[i], hash)
+			if (!pid_task(lt->pid, PIDTYPE_PID))
+				lowmem_index_remove(lt);
+	rcu_read_unlock();
+}
+
+/*
+ * Resample the RSS of an indexed process. Returns the process, or NULL
+ * after removing the entry if it has exited. Called with the index lock
+ * and rcu_read_lock held.
+ */
+static struct task_struct *lowmem_task_refresh(struct lowmem_task *lt)
+{
+	struct task_struct *p;
+
+	p = pid_task(lt->pid, PIDTYPE_PID);
+	if (!p) {
+		lowmem_index_remove(lt);
+		return NULL;
+	}
+	task_lock(p);
+	lt->rss = p->mm ? get_mm_rss(p->mm) : 0;
+	task_unlock(p);
+	lt->rss_stamp = jiffies;
+	return p;
+}
+
 static int
 task_notify_func(struct notifier_block *self, unsigned long val, void *data);
 
@@ -73,27 +242,362 @@ task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 {
 	struct task_struct *task = data;
 
-	if (task == lowmem_deathpending)
+	if (task == lowmem_deathpending) {
 		lowmem_deathpending = NULL;
+		wake_up(&lowmem_death_wait);
+	}
+
+	/*
+	 * This may run from softirq context while the shrinker holds the
+	 * index lock and waits for this task's alloc_lock, so the entry is
+	 * not removed here. Count it and let the next oom_adj write prune.
+	 */
+	if (thread_group_leader(task))
+		atomic_inc(&lowmem_index_stale);
 
 	return NOTIFY_OK;
 }
 
-static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+static int
+oom_adj_notify_func(struct notifier_block *self, unsigned long val,
+		    void *data)
+{
+	struct task_struct *task = data;
+	int oom_adj;
+	struct lowmem_task *lt, *new;
+	struct pid *pid;
+
+	rcu_read_lock();
+	pid = get_pid(task_tgid(task));
+	rcu_read_unlock();
+	if (!pid)
+		return NOTIFY_DONE;
+
+	new = kmalloc(sizeof(*new), GFP_KERNEL);
+
+	spin_lock(&lowmem_index_lock);
+	if (atomic_read(&lowmem_index_stale) >= LOWMEM_PRUNE_THRESHOLD)
+		lowmem_index_prune();
+
+	/*
+	 * A fork and a write to the child's oom_adj can race to get here;
+	 * whoever comes last has to file the process under the latest value.
+	 */
+	oom_adj = ACCESS_ONCE(task->signal->oom_adj);
+	if (oom_adj < OOM_DISABLE || oom_adj > OOM_ADJUST_MAX)
+		goto out;
+
+	lt = lowmem_index_find(pid);
+	if (lt) {
+		list_move_tail(&lt->bucket, lowmem_bucket(oom_adj));
+		lt->oom_adj = oom_adj;
+	} else if (new) {
+		new->pid = pid;
+		new->oom_adj = oom_adj;
+		new->rss = 0;
+		new->rss_stamp = jiffies - LOWMEM_RSS_TTL;
+		hlist_add_head(&new->hash, lowmem_hash_head(pid));
+		list_add_tail(&new->bucket, lowmem_bucket(oom_adj));
+		lowmem_index_size++;
+		new = NULL;
+		pid = NULL;
+	}
+out:
+	spin_unlock(&lowmem_index_lock);
+
+	kfree(new);
+	put_pid(pid);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block oom_adj_nb = {
+	.notifier_call	= oom_adj_notify_func,
+};
+
+/*
+ * Pick the largest process from the highest non-empty bucket at or above
+ * min_adj. Called with the index lock and rcu_read_lock held.
+ */
+static struct task_struct *
+lowmem_select_indexed(int min_adj, int *tasksize, int *oom_adj,
+		      int *nr_scanned)
+{
+	struct lowmem_task *lt, *tmp, *best;
+	struct task_struct *p;
+	int adj;
+
+	if (min_adj < OOM_DISABLE)
+		min_adj = OOM_DISABLE;
+retry:
+	best = NULL;
+	for (adj = OOM_ADJUST_MAX; adj >= min_adj && !best; adj--) {
+		list_for_each_entry_safe(lt, tmp, lowmem_bucket(adj), bucket) {
+			(*nr_scanned)++;
+			if (time_after_eq(jiffies,
+					  lt->rss_stamp + LOWMEM_RSS_TTL) &&
+			    !lowmem_task_refresh(lt))
+				continue;
+			if (lt->rss <= 0)
+				continue;
+			if (!best || lt->rss > best->rss)
+				best = lt;
+		}
+	}
+	if (!best)
+		return NULL;
+
+	/* The ranking may have used a cached size; sample the winner again. */
+	p = lowmem_task_refresh(best);
+	if (!p || best->rss <= 0)
+		goto retry;
+
+	*tasksize = best->rss;
+	*oom_adj = best->oom_adj;
+	lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+		     p->pid, p->comm, *oom_adj, *tasksize);
+	return p;
+}
+
+/*
+ * Walk the whole task list for processes that are not indexed. Called
+ * with tasklist_lock held.
+ */
+static struct task_struct *
+lowmem_select_scan(int min_adj, int *tasksize, int *oom_adj, int *nr_scanned)
 {
 	struct task_struct *p;
 	struct task_struct *selected = NULL;
-	int rem = 0;
-	int tasksize;
-	int i;
-	int min_adj = OOM_ADJUST_MAX + 1;
 	int selected_tasksize = 0;
-	int selected_oom_adj;
+	int selected_oom_adj = min_adj;
+
+	for_each_process(p) {
+		struct mm_struct *mm;
+		struct signal_struct *sig;
+		int size;
+		int adj;
+
+		(*nr_scanned)++;
+		task_lock(p);
+		mm = p->mm;
+		sig = p->signal;
+		if (!mm || !sig) {
+			task_unlock(p);
+			continue;
+		}
+		adj = sig->oom_adj;
+		if (adj < min_adj) {
+			task_unlock(p);
+			continue;
+		}
+		size = get_mm_rss(mm);
+		task_unlock(p);
+		if (size <= 0)
+			continue;
+		if (selected) {
+			if (adj < selected_oom_adj)
+				continue;
+			if (adj == selected_oom_adj &&
+			    size <= selected_tasksize)
+				continue;
+		}
+		selected = p;
+		selected_tasksize = size;
+		selected_oom_adj = adj;
+		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+			     p->pid, p->comm, adj, size);
+	}
+	*tasksize = selected_tasksize;
+	*oom_adj = selected_oom_adj;
+	return selected;
+}
+
+static void lowmem_kill(struct task_struct *selected, int oom_adj,
+			int tasksize, int min_adj, int other_free,
+			int other_file)
+{
+	lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
+		     selected->pid, selected->comm, oom_adj, tasksize);
+	trace_lowmem_kill(selected, oom_adj, tasksize, min_adj,
+			  other_free, other_file);
+	lowmem_deathpending = selected;
+	lowmem_deathpending_timeout = jiffies + HZ;
+	force_sig(SIGKILL, selected);
+}
+
+#ifdef CONFIG_VM_EVENT_COUNTERS
+/*
+ * Sum a per-zone vmscan event counter over all zones, given its entry for
+ * ZONE_NORMAL. Offline CPUs have their counters folded into an online
+ * one, so walking every possible CPU neither double counts nor needs the
+ * hotplug lock.
+ */
+static unsigned long lowmem_sum_zone_events(enum vm_event_item normal_item)
+{
+	enum vm_event_item first = normal_item - ZONE_NORMAL;
+	unsigned long sum = 0;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		struct vm_event_state *this = &per_cpu(vm_event_states, cpu);
+
+		for (i = 0; i < MAX_NR_ZONES; i++)
+			sum += this->event[first + i];
+	}
+	return sum;
+}
+
+static void lowmem_vmscan_events(unsigned long *scanned,
+				 unsigned long *reclaimed)
+{
+	*scanned = lowmem_sum_zone_events(PGSCAN_KSWAPD_NORMAL) +
+		   lowmem_sum_zone_events(PGSCAN_DIRECT_NORMAL);
+	*reclaimed = lowmem_sum_zone_events(PGSTEAL_NORMAL);
+}
+#else
+static void lowmem_vmscan_events(unsigned long *scanned,
+				 unsigned long *reclaimed)
+{
+	*scanned = 0;
+	*reclaimed = 0;
+}
+#endif
+
+/*
+ * Take a new pressure sample once vmscan has scanned a full window since
+ * the last one: 0 when everything scanned was reclaimed, 100 when nothing
+ * was.
+ */
+static void lowmem_update_pressure(void)
+{
+	unsigned long scanned, reclaimed;
+	unsigned long delta_scanned, delta_reclaimed;
+	unsigned int ratio;
+
+	lowmem_vmscan_events(&scanned, &reclaimed);
+
+	spin_lock(&lowmem_pressure_lock);
+	delta_scanned = scanned - lowmem_pressure_scanned;
+	if (delta_scanned < LOWMEM_PRESSURE_WINDOW) {
+		spin_unlock(&lowmem_pressure_lock);
+		return;
+	}
+	delta_reclaimed = reclaimed - lowmem_pressure_reclaimed;
+	ratio = min_t(unsigned long, delta_reclaimed / (delta_scanned / 100),
+		      100);
+	lowmem_pressure = 100 - ratio;
+	lowmem_pressure_scanned = scanned;
+	lowmem_pressure_reclaimed = reclaimed;
+	lowmem_pressure_seq++;
+	spin_unlock(&lowmem_pressure_lock);
+
+	wake_up_interruptible(&lowmem_pressure_wait);
+}
+
+static int lowmem_min_adj(int *other_free, int *other_file)
+{
+	int i;
 	int array_size = ARRAY_SIZE(lowmem_adj);
-	int other_free = global_page_state(NR_FREE_PAGES);
-	int other_file = global_page_state(NR_FILE_PAGES) -
+
+	*other_free = global_page_state(NR_FREE_PAGES);
+	*other_file = global_page_state(NR_FILE_PAGES) -
 						global_page_state(NR_SHMEM);
 
+	if (lowmem_adj_size < array_size)
+		array_size = lowmem_adj_size;
+	if (lowmem_minfree_size < array_size)
+		array_size = lowmem_minfree_size;
+	for (i = 0; i < array_size; i++) {
+		if (*other_free < lowmem_minfree[i] &&
+		    *other_file < lowmem_minfree[i])
+			return lowmem_adj[i];
+	}
+	return OOM_ADJUST_MAX + 1;
+}
+
+/*
+ * Select a victim at or above min_adj, from the index first and the task
+ * list if that finds nothing, and kill it. Returns the victim, which may
+ * only be compared against, or NULL.
+ */
+static struct task_struct *
+lowmem_select_and_kill(int min_adj, int other_free, int other_file,
+		       int *tasksize)
+{
+	struct task_struct *selected;
+	int selected_oom_adj = OOM_DISABLE;
+	int nr_scanned = 0;
+	bool fallback = false;
+	ktime_t start;
+	u64 delta;
+
+	*tasksize = 0;
+	start = ktime_get();
+
+	spin_lock(&lowmem_index_lock);
+	rcu_read_lock();
+	selected = lowmem_select_indexed(min_adj, tasksize,
+					 &selected_oom_adj, &nr_scanned);
+	if (selected)
+		lowmem_kill(selected, selected_oom_adj, *tasksize,
+			    min_adj, other_free, other_file);
+	rcu_read_unlock();
+	if (!selected &&
+	    (time_after_eq(jiffies, lowmem_fallback_next) ||
+	     min_adj < lowmem_fallback_min_adj))
+		fallback = true;
+	spin_unlock(&lowmem_index_lock);
+
+	if (fallback) {
+		read_lock(&tasklist_lock);
+		selected = lowmem_select_scan(min_adj, tasksize,
+					      &selected_oom_adj, &nr_scanned);
+		if (selected)
+			lowmem_kill(selected, selected_oom_adj, *tasksize,
+				    min_adj, other_free, other_file);
+		read_unlock(&tasklist_lock);
+	}
+
+	delta = ktime_to_ns(ktime_sub(ktime_get(), start));
+	trace_lowmem_scan(min_adj, selected ? selected_oom_adj : OOM_DISABLE,
+			  nr_scanned, fallback, delta);
+
+	spin_lock(&lowmem_index_lock);
+	if (fallback) {
+		lowmem_stats.fallback_scans++;
+		if (!selected) {
+			lowmem_fallback_next = jiffies + HZ;
+			lowmem_fallback_min_adj = min_adj;
+		} else {
+			lowmem_fallback_min_adj = OOM_ADJUST_MAX + 1;
+		}
+	}
+	lowmem_stats.scans++;
+	lowmem_stats.scan_ns += delta;
+	if (delta > lowmem_stats.max_scan_ns)
+		lowmem_stats.max_scan_ns = delta;
+	if (selected)
+		lowmem_stats.kills[selected_oom_adj - OOM_DISABLE]++;
+	spin_unlock(&lowmem_index_lock);
+
+	return selected;
+}
+
+static inline bool lowmem_use_kill_thread(void)
+{
+	return lowmem_kill_thread_enabled && lowmem_kill_task;
+}
+
+static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	int rem = 0;
+	int min_adj;
+	int selected_tasksize;
+	int other_free;
+	int other_file;
+
+	if (sc->nr_to_scan > 0)
+		lowmem_update_pressure();
+
 	/*
 	 * If we already have a death outstanding, then
 	 * bail out right away; indicating to vmscan
@@ -101,21 +605,11 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	 * this pass.
 	 *
 	 */
-	if (lowmem_deathpending &&
+	if (!lowmem_use_kill_thread() && lowmem_deathpending &&
 	    time_before_eq(jiffies, lowmem_deathpending_timeout))
 		return 0;
 
-	if (lowmem_adj_size < array_size)
-		array_size = lowmem_adj_size;
-	if (lowmem_minfree_size < array_size)
-		array_size = lowmem_minfree_size;
-	for (i = 0; i < array_size; i++) {
-		if (other_free < lowmem_minfree[i] &&
-		    other_file < lowmem_minfree[i]) {
-			min_adj = lowmem_adj[i];
-			break;
-		}
-	}
+	min_adj = lowmem_min_adj(&other_free, &other_file);
 	if (sc->nr_to_scan > 0)
 		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d\n",
 			     sc->nr_to_scan, sc->gfp_mask, other_free, other_file,
@@ -129,74 +623,187 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			     sc->nr_to_scan, sc->gfp_mask, rem);
 		return rem;
 	}
-	selected_oom_adj = min_adj;
-
-	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
 
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
+	if (lowmem_use_kill_thread()) {
+		if (lowmem_pressure >= lowmem_kill_pressure) {
+			atomic_set(&lowmem_kill_requested, 1);
+			wake_up(&lowmem_kill_wait);
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
+		return rem;
 	}
-	if (selected) {
-		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
-			     selected->pid, selected->comm,
-			     selected_oom_adj, selected_tasksize);
-		lowmem_deathpending = selected;
-		lowmem_deathpending_timeout = jiffies + HZ;
-		force_sig(SIGKILL, selected);
+
+	if (lowmem_select_and_kill(min_adj, other_free, other_file,
+				   &selected_tasksize))
 		rem -= selected_tasksize;
-	}
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
-	read_unlock(&tasklist_lock);
 	return rem;
 }
 
+/*
+ * Kill on behalf of the shrinker. Free memory is checked again when woken
+ * since it may have recovered, and after a kill the thread, rather than
+ * reclaim, waits for the victim to exit.
+ */
+static int lowmem_kill_thread(void *unused)
+{
+	struct sched_param param = { .sched_priority = 1 };
+	struct task_struct *selected;
+	int min_adj;
+	int tasksize;
+	int other_free;
+	int other_file;
+
+	sched_setscheduler(current, SCHED_FIFO, &param);
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(lowmem_kill_wait,
+				atomic_read(&lowmem_kill_requested) ||
+				kthread_should_stop());
+		if (!atomic_xchg(&lowmem_kill_requested, 0))
+			continue;
+
+		min_adj = lowmem_min_adj(&other_free, &other_file);
+		if (min_adj == OOM_ADJUST_MAX + 1)
+			continue;
+
+		selected = lowmem_select_and_kill(min_adj, other_free,
+						  other_file, &tasksize);
+		if (selected)
+			wait_event_timeout(lowmem_death_wait,
+					   lowmem_deathpending != selected,
+					   HZ);
+	}
+	return 0;
+}
+
 static struct shrinker lowmem_shrinker = {
 	.shrink = lowmem_shrink,
 	.seeks = DEFAULT_SEEKS * 16
 };
 
+static int lowmem_pressure_open(struct inode *inode, struct file *file)
+{
+	file->private_data = (void *)lowmem_pressure_seq;
+	return 0;
+}
+
+static ssize_t lowmem_pressure_read(struct file *file, char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	char tmp[16];
+	int len;
+
+	spin_lock(&lowmem_pressure_lock);
+	len = snprintf(tmp, sizeof(tmp), "%u\n", lowmem_pressure);
+	file->private_data = (void *)lowmem_pressure_seq;
+	spin_unlock(&lowmem_pressure_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, tmp, len);
+}
+
+static unsigned int lowmem_pressure_poll(struct file *file, poll_table *wait)
+{
+	poll_wait(file, &lowmem_pressure_wait, wait);
+	if ((unsigned long)file->private_data != lowmem_pressure_seq)
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static const struct file_operations lowmem_pressure_fops = {
+	.owner		= THIS_MODULE,
+	.open		= lowmem_pressure_open,
+	.read		= lowmem_pressure_read,
+	.poll		= lowmem_pressure_poll,
+	.llseek		= default_llseek,
+};
+
+static int lowmem_stats_show(struct seq_file *m, void *unused)
+{
+	int i;
+
+	spin_lock(&lowmem_index_lock);
+	seq_printf(m, "indexed_tasks: %d\n", lowmem_index_size);
+	seq_printf(m, "scans: %lu\n", lowmem_stats.scans);
+	seq_printf(m, "fallback_scans: %lu\n", lowmem_stats.fallback_scans);
+	seq_printf(m, "scan_time_ns: %llu\n", lowmem_stats.scan_ns);
+	seq_printf(m, "max_scan_time_ns: %llu\n", lowmem_stats.max_scan_ns);
+	seq_printf(m, "pressure: %u\n", lowmem_pressure);
+	seq_puts(m, "adj kills\n");
+	for (i = 0; i < LOWMEM_ADJ_LEVELS; i++)
+		if (lowmem_stats.kills[i])
+			seq_printf(m, "%3d %lu\n", i + OOM_DISABLE,
+				   lowmem_stats.kills[i]);
+	spin_unlock(&lowmem_index_lock);
+	return 0;
+}
+
+static int lowmem_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lowmem_stats_show, NULL);
+}
+
+static const struct file_operations lowmem_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= lowmem_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int __init lowmem_init(void)
 {
+	int i;
+
+	for (i = 0; i < LOWMEM_ADJ_LEVELS; i++)
+		INIT_LIST_HEAD(&lowmem_buckets[i]);
+
+	lowmem_debugfs_root = debugfs_create_dir("lowmemorykiller", NULL);
+	if (lowmem_debugfs_root)
+		debugfs_create_file("stats", S_IRUGO, lowmem_debugfs_root,
+				    NULL, &lowmem_stats_fops);
+
+	lowmem_vmscan_events(&lowmem_pressure_scanned,
+			     &lowmem_pressure_reclaimed);
+	lowmem_proc_root = proc_mkdir("lowmemorykiller", NULL);
+	if (lowmem_proc_root)
+		proc_create("pressure", S_IRUGO, lowmem_proc_root,
+			    &lowmem_pressure_fops);
+
+	lowmem_kill_task = kthread_run(lowmem_kill_thread, NULL,
+				       "lowmemorykiller");
+	if (IS_ERR(lowmem_kill_task)) {
+		pr_err("lowmemorykiller: failed to start kill thread\n");
+		lowmem_kill_task = NULL;
+	}
+
 	task_free_register(&task_nb);
+	register_oom_adj_notifier(&oom_adj_nb);
 	register_shrinker(&lowmem_shrinker);
 	return 0;
 }
 
 static void __exit lowmem_exit(void)
 {
+	struct lowmem_task *lt;
+	struct hlist_node *node, *tmp;
+	int i;
+
 	unregister_shrinker(&lowmem_shrinker);
+	unregister_oom_adj_notifier(&oom_adj_nb);
 	task_free_unregister(&task_nb);
+	if (lowmem_kill_task)
+		kthread_stop(lowmem_kill_task);
+	if (lowmem_proc_root) {
+		remove_proc_entry("pressure", lowmem_proc_root);
+		remove_proc_entry("lowmemorykiller", NULL);
+	}
+	debugfs_remove_recursive(lowmem_debugfs_root);
+
+	for (i = 0; i < ARRAY_SIZE(lowmem_task_hash); i++)
+		hlist_for_each_entry_safe(lt, node, tmp,
+					  &lowmem_task_hash[i], hash)
+			lowmem_index_remove(lt);
 }
 
 module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
@@ -205,6 +812,10 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(kill_thread, lowmem_kill_thread_enabled, bool,
+		   S_IRUGO | S_IWUSR);
+module_param_named(kill_pressure, lowmem_kill_pressure, uint,
+		   S_IRUGO | S_IWUSR);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
@@ -0,0 +1,77 @@
+/*
+ * Compressed RAM block device
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+/* Longest backend name accepted by the comp_algorithm attribute */
+#define ZCOMP_NAME_LEN	16
+
+/* Per-stream compression working memory and output buffer */
+struct zcomp_strm {
+	/* compression output, large enough for the worst case of a page */
+	void *buffer;
+	/* backend private working memory */
+	void *private;
+	/* entry in zcomp->idle_strm while not in use */
+	struct list_head list;
+};
+
+/* Static description of a compression algorithm */
+struct zcomp_backend {
+	int (*compress)(const unsigned char *src, unsigned char *dst,
+			size_t *dst_len, void *private);
+
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			  unsigned char *dst);
+
+	void *(*create)(void);
+	void (*destroy)(void *private);
+
+	const char *name;
+};
+
+/*
+ * Compressor instance of one zram device. It owns max_strm streams so
+ * that up to max_strm writers can compress in parallel; further
+ * writers sleep on strm_wait until a stream is released.
+ */
+struct zcomp {
+	spinlock_t strm_lock;	/* protects idle_strm and strm_waits */
+	struct list_head idle_strm;
+	wait_queue_head_t strm_wait;
+	int max_strm;
+	u64 strm_waits;		/* times a writer found no idle stream */
+	struct zcomp_backend *backend;
+};
+
+ssize_t zcomp_available_show(const char *comp, char *buf);
+int zcomp_backend_valid(const char *comp);
+const char *zcomp_backend_name(int i);
+
+struct zcomp *zcomp_create(const char *comp, int max_strm);
+void zcomp_destroy(struct zcomp *comp);
+
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp);
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm);
+u64 zcomp_strm_waits(struct zcomp *comp);
+
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		   const unsigned char *src, size_t *dst_len);
+
+int zcomp_decompress(struct zcomp *comp, const unsigned char *src,
+		     size_t src_len, unsigned char *dst);
+
+#endif /* _ZCOMP_H_ */
@@ -0,0 +1,296 @@
+/*
+ * Compressed RAM block device
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * Benchmark of the zram compression backends on real anonymous memory.
+ *
+ * Reading <debugfs>/zcomp_bench/results copies up to 'pages' anonymous
+ * pages out of the process given in 'pid', then compresses and
+ * decompresses all of them with every backend. Pages filled with a single
+ * repeated word are left out, as zram stores those without compressing.
+ * Throughput is in MB/s of uncompressed data. The ratio is uncompressed
+ * over stored size, counting pages over max_zpage_size as a full page
+ * the way zram stores them; those are not decompressed.
+ *
+ * Pages are looked up like ptrace would, so pages the process never
+ * touched are mapped to the zero page (and left out) and swapped out ones
+ * are read back in.
+ */
+
+#define KMSG_COMPONENT "zcomp_bench"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/highmem.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/pid.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+
+#include "zram_drv.h"
+
+static u32 bench_pid;
+static u32 bench_pages = 4096;
+static struct dentry *bench_root;
+
+/* Only one benchmark runs at a time; each one takes seconds */
+static DEFINE_MUTEX(bench_mutex);
+
+struct bench_sample {
+	void *data;		/* nr pages, back to back */
+	int nr;
+	int nr_same;		/* same-filled pages left out */
+};
+
+static int bench_page_same_filled(const unsigned long *ptr)
+{
+	unsigned int pos;
+
+	for (pos = 1; pos < PAGE_SIZE / sizeof(*ptr); pos++)
+		if (ptr[pos] != ptr[0])
+			return 0;
+	return 1;
+}
+
+/* Copy up to bench_pages anonymous pages of bench_pid into @s */
+static int bench_collect(struct bench_sample *s)
+{
+	struct task_struct *task;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	struct pid *pid;
+	unsigned long addr, max = bench_pages;
+	unsigned long visited = 0;
+	int ret = 0;
+
+	if (!max || max > totalram_pages / 4)
+		return -EINVAL;
+
+	pid = find_get_pid(bench_pid);
+	task = get_pid_task(pid, PIDTYPE_PID);
+	put_pid(pid);
+	if (!task)
+		return -ESRCH;
+
+	mm = get_task_mm(task);
+	if (!mm) {
+		ret = -EINVAL;
+		goto out_task;
+	}
+
+	s->data = vmalloc(max * PAGE_SIZE);
+	if (!s->data) {
+		ret = -ENOMEM;
+		goto out_mm;
+	}
+
+	/*
+	 * Looking up an untouched page maps the zero page, so bound the
+	 * walk for processes with large, mostly unused reservations.
+	 */
+	down_read(&mm->mmap_sem);
+	for (vma = mm->mmap; vma && s->nr < max && visited < max * 16;
+	     vma = vma->vm_next) {
+		if (vma->vm_file || !(vma->vm_flags & VM_READ) ||
+		    (vma->vm_flags & (VM_IO | VM_PFNMAP)))
+			continue;
+
+		for (addr = vma->vm_start;
+		     addr < vma->vm_end && s->nr < max && visited < max * 16;
+		     addr += PAGE_SIZE, visited++) {
+			void *dst = s->data + s->nr * PAGE_SIZE;
+			struct page *page;
+			void *src;
+
+			if (get_user_pages(task, mm, addr, 1, 0, 0,
+					   &page, NULL) != 1)
+				continue;
+
+			src = kmap(page);
+			memcpy(dst, src, PAGE_SIZE);
+			kunmap(page);
+			put_page(page);
+
+			if (bench_page_same_filled(dst))
+				s->nr_same++;
+			else
+				s->nr++;
+			cond_resched();
+		}
+	}
+	up_read(&mm->mmap_sem);
+
+out_mm:
+	mmput(mm);
+out_task:
+	put_task_struct(task);
+	return ret;
+}
+
+/* bytes per nanosecond times 1000 is MB/s */
+static u64 bench_mbps(u64 bytes, s64 ns)
+{
+	return ns > 0 ? div64_u64(bytes * 1000, ns) : 0;
+}
+
+static int bench_backend(struct seq_file *s, const char *name,
+			 struct bench_sample *sample)
+{
+	struct zcomp *comp;
+	struct zcomp_strm *zstrm;
+	unsigned char *cdata, *out;
+	size_t *clens, clen;
+	u64 bytes, csize = 0;
+	s64 comp_ns = 0, decomp_ns = 0;
+	ktime_t t0;
+	int i, incompressible = 0, errors = 0, ret = 0;
+
+	comp = zcomp_create(name, 1);
+	if (!comp)
+		return -ENOMEM;
+
+	cdata = vmalloc(sample->nr * PAGE_SIZE);
+	clens = vmalloc(sample->nr * sizeof(*clens));
+	out = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!cdata || !clens || !out) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	zstrm = zcomp_strm_find(comp);
+	for (i = 0; i < sample->nr; i++) {
+		t0 = ktime_get();
+		ret = zcomp_compress(comp, zstrm,
+				     sample->data + i * PAGE_SIZE, &clen);
+		comp_ns += ktime_to_ns(ktime_sub(ktime_get(), t0));
+		if (ret) {
+			zcomp_strm_release(comp, zstrm);
+			goto out;
+		}
+
+		/* zram would store these uncompressed */
+		if (clen > max_zpage_size) {
+			clens[i] = 0;
+			csize += PAGE_SIZE;
+			incompressible++;
+		} else {
+			memcpy(cdata + i * PAGE_SIZE, zstrm->buffer, clen);
+			clens[i] = clen;
+			csize += clen;
+		}
+		cond_resched();
+	}
+	zcomp_strm_release(comp, zstrm);
+
+	for (i = 0; i < sample->nr; i++) {
+		if (!clens[i])
+			continue;
+
+		t0 = ktime_get();
+		ret = zcomp_decompress(comp, cdata + i * PAGE_SIZE, clens[i],
+				       out);
+		decomp_ns += ktime_to_ns(ktime_sub(ktime_get(), t0));
+		if (ret || memcmp(out, sample->data + i * PAGE_SIZE,
+				  PAGE_SIZE))
+			errors++;
+		cond_resched();
+	}
+	ret = 0;
+
+	bytes = (u64)sample->nr * PAGE_SIZE;
+	seq_printf(s, "%-8s %5u.%02u %12llu %12llu %8d %8d\n", name,
+		   (unsigned int)div64_u64(bytes, csize),
+		   (unsigned int)div64_u64(bytes * 100, csize) % 100,
+		   bench_mbps(bytes, comp_ns),
+		   bench_mbps(bytes - (u64)incompressible * PAGE_SIZE,
+			      decomp_ns),
+		   incompressible, errors);
+out:
+	kfree(out);
+	vfree(clens);
+	vfree(cdata);
+	zcomp_destroy(comp);
+	return ret;
+}
+
+static int bench_results_show(struct seq_file *s, void *unused)
+{
+	struct bench_sample sample = { NULL, 0, 0 };
+	const char *name;
+	int i, ret;
+
+	mutex_lock(&bench_mutex);
+	ret = bench_collect(&sample);
+	if (ret)
+		goto out;
+
+	seq_printf(s, "pid %u: %d pages sampled, %d same-filled left out\n",
+		   bench_pid, sample.nr + sample.nr_same, sample.nr_same);
+	if (!sample.nr)
+		goto out;
+
+	seq_printf(s, "%-8s %8s %12s %12s %8s %8s\n", "backend", "ratio",
+		   "comp_MB/s", "decomp_MB/s", "incompr", "errors");
+	for (i = 0; (name = zcomp_backend_name(i)); i++) {
+		ret = bench_backend(s, name, &sample);
+		if (ret) {
+			pr_err("%s failed: %d\n", name, ret);
+			break;
+		}
+	}
+out:
+	vfree(sample.data);
+	mutex_unlock(&bench_mutex);
+	return ret;
+}
+
+static int bench_results_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bench_results_show, inode->i_private);
+}
+
+static const struct file_operations bench_results_fops = {
+	.open = bench_results_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init zcomp_bench_init(void)
+{
+	bench_root = debugfs_create_dir("zcomp_bench", NULL);
+	if (IS_ERR_OR_NULL(bench_root))
+		return -ENOMEM;
+
+	if (!debugfs_create_u32("pid", 0644, bench_root, &bench_pid) ||
+	    !debugfs_create_u32("pages", 0644, bench_root, &bench_pages) ||
+	    !debugfs_create_file("results", 0444, bench_root, NULL,
+				 &bench_results_fops)) {
+		debugfs_remove_recursive(bench_root);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void __exit zcomp_bench_exit(void)
+{
+	debugfs_remove_recursive(bench_root);
+}
+
+module_init(zcomp_bench_init);
+module_exit(zcomp_bench_exit);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("Benchmark of the zram compression backends");
@@ -0,0 +1,144 @@
+/*
+ * Compressed RAM block device - deduplication of compressed objects
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "zram_drv.h"
+
+u32 zram_dedup_checksum(const void *mem, size_t len)
+{
+	return jhash(mem, len, 0);
+}
+
+static struct zram_entry *zram_entry_next(struct zram_entry *entry)
+{
+	struct rb_node *node = rb_next(&entry->rb_node);
+
+	return node ? rb_entry(node, struct zram_entry, rb_node) : NULL;
+}
+
+/*
+ * Look for an object with the same compressed contents as @mem.  Both
+ * compressors are deterministic, so identical pages compress to identical
+ * bytes and comparing the compressed data is enough.  On success a
+ * reference is taken on the returned entry.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, const void *mem,
+				size_t len, u32 checksum)
+{
+	struct rb_node *node;
+	struct zram_entry *entry, *found = NULL;
+
+	spin_lock(&zram->dedup_lock);
+
+	/* Find the leftmost entry with a matching checksum */
+	node = zram->dedup_root.rb_node;
+	entry = NULL;
+	while (node) {
+		struct zram_entry *cur;
+
+		cur = rb_entry(node, struct zram_entry, rb_node);
+		if (checksum < cur->checksum)
+			node = node->rb_left;
+		else if (checksum > cur->checksum)
+			node = node->rb_right;
+		else {
+			entry = cur;
+			node = node->rb_left;
+		}
+	}
+
+	/* ...and compare against every entry sharing it */
+	for (; entry && entry->checksum == checksum;
+	     entry = zram_entry_next(entry)) {
+		void *cmem;
+		int match;
+
+		if (entry->len != len)
+			continue;
+
+		cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+		match = !memcmp(cmem, mem, len);
+		zs_unmap_object(zram->mem_pool, entry->handle);
+
+		if (match) {
+			entry->refcount++;
+			found = entry;
+			break;
+		}
+	}
+
+	spin_unlock(&zram->dedup_lock);
+
+	return found;
+}
+
+/*
+ * Wrap a freshly written object in an entry and make it visible to later
+ * writers.  Returns NULL (leaving @handle to the caller) on allocation
+ * failure.
+ */
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				size_t len, u32 checksum)
+{
+	struct rb_node **link, *parent = NULL;
+	struct zram_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->len = len;
+	entry->refcount = 1;
+	entry->handle = handle;
+
+	spin_lock(&zram->dedup_lock);
+	link = &zram->dedup_root.rb_node;
+	while (*link) {
+		struct zram_entry *cur;
+
+		parent = *link;
+		cur = rb_entry(parent, struct zram_entry, rb_node);
+		if (checksum < cur->checksum)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&entry->rb_node, parent, link);
+	rb_insert_color(&entry->rb_node, &zram->dedup_root);
+	spin_unlock(&zram->dedup_lock);
+
+	return entry;
+}
+
+/*
+ * Drop a table slot's reference.  Returns true if this was the last one,
+ * in which case the compressed object has been freed as well.
+ */
+bool zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	bool last;
+
+	spin_lock(&zram->dedup_lock);
+	last = !--entry->refcount;
+	if (last)
+		rb_erase(&entry->rb_node, &zram->dedup_root);
+	spin_unlock(&zram->dedup_lock);
+
+	if (last) {
+		zs_free(zram->mem_pool, entry->handle);
+		kfree(entry);
+	}
+
+	return last;
+}
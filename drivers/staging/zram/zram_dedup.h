@@ -0,0 +1,63 @@
+/*
+ * Compressed RAM block device - deduplication of compressed objects
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+#include <linux/rbtree.h>
+#include <linux/types.h>
+
+struct zram;
+
+/*
+ * With deduplication enabled, table[].handle of a compressed page points
+ * to one of these instead of holding the zsmalloc handle directly.  Slots
+ * holding identical compressed data share the entry.
+ */
+struct zram_entry {
+	struct rb_node rb_node;	/* in zram->dedup_root, keyed by checksum */
+	u32 checksum;		/* jhash of the compressed data */
+	u16 len;		/* compressed size */
+	int refcount;		/* table slots using this entry */
+	unsigned long handle;	/* zsmalloc handle of the data */
+};
+
+#ifdef CONFIG_ZRAM_DEDUP
+u32 zram_dedup_checksum(const void *mem, size_t len);
+struct zram_entry *zram_dedup_find(struct zram *zram, const void *mem,
+				size_t len, u32 checksum);
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				size_t len, u32 checksum);
+bool zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+#else
+static inline u32 zram_dedup_checksum(const void *mem, size_t len)
+{
+	return 0;
+}
+
+static inline struct zram_entry *zram_dedup_find(struct zram *zram,
+				const void *mem, size_t len, u32 checksum)
+{
+	return NULL;
+}
+
+static inline struct zram_entry *zram_dedup_insert(struct zram *zram,
+				unsigned long handle, size_t len, u32 checksum)
+{
+	return NULL;
+}
+
+static inline bool zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	return false;
+}
+#endif
+
+#endif
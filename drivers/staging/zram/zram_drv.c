@@ -29,7 +29,6 @@
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
@@ -89,21 +88,39 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
-static int page_zero_filled(void *ptr)
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
+	unsigned long val;
 
 	page = (unsigned long *)ptr;
+	val = page[0];
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != val)
 			return 0;
 	}
 
+	*element = val;
 	return 1;
 }
 
+static void zram_fill_page(void *ptr, unsigned long element)
+{
+	unsigned int pos;
+	unsigned long *page;
+
+	if (likely(!element)) {
+		memset(ptr, 0, PAGE_SIZE);
+		return;
+	}
+
+	page = (unsigned long *)ptr;
+	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++)
+		page[pos] = element;
+}
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -133,56 +150,115 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
-static void zram_free_page(struct zram *zram, size_t index)
+#ifdef CONFIG_ZRAM_WRITEBACK
+/*
+ * Block 0 of the backing device is never handed out, so a written back
+ * slot's handle is never zero.
+ */
+static unsigned long zram_alloc_block(struct zram *zram)
+{
+	unsigned long blk;
+
+retry:
+	blk = find_next_zero_bit(zram->bitmap, zram->nr_blocks, 1);
+	if (blk >= zram->nr_blocks)
+		return 0;
+
+	if (test_and_set_bit(blk, zram->bitmap))
+		goto retry;
+
+	return blk;
+}
+
+static void zram_free_block(struct zram *zram, unsigned long blk)
+{
+	WARN_ON_ONCE(!test_and_clear_bit(blk, zram->bitmap));
+}
+#else
+static inline void zram_free_block(struct zram *zram, unsigned long blk)
 {
-	u32 clen;
-	void *obj;
+}
+#endif
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+/* Called with tb_lock held for write */
+static void zram_free_page(struct zram *zram, size_t index)
+{
+	unsigned long handle = zram->table[index].handle;
+	u16 size = zram->table[index].size;
+
+	/* Let a writeback in progress know the slot has changed */
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_free_block(zram, handle);
+		zram_stat_dec(&zram->stats.bd_count);
+		zram->table[index].handle = 0;
+		return;
+	}
 
-	if (unlikely(!page)) {
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
 		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
+		 * No memory is allocated for same element filled pages.
+		 * Simply clear same page flag.
 		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		if (!handle)
 			zram_stat_dec(&zram->stats.pages_zero);
-		}
+		zram_stat_dec(&zram->stats.pages_same);
+		zram->table[index].handle = 0;
 		return;
 	}
 
+	if (unlikely(!handle))
+		return;
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		clen = PAGE_SIZE;
-		__free_page(page);
+		__free_page((struct page *)handle);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
+		zram_stat64_sub(zram, &zram->stats.compr_size, size);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
+	if (!zram_dedup_enabled(zram)) {
+		zs_free(zram->mem_pool, handle);
+		zram_stat64_sub(zram, &zram->stats.compr_size, size);
+	} else if (zram_dedup_put(zram, (struct zram_entry *)handle)) {
+		zram_stat64_sub(zram, &zram->stats.compr_size, size);
+	} else {
+		/* Other pages still share this object */
+		zram_stat64_sub(zram, &zram->stats.dup_data_size, size);
+	}
 
-	xv_free(zram->mem_pool, page, offset);
-	if (clen <= PAGE_SIZE / 2)
+	if (size <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
 out:
-	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].handle = 0;
+	zram->table[index].size = 0;
+}
+
+/* zsmalloc handle of a compressed page, looking through dedup entries */
+static unsigned long zram_obj_handle(struct zram *zram, u32 index)
+{
+	unsigned long handle = zram->table[index].handle;
+
+	if (zram_dedup_enabled(zram))
+		handle = ((struct zram_entry *)handle)->handle;
+
+	return handle;
 }
 
-static void handle_zero_page(struct page *page)
+static void handle_same_page(struct page *page, unsigned long element)
 {
 	void *user_mem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem, 0, PAGE_SIZE);
+	zram_fill_page(user_mem, element);
 	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
@@ -194,16 +270,436 @@ static void handle_uncompressed_page(struct zram *zram,
 	unsigned char *user_mem, *cmem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+	cmem = kmap_atomic((struct page *)zram->table[index].handle, KM_USER1);
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
-	kunmap_atomic(user_mem, KM_USER0);
 	kunmap_atomic(cmem, KM_USER1);
+	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
 }
 
+/* Called with tb_lock held */
+static int zram_decompress_page(struct zram *zram, struct page *page,
+				u32 index)
+{
+	int ret;
+	unsigned long handle;
+	unsigned char *user_mem, *cmem;
+
+	handle = zram_obj_handle(zram, index);
+	cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
+	user_mem = kmap_atomic(page, KM_USER0);
+
+	ret = zcomp_decompress(zram->comp,
+		cmem + sizeof(struct zobj_header),
+		zram->table[index].size,
+		user_mem);
+
+	kunmap_atomic(user_mem, KM_USER0);
+	zs_unmap_object(zram->mem_pool, handle);
+
+	return ret;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+struct zram_bio_wait {
+	struct completion done;
+	int error;
+};
+
+static void zram_bdev_end_io(struct bio *bio, int err)
+{
+	struct zram_bio_wait *wait = bio->bi_private;
+
+	wait->error = err;
+	complete(&wait->done);
+}
+
+/* Synchronously read or write one page of the backing device */
+static int zram_bdev_rw(struct zram *zram, struct page *page,
+			unsigned long blk, int rw)
+{
+	struct bio *bio;
+	struct zram_bio_wait wait;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_sector = (sector_t)blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = zram->bdev;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	init_completion(&wait.done);
+	wait.error = 0;
+	bio->bi_private = &wait;
+	bio->bi_end_io = zram_bdev_end_io;
+
+	submit_bio(rw, bio);
+	wait_for_completion(&wait.done);
+
+	if (!wait.error && !test_bit(BIO_UPTODATE, &bio->bi_flags))
+		wait.error = -EIO;
+	bio_put(bio);
+
+	return wait.error;
+}
+
+struct zram_read_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk;
+	int ret;
+};
+
+static void zram_sync_read(struct work_struct *work)
+{
+	struct zram_read_work *rw;
+
+	rw = container_of(work, struct zram_read_work, work);
+	rw->ret = zram_bdev_rw(rw->zram, rw->page, rw->blk, READ);
+}
+
+/*
+ * Read a written back page into @page.  Returns -EAGAIN if the slot no
+ * longer lives on the backing device and should be looked up again.
+ */
+static int zram_bd_read(struct zram *zram, struct page *page, u32 index)
+{
+	struct zram_read_work rw;
+
+	/* Keeps the block from being reused until the read completes */
+	down_read(&zram->wb_sem);
+
+	read_lock(&zram->tb_lock);
+	if (!zram_test_flag(zram, index, ZRAM_WB)) {
+		read_unlock(&zram->tb_lock);
+		up_read(&zram->wb_sem);
+		return -EAGAIN;
+	}
+	rw.blk = zram->table[index].handle;
+	read_unlock(&zram->tb_lock);
+
+	/*
+	 * Bios submitted from within zram_make_request() are only issued
+	 * after it returns, so waiting for one here would deadlock.  Let a
+	 * worker do the read.  This may be a swap-in under memory pressure,
+	 * so use our own WQ_MEM_RECLAIM queue: a shared pool may need to
+	 * allocate a worker first, and that allocation can wait on us.
+	 */
+	rw.zram = zram;
+	rw.page = page;
+	INIT_WORK_ONSTACK(&rw.work, zram_sync_read);
+	queue_work(zram->read_wq, &rw.work);
+	flush_work(&rw.work);
+	destroy_work_on_stack(&rw.work);
+
+	up_read(&zram->wb_sem);
+
+	if (!rw.ret)
+		zram_stat64_inc(zram, &zram->stats.bd_reads);
+
+	return rw.ret;
+}
+
+/* Called with tb_lock held for write */
+static int zram_wb_candidate(struct zram *zram, u32 index, int idle)
+{
+	if (!zram->table[index].handle ||
+	    zram_test_flag(zram, index, ZRAM_SAME) ||
+	    zram_test_flag(zram, index, ZRAM_WB))
+		return 0;
+
+	if (zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))
+		return 1;
+
+	if (!idle)
+		return 0;
+
+	if (zram_test_flag(zram, index, ZRAM_IDLE))
+		return 1;
+
+	/* Accessed since the last pass; give it another period */
+	zram_set_flag(zram, index, ZRAM_IDLE);
+	return 0;
+}
+
+/*
+ * Write one slot out to the backing device if it is a candidate, using
+ * @page as a bounce buffer.  Returns -ENOSPC once the backing device is
+ * full or failing.
+ */
+static int zram_writeback_slot(struct zram *zram, struct page *page,
+				u32 index, int idle)
+{
+	unsigned long blk;
+	int ret;
+
+	write_lock(&zram->tb_lock);
+	if (!zram_wb_candidate(zram, index, idle)) {
+		write_unlock(&zram->tb_lock);
+		return 0;
+	}
+
+	if (zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
+		handle_uncompressed_page(zram, page, index);
+		ret = 0;
+	} else
+		ret = zram_decompress_page(zram, page, index);
+
+	if (unlikely(ret)) {
+		write_unlock(&zram->tb_lock);
+		return 0;
+	}
+	zram_set_flag(zram, index, ZRAM_UNDER_WB);
+	write_unlock(&zram->tb_lock);
+
+	down_write(&zram->wb_sem);
+	blk = zram_alloc_block(zram);
+	if (blk && zram_bdev_rw(zram, page, blk, WRITE)) {
+		zram_free_block(zram, blk);
+		blk = 0;
+	}
+	up_write(&zram->wb_sem);
+
+	if (blk)
+		zram_stat64_inc(zram, &zram->stats.bd_writes);
+
+	write_lock(&zram->tb_lock);
+	if (blk && zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+		zram_free_page(zram, index);
+		zram->table[index].handle = blk;
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_stat_inc(&zram->stats.bd_count);
+		blk = 0;
+	} else if (!blk) {
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		write_unlock(&zram->tb_lock);
+		return -ENOSPC;
+	}
+	write_unlock(&zram->tb_lock);
+
+	/* The slot was rewritten while we were busy */
+	if (blk)
+		zram_free_block(zram, blk);
+
+	return 0;
+}
+
+/*
+ * Write huge pages and, if @idle, pages not accessed since the previous
+ * idle pass out to the backing device, freeing their memory.  Without
+ * @idle only the slots marked in huge_map are looked at.
+ */
+static void zram_writeback(struct zram *zram, int idle)
+{
+	size_t index, nr_pages;
+	struct page *page;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return;
+
+	mutex_lock(&zram->wb_lock);
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	if (idle) {
+		for (index = 0; index < nr_pages && zram->init_done; index++)
+			if (zram_writeback_slot(zram, page, index, 1))
+				break;
+		goto out;
+	}
+
+	for (index = find_first_bit(zram->huge_map, nr_pages);
+	     index < nr_pages && zram->init_done;
+	     index = find_next_bit(zram->huge_map, nr_pages, index + 1)) {
+		/*
+		 * A huge page stored from here on sets the bit again, so
+		 * clearing it first cannot lose one.
+		 */
+		if (!test_and_clear_bit(index, zram->huge_map))
+			continue;
+		if (zram_writeback_slot(zram, page, index, 0)) {
+			/* Backing device is full or failing; stop here */
+			set_bit(index, zram->huge_map);
+			break;
+		}
+	}
+out:
+	mutex_unlock(&zram->wb_lock);
+
+	__free_page(page);
+}
+
+static void zram_wb_work(struct work_struct *work)
+{
+	struct zram *zram = container_of(work, struct zram, wb_work);
+
+	zram_writeback(zram, 0);
+}
+
+static void zram_idle_work(struct work_struct *work)
+{
+	struct zram *zram = container_of(to_delayed_work(work), struct zram,
+					idle_work);
+	unsigned int secs = zram->wb_idle_secs;
+
+	zram_writeback(zram, 1);
+
+	if (secs && zram->init_done)
+		queue_delayed_work(system_unbound_wq, &zram->idle_work,
+				secs * HZ);
+}
+
+/* A huge page was stored at @index; push it out to the backing device */
+static void zram_kick_writeback(struct zram *zram, u32 index)
+{
+	if (zram->huge_map) {
+		set_bit(index, zram->huge_map);
+		queue_work(system_unbound_wq, &zram->wb_work);
+	}
+}
+
+/* Called from zram_init_device(), once the backing device is fixed */
+static int zram_init_writeback(struct zram *zram, size_t num_pages)
+{
+	if (!zram->bdev)
+		return 0;
+
+	zram->huge_map = vzalloc(BITS_TO_LONGS(num_pages) * sizeof(long));
+	if (!zram->huge_map)
+		return -ENOMEM;
+
+	zram->read_wq = alloc_workqueue("zram_wb", WQ_MEM_RECLAIM | WQ_UNBOUND,
+					0);
+	if (!zram->read_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+static void zram_start_writeback(struct zram *zram)
+{
+	if (zram->bdev && zram->wb_idle_secs)
+		queue_delayed_work(system_unbound_wq, &zram->idle_work,
+				zram->wb_idle_secs * HZ);
+}
+
+static void zram_stop_writeback(struct zram *zram)
+{
+	cancel_work_sync(&zram->wb_work);
+	cancel_delayed_work_sync(&zram->idle_work);
+	vfree(zram->huge_map);
+	zram->huge_map = NULL;
+	if (zram->read_wq)
+		destroy_workqueue(zram->read_wq);
+	zram->read_wq = NULL;
+}
+
+static void zram_release_backing_dev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	zram->bdev = NULL;
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+	zram->nr_blocks = 0;
+	kfree(zram->backing_dev);
+	zram->backing_dev = NULL;
+}
+
+/*
+ * Called with init_lock held, before the device is initialized.  An empty
+ * @path drops the current backing device.
+ */
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	struct block_device *bdev;
+	unsigned long nr_blocks, *bitmap;
+	char *name;
+	int ret;
+
+	zram_release_backing_dev(zram);
+	if (!*path)
+		return 0;
+
+	name = kstrdup(path, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+
+	bdev = blkdev_get_by_path(name, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				zram);
+	if (IS_ERR(bdev)) {
+		ret = PTR_ERR(bdev);
+		goto out_free_name;
+	}
+
+	/* Don't let a device back itself */
+	if (bdev->bd_disk == zram->disk) {
+		ret = -EINVAL;
+		goto out_put;
+	}
+
+	ret = set_blocksize(bdev, PAGE_SIZE);
+	if (ret)
+		goto out_put;
+
+	nr_blocks = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (nr_blocks < 2) {
+		ret = -EINVAL;
+		goto out_put;
+	}
+
+	bitmap = vzalloc(BITS_TO_LONGS(nr_blocks) * sizeof(long));
+	if (!bitmap) {
+		ret = -ENOMEM;
+		goto out_put;
+	}
+
+	zram->bdev = bdev;
+	zram->bitmap = bitmap;
+	zram->nr_blocks = nr_blocks;
+	zram->backing_dev = name;
+	pr_info("Using %s as backing device (%lu pages)\n", name, nr_blocks);
+
+	return 0;
+
+out_put:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+out_free_name:
+	kfree(name);
+	return ret;
+}
+
+void zram_set_wb_idle_secs(struct zram *zram, unsigned int secs)
+{
+	cancel_delayed_work_sync(&zram->idle_work);
+	zram->wb_idle_secs = secs;
+	if (zram->init_done)
+		zram_start_writeback(zram);
+}
+#else
+static inline int zram_bd_read(struct zram *zram, struct page *page,
+				u32 index)
+{
+	return -EIO;
+}
+
+static inline void zram_kick_writeback(struct zram *zram, u32 index) { }
+static inline int zram_init_writeback(struct zram *zram, size_t num_pages)
+{
+	return 0;
+}
+static inline void zram_start_writeback(struct zram *zram) { }
+static inline void zram_stop_writeback(struct zram *zram) { }
+static inline void zram_release_backing_dev(struct zram *zram) { }
+#endif
+
 static void zram_read(struct zram *zram, struct bio *bio)
 {
 
@@ -216,51 +712,68 @@ static void zram_read(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		size_t clen;
 		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
 
 		page = bvec->bv_page;
 
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
+retry:
+		read_lock(&zram->tb_lock);
+		if (zram_test_flag(zram, index, ZRAM_SAME)) {
+			unsigned long element = zram->table[index].handle;
+
+			read_unlock(&zram->tb_lock);
+			handle_same_page(page, element);
+			index++;
+			continue;
+		}
+
+		/* Page lives on the backing device */
+		if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+			read_unlock(&zram->tb_lock);
+			ret = zram_bd_read(zram, page, index);
+			if (ret == -EAGAIN)
+				goto retry;
+			if (unlikely(ret)) {
+				pr_err("Backing device read failed! err=%d, "
+					"page=%u\n", ret, index);
+				zram_stat64_inc(zram,
+					&zram->stats.failed_reads);
+				goto out;
+			}
+			flush_dcache_page(page);
 			index++;
 			continue;
 		}
 
 		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
+		if (unlikely(!zram->table[index].handle)) {
+			read_unlock(&zram->tb_lock);
 			pr_debug("Read before write: sector=%lu, size=%u",
 				(ulong)(bio->bi_sector), bio->bi_size);
-			handle_zero_page(page);
+			handle_same_page(page, 0);
 			index++;
 			continue;
 		}
 
+		/*
+		 * Only ever cleared under the read lock, and set under the
+		 * write lock, so concurrent readers cannot lose an update.
+		 */
+		zram_clear_flag(zram, index, ZRAM_IDLE);
+
 		/* Page is stored uncompressed since it's incompressible */
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 			handle_uncompressed_page(zram, page, index);
+			read_unlock(&zram->tb_lock);
 			index++;
 			continue;
 		}
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
-
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+		ret = zram_decompress_page(zram, page, index);
+		read_unlock(&zram->tb_lock);
 
 		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
+		if (unlikely(ret)) {
 			pr_err("Decompression failed! err=%d, page=%u\n",
 				ret, index);
 			zram_stat64_inc(zram, &zram->stats.failed_reads);
@@ -290,42 +803,50 @@ static void zram_write(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		u32 offset;
+		unsigned long handle, element;
 		size_t clen;
+		u32 checksum = 0;
 		struct zobj_header *zheader;
 		struct page *page, *page_store;
 		unsigned char *user_mem, *cmem, *src;
+		struct zcomp_strm *zstrm;
+		struct zram_entry *entry;
+		int uncompressed = 0, dup = 0;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
 
 		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
+		 * Compression and allocation run without tb_lock, on a
+		 * stream of our own, so writers on other CPUs proceed in
+		 * parallel.  The old object is replaced (and freed) only
+		 * once the new one is complete.
 		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
-
-		mutex_lock(&zram->lock);
-
 		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
+		if (page_same_filled(user_mem, &element)) {
 			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
+			write_lock(&zram->tb_lock);
+			zram_free_page(zram, index);
+			zram->table[index].handle = element;
+			zram_set_flag(zram, index, ZRAM_SAME);
+			zram_stat_inc(&zram->stats.pages_same);
+			if (!element)
+				zram_stat_inc(&zram->stats.pages_zero);
+			write_unlock(&zram->tb_lock);
 			index++;
 			continue;
 		}
+		kunmap_atomic(user_mem, KM_USER0);
+
+		zstrm = zcomp_strm_find(zram->comp);
+		src = zstrm->buffer;
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+		user_mem = kmap_atomic(page, KM_USER0);
+		ret = zcomp_compress(zram->comp, zstrm, user_mem, &clen);
 
 		kunmap_atomic(user_mem, KM_USER0);
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
+		if (unlikely(ret)) {
+			zcomp_strm_release(zram->comp, zstrm);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
@@ -340,7 +861,7 @@ static void zram_write(struct zram *zram, struct bio *bio)
 			clen = PAGE_SIZE;
 			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
 			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
+				zcomp_strm_release(zram->comp, zstrm);
 				pr_info("Error allocating memory for "
 					"incompressible page: %u\n", index);
 				zram_stat64_inc(zram,
@@ -348,52 +869,89 @@ static void zram_write(struct zram *zram, struct bio *bio)
 				goto out;
 			}
 
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
+			handle = (unsigned long)page_store;
+			uncompressed = 1;
+
 			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
+			cmem = kmap_atomic(page_store, KM_USER1);
+			memcpy(cmem, src, clen);
+			kunmap_atomic(cmem, KM_USER1);
+			kunmap_atomic(src, KM_USER0);
+			goto store;
+		}
+
+		if (zram_dedup_enabled(zram)) {
+			checksum = zram_dedup_checksum(src, clen);
+			entry = zram_dedup_find(zram, src, clen, checksum);
+			if (entry) {
+				/* Identical data is already stored */
+				handle = (unsigned long)entry;
+				dup = 1;
+				goto store;
+			}
 		}
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
+		handle = zs_malloc(zram->mem_pool, clen + sizeof(*zheader));
+		if (unlikely(!handle)) {
+			zcomp_strm_release(zram->comp, zstrm);
 			pr_info("Error allocating memory for compressed "
 				"page: %u, size=%zu\n", index, clen);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
 		}
 
-memstore:
-		zram->table[index].offset = offset;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
+		cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
 #if 0
 		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
-		}
+		zheader = (struct zobj_header *)cmem;
+		zheader->table_idx = index;
+		cmem += sizeof(*zheader);
 #endif
-
 		memcpy(cmem, src, clen);
+		zs_unmap_object(zram->mem_pool, handle);
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+		if (zram_dedup_enabled(zram)) {
+			entry = zram_dedup_insert(zram, handle, clen, checksum);
+			if (unlikely(!entry)) {
+				zs_free(zram->mem_pool, handle);
+				zcomp_strm_release(zram->comp, zstrm);
+				zram_stat64_inc(zram,
+					&zram->stats.failed_writes);
+				goto out;
+			}
+			handle = (unsigned long)entry;
+		}
+
+store:
+		zcomp_strm_release(zram->comp, zstrm);
+
+		/*
+		 * System overwrites unused sectors. Free memory associated
+		 * with this sector now.
+		 */
+		write_lock(&zram->tb_lock);
+		zram_free_page(zram, index);
+
+		zram->table[index].handle = handle;
+		zram->table[index].size = clen;
+		if (unlikely(uncompressed)) {
+			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+			zram_stat_inc(&zram->stats.pages_expand);
+		}
 
 		/* Update stats */
-		zram_stat64_add(zram, &zram->stats.compr_size, clen);
+		if (unlikely(dup))
+			zram_stat64_add(zram, &zram->stats.dup_data_size, clen);
+		else
+			zram_stat64_add(zram, &zram->stats.compr_size, clen);
 		zram_stat_inc(&zram->stats.pages_stored);
 		if (clen <= PAGE_SIZE / 2)
 			zram_stat_inc(&zram->stats.good_compress);
+		write_unlock(&zram->tb_lock);
+
+		if (unlikely(uncompressed))
+			zram_kick_writeback(zram, index);
 
-		mutex_unlock(&zram->lock);
 		index++;
 	}
 
@@ -459,37 +1017,38 @@ void zram_reset_device(struct zram *zram)
 
 	mutex_lock(&zram->init_lock);
 	zram->init_done = 0;
+	zram_stop_writeback(zram);
 
 	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	if (zram->comp)
+		zcomp_destroy(zram->comp);
+	zram->comp = NULL;
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
+		unsigned long handle = zram->table[index].handle;
 
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
-
-		if (!page)
+		if (!handle || zram_test_flag(zram, index, ZRAM_SAME) ||
+		    zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
+			__free_page((struct page *)handle);
+		else if (zram_dedup_enabled(zram))
+			zram_dedup_put(zram, (struct zram_entry *)handle);
 		else
-			xv_free(zram->mem_pool, page, offset);
+			zs_free(zram->mem_pool, handle);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
+	zram_release_backing_dev(zram);
+
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
@@ -511,16 +1070,10 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	zram->comp = zcomp_create(zram->compressor,
+			zram->max_comp_streams ?: num_online_cpus());
+	if (!zram->comp) {
+		pr_err("Error initializing %s compressor\n", zram->compressor);
 		ret = -ENOMEM;
 		goto fail;
 	}
@@ -535,12 +1088,20 @@ int zram_init_device(struct zram *zram)
 		goto fail;
 	}
 
+	ret = zram_init_writeback(zram, num_pages);
+	if (ret) {
+		pr_err("Error setting up writeback\n");
+		goto fail;
+	}
+
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
+	zram->dedup_root = RB_ROOT;
 
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name,
+					GFP_NOIO | __GFP_HIGHMEM);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -548,6 +1109,7 @@ int zram_init_device(struct zram *zram)
 	}
 
 	zram->init_done = 1;
+	zram_start_writeback(zram);
 	mutex_unlock(&zram->init_lock);
 
 	pr_debug("Initialization done!\n");
@@ -566,7 +1128,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->tb_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->tb_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -579,9 +1143,17 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
+	rwlock_init(&zram->tb_lock);
 	spin_lock_init(&zram->stat64_lock);
+	spin_lock_init(&zram->dedup_lock);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	init_rwsem(&zram->wb_sem);
+	mutex_init(&zram->wb_lock);
+	INIT_WORK(&zram->wb_work, zram_wb_work);
+	INIT_DELAYED_WORK(&zram->idle_work, zram_idle_work);
+#endif
+	strlcpy(zram->compressor, default_compressor, sizeof(zram->compressor));
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -713,6 +1285,7 @@ static void __exit zram_exit(void)
 		destroy_device(zram);
 		if (zram->init_done)
 			zram_reset_device(zram);
+		zram_release_backing_dev(zram);
 	}
 
 	unregister_blkdev(zram_major, "zram");
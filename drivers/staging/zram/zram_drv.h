@@ -17,8 +17,12 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/rwsem.h>
+#include <linux/workqueue.h>
 
-#include "xvmalloc.h"
+#include "../zsmalloc/zsmalloc.h"
+#include "zcomp.h"
+#include "zram_dedup.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -40,6 +44,9 @@ struct zobj_header {
 
 /*-- Configurable parameters */
 
+/* Compression backend used unless comp_algorithm is written */
+static const char default_compressor[] = "lzo";
+
 /* Default zram disk size: 25% of total RAM */
 static const unsigned default_disksize_perc_ram = 25;
 
@@ -51,8 +58,8 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
+ * otherwise, zs_malloc() would always return failure.
  */
 
 /*-- End of configurable params */
@@ -68,8 +75,20 @@ enum zram_pageflags {
 	/* Page is stored uncompressed */
 	ZRAM_UNCOMPRESSED,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/*
+	 * Page is filled with a single repeated word, kept in
+	 * table[page_no].handle; no memory is allocated for it.
+	 */
+	ZRAM_SAME,
+
+	/* Page was written back; table[page_no].handle is the block index */
+	ZRAM_WB,
+
+	/* Page is being written back to the backing device */
+	ZRAM_UNDER_WB,
+
+	/* Page has not been accessed since the last idle writeback pass */
+	ZRAM_IDLE,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -78,8 +97,11 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
+	unsigned long handle;	/* zsmalloc handle, struct zram_entry * if
+				 * deduplicating, struct page * if
+				 * ZRAM_UNCOMPRESSED, fill word if
+				 * ZRAM_SAME or block index if ZRAM_WB */
+	u16 size;	/* object size (excluding header) */
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
@@ -92,20 +114,24 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
+	u64 dup_data_size;	/* compressed bytes shared with other pages */
+	u64 bd_reads;		/* pages read back from the backing device */
+	u64 bd_writes;		/* pages written to the backing device */
 	u32 pages_zero;		/* no. of zero filled pages */
+	u32 pages_same;		/* no. of single word filled pages (incl. zero) */
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
+	u32 bd_count;		/* no. of pages held on the backing device */
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	struct zcomp *comp;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	rwlock_t tb_lock;	/* protect table entries and 32-bit stats
+				 * against concurrent reads and writes */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -116,6 +142,32 @@ struct zram {
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
+	/* name of the compression backend, set via comp_algorithm */
+	char compressor[ZCOMP_NAME_LEN];
+	/* compression streams; 0 means one per online CPU */
+	int max_comp_streams;
+	/* share identical compressed pages; set via use_dedup */
+	int use_dedup;
+	spinlock_t dedup_lock;	/* protects dedup_root and entry refcounts */
+	struct rb_root dedup_root;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Backing device for huge and idle pages, set via backing_dev */
+	struct block_device *bdev;
+	char *backing_dev;	/* path bdev was opened by */
+	unsigned long *bitmap;	/* blocks in use on bdev */
+	unsigned long nr_blocks;
+	/* slots a huge page was stored in since the last writeback pass */
+	unsigned long *huge_map;
+	/* reads of written back pages; may run in reclaim */
+	struct workqueue_struct *read_wq;
+	/* Held for write while a block is allocated and written */
+	struct rw_semaphore wb_sem;
+	struct mutex wb_lock;	/* serializes writeback passes */
+	struct work_struct wb_work;	/* writes back huge pages */
+	struct delayed_work idle_work;	/* periodic idle page writeback */
+	/* idle page writeback period; 0 disables it */
+	unsigned int wb_idle_secs;
+#endif
 
 	struct zram_stats stats;
 };
@@ -126,7 +178,20 @@ extern unsigned int num_devices;
 extern struct attribute_group zram_disk_attr_group;
 #endif
 
+static inline int zram_dedup_enabled(struct zram *zram)
+{
+#ifdef CONFIG_ZRAM_DEDUP
+	return zram->use_dedup;
+#else
+	return 0;
+#endif
+}
+
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_set_wb_idle_secs(struct zram *zram, unsigned int secs);
+#endif
 
 #endif
@@ -904,6 +904,9 @@ void write_checkpoint(struct f2fs_sb_info *sbi, bool is_umount)
 	mutex_lock(&sbi->cp_mutex);
 	block_operations(sbi);
 
+	/* no dirty node page is left, so every dirty dnode is tracked again */
+	fsync_dnodes_flushed(sbi);
+
 	trace_f2fs_write_checkpoint(sbi->sb, is_umount, "finish block_ops");
 
 	f2fs_submit_merged_bio(sbi, DATA, WRITE);
@@ -18,6 +18,7 @@
 #include <linux/blkdev.h>
 #include <linux/bio.h>
 #include <linux/prefetch.h>
+#include <linux/pagevec.h>
 
 #include "f2fs.h"
 #include "node.h"
@@ -268,55 +269,250 @@ int f2fs_reserve_block(struct dnode_of_data *dn, pgoff_t index)
 	return err;
 }
 
+static struct kmem_cache *extent_node_slab;
+
+/* all cached extent nodes, least recently used first */
+static LIST_HEAD(extent_lru);
+static DEFINE_SPINLOCK(extent_lru_lock);
+static int extent_lru_count;
+
+static inline struct f2fs_sb_info *ET_SB(struct extent_tree *et)
+{
+	struct f2fs_inode_info *fi = container_of(et, struct f2fs_inode_info,
+								ext_tree);
+	return F2FS_SB(fi->vfs_inode.i_sb);
+}
+
+static inline bool extent_contains(struct extent_info *ei, pgoff_t fofs)
+{
+	return ei->len && fofs >= ei->fofs && fofs < ei->fofs + ei->len;
+}
+
+static struct extent_node *__lookup_extent_node(struct extent_tree *et,
+							pgoff_t fofs)
+{
+	struct rb_node *node = et->root.rb_node;
+	struct extent_node *en;
+
+	while (node) {
+		en = rb_entry(node, struct extent_node, rb_node);
+		if (fofs < en->ei.fofs)
+			node = node->rb_left;
+		else if (fofs >= en->ei.fofs + en->ei.len)
+			node = node->rb_right;
+		else
+			return en;
+	}
+	return NULL;
+}
+
+/*
+ * Nodes are allocated under the tree lock, so this must not sleep. The
+ * cache is only a hint: if there is no memory, the extent is not cached.
+ */
+static struct extent_node *__insert_extent_node(struct extent_tree *et,
+				unsigned int fofs, u32 blk_addr, unsigned int len)
+{
+	struct rb_node **p = &et->root.rb_node;
+	struct rb_node *parent = NULL;
+	struct extent_node *en;
+
+	while (*p) {
+		parent = *p;
+		en = rb_entry(parent, struct extent_node, rb_node);
+		if (fofs < en->ei.fofs)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	en = kmem_cache_alloc(extent_node_slab, GFP_ATOMIC);
+	if (!en)
+		return NULL;
+
+	en->ei.fofs = fofs;
+	en->ei.blk_addr = blk_addr;
+	en->ei.len = len;
+	en->et = et;
+	rb_link_node(&en->rb_node, parent, p);
+	rb_insert_color(&en->rb_node, &et->root);
+	if (!et->count++)
+		stat_inc_ext_tree(ET_SB(et));
+	stat_inc_ext_node(ET_SB(et));
+
+	spin_lock(&extent_lru_lock);
+	list_add_tail(&en->list, &extent_lru);
+	extent_lru_count++;
+	spin_unlock(&extent_lru_lock);
+	return en;
+}
+
+/* the caller holds the tree lock and has taken the node off the lru list */
+static void __release_extent_node(struct extent_tree *et,
+					struct extent_node *en)
+{
+	rb_erase(&en->rb_node, &et->root);
+	if (et->cached_en == en)
+		et->cached_en = NULL;
+	if (!--et->count)
+		stat_dec_ext_tree(ET_SB(et));
+	stat_dec_ext_node(ET_SB(et));
+	kmem_cache_free(extent_node_slab, en);
+}
+
+static void __detach_extent_node(struct extent_tree *et,
+					struct extent_node *en)
+{
+	spin_lock(&extent_lru_lock);
+	list_del(&en->list);
+	extent_lru_count--;
+	spin_unlock(&extent_lru_lock);
+	__release_extent_node(et, en);
+}
+
+/* Drop fofs from the cached extents, splitting the node that covers it. */
+static void __drop_extent_node(struct extent_tree *et, pgoff_t fofs)
+{
+	struct extent_node *en = __lookup_extent_node(et, fofs);
+	unsigned int end_fofs;
+
+	if (!en)
+		return;
+
+	end_fofs = en->ei.fofs + en->ei.len - 1;
+	if (en->ei.len == 1) {
+		__detach_extent_node(et, en);
+	} else if (fofs == en->ei.fofs) {
+		en->ei.fofs++;
+		en->ei.blk_addr++;
+		en->ei.len--;
+	} else if (fofs == end_fofs) {
+		en->ei.len--;
+	} else {
+		en->ei.len = fofs - en->ei.fofs;
+		__insert_extent_node(et, fofs + 1,
+				en->ei.blk_addr + en->ei.len + 1,
+				end_fofs - fofs);
+	}
+}
+
+/* Cache fofs at blk_addr, merging it with its neighbours if possible. */
+static struct extent_node *__merge_extent_node(struct extent_tree *et,
+					pgoff_t fofs, block_t blk_addr)
+{
+	struct extent_node *prev = NULL, *next;
+
+	if (fofs)
+		prev = __lookup_extent_node(et, fofs - 1);
+	next = __lookup_extent_node(et, fofs + 1);
+
+	if (prev && prev->ei.blk_addr + prev->ei.len == blk_addr) {
+		prev->ei.len++;
+		if (next && next->ei.blk_addr == blk_addr + 1) {
+			prev->ei.len += next->ei.len;
+			__detach_extent_node(et, next);
+		}
+		return prev;
+	}
+
+	if (next && next->ei.blk_addr == blk_addr + 1) {
+		next->ei.fofs--;
+		next->ei.blk_addr--;
+		next->ei.len++;
+		return next;
+	}
+
+	return __insert_extent_node(et, fofs, blk_addr, 1);
+}
+
+/* Drop fofs from the largest extent, keeping its longer part. */
+static bool __drop_largest_extent(struct f2fs_inode_info *fi, pgoff_t fofs)
+{
+	struct extent_info *ei = &fi->ext;
+	unsigned int end_fofs;
+
+	if (!extent_contains(ei, fofs))
+		return false;
+
+	end_fofs = ei->fofs + ei->len - 1;
+	if (end_fofs - fofs < fofs - ei->fofs) {
+		ei->len = fofs - ei->fofs;
+	} else {
+		ei->blk_addr += fofs - ei->fofs + 1;
+		ei->len = end_fofs - fofs;
+		ei->fofs = fofs + 1;
+	}
+	if (ei->len < F2FS_MIN_EXTENT_LEN)
+		ei->len = 0;
+	return true;
+}
+
 static int check_extent_cache(struct inode *inode, pgoff_t pgofs,
 					struct buffer_head *bh_result)
 {
 	struct f2fs_inode_info *fi = F2FS_I(inode);
-	pgoff_t start_fofs, end_fofs;
-	block_t start_blkaddr;
+	struct extent_tree *et = &fi->ext_tree;
+	struct extent_node *en;
+	struct extent_info ei;
+	unsigned int blkbits = inode->i_sb->s_blocksize_bits;
+	size_t count;
 
 	if (is_inode_flag_set(fi, FI_NO_EXTENT))
 		return 0;
 
-	read_lock(&fi->ext.ext_lock);
-	if (fi->ext.len == 0) {
-		read_unlock(&fi->ext.ext_lock);
-		return 0;
-	}
-
 	stat_inc_total_hit(inode->i_sb);
 
-	start_fofs = fi->ext.fofs;
-	end_fofs = fi->ext.fofs + fi->ext.len - 1;
-	start_blkaddr = fi->ext.blk_addr;
-
-	if (pgofs >= start_fofs && pgofs <= end_fofs) {
-		unsigned int blkbits = inode->i_sb->s_blocksize_bits;
-		size_t count;
+	read_lock(&et->lock);
+	if (extent_contains(&fi->ext, pgofs)) {
+		ei = fi->ext;
+		stat_inc_largest_hit(inode->i_sb);
+		goto found;
+	}
 
-		clear_buffer_new(bh_result);
-		map_bh(bh_result, inode->i_sb,
-				start_blkaddr + pgofs - start_fofs);
-		count = end_fofs - pgofs + 1;
-		if (count < (UINT_MAX >> blkbits))
-			bh_result->b_size = (count << blkbits);
-		else
-			bh_result->b_size = UINT_MAX;
+	en = et->cached_en;
+	if (en && extent_contains(&en->ei, pgofs)) {
+		ei = en->ei;
+		stat_inc_cached_hit(inode->i_sb);
+		goto found;
+	}
 
-		stat_inc_read_hit(inode->i_sb);
-		read_unlock(&fi->ext.ext_lock);
-		return 1;
+	en = __lookup_extent_node(et, pgofs);
+	if (!en) {
+		read_unlock(&et->lock);
+		return 0;
 	}
-	read_unlock(&fi->ext.ext_lock);
-	return 0;
+	ei = en->ei;
+
+	/*
+	 * Readers may race on cached_en, but any node in the tree stays
+	 * valid until the tree lock is taken for writing.
+	 */
+	et->cached_en = en;
+	spin_lock(&extent_lru_lock);
+	list_move_tail(&en->list, &extent_lru);
+	spin_unlock(&extent_lru_lock);
+found:
+	read_unlock(&et->lock);
+
+	clear_buffer_new(bh_result);
+	map_bh(bh_result, inode->i_sb, ei.blk_addr + pgofs - ei.fofs);
+	count = ei.fofs + ei.len - pgofs;
+	if (count < (UINT_MAX >> blkbits))
+		bh_result->b_size = (count << blkbits);
+	else
+		bh_result->b_size = UINT_MAX;
+
+	stat_inc_read_hit(inode->i_sb);
+	return 1;
 }
 
 void update_extent_cache(block_t blk_addr, struct dnode_of_data *dn)
 {
 	struct f2fs_inode_info *fi = F2FS_I(dn->inode);
-	pgoff_t fofs, start_fofs, end_fofs;
-	block_t start_blkaddr, end_blkaddr;
-	int need_update = true;
+	struct extent_tree *et = &fi->ext_tree;
+	struct extent_node *en;
+	pgoff_t fofs;
+	bool need_update;
 
 	f2fs_bug_on(blk_addr == NEW_ADDR);
 	fofs = start_bidx_of_node(ofs_of_node(dn->node_page), fi) +
@@ -325,70 +521,92 @@ void update_extent_cache(block_t blk_addr, struct dnode_of_data *dn)
 	/* Update the page address in the parent node */
 	__set_data_blkaddr(dn, blk_addr);
 
-	if (is_inode_flag_set(fi, FI_NO_EXTENT))
-		return;
-
-	write_lock(&fi->ext.ext_lock);
-
-	start_fofs = fi->ext.fofs;
-	end_fofs = fi->ext.fofs + fi->ext.len - 1;
-	start_blkaddr = fi->ext.blk_addr;
-	end_blkaddr = fi->ext.blk_addr + fi->ext.len - 1;
+	write_lock(&et->lock);
 
-	/* Drop and initialize the matched extent */
-	if (fi->ext.len == 1 && fofs == start_fofs)
-		fi->ext.len = 0;
+	/* the old address of fofs must not be found in the cache anymore */
+	need_update = __drop_largest_extent(fi, fofs);
+	__drop_extent_node(et, fofs);
 
-	/* Initial extent */
-	if (fi->ext.len == 0) {
-		if (blk_addr != NULL_ADDR) {
-			fi->ext.fofs = fofs;
-			fi->ext.blk_addr = blk_addr;
-			fi->ext.len = 1;
-		}
+	if (blk_addr == NULL_ADDR || is_inode_flag_set(fi, FI_NO_EXTENT))
 		goto end_update;
-	}
 
-	/* Front merge */
-	if (fofs == start_fofs - 1 && blk_addr == start_blkaddr - 1) {
-		fi->ext.fofs--;
-		fi->ext.blk_addr--;
-		fi->ext.len++;
-		goto end_update;
+	/* the largest extent is written back to the inode as i_ext */
+	en = __merge_extent_node(et, fofs, blk_addr);
+	if (en && en->ei.len >= F2FS_MIN_EXTENT_LEN &&
+					en->ei.len > fi->ext.len) {
+		fi->ext = en->ei;
+		need_update = true;
 	}
+end_update:
+	write_unlock(&et->lock);
+	if (need_update)
+		sync_inode_page(dn);
+}
 
-	/* Back merge */
-	if (fofs == end_fofs + 1 && blk_addr == end_blkaddr + 1) {
-		fi->ext.len++;
-		goto end_update;
-	}
+void f2fs_destroy_extent_tree(struct inode *inode)
+{
+	struct extent_tree *et = &F2FS_I(inode)->ext_tree;
+	struct rb_node *node;
+
+	write_lock(&et->lock);
+	while ((node = rb_first(&et->root)))
+		__detach_extent_node(et,
+				rb_entry(node, struct extent_node, rb_node));
+	write_unlock(&et->lock);
+}
 
-	/* Split the existing extent */
-	if (fi->ext.len > 1 &&
-		fofs >= start_fofs && fofs <= end_fofs) {
-		if ((end_fofs - fofs) < (fi->ext.len >> 1)) {
-			fi->ext.len = fofs - start_fofs;
-		} else {
-			fi->ext.fofs = fofs + 1;
-			fi->ext.blk_addr = start_blkaddr +
-					fofs - start_fofs + 1;
-			fi->ext.len -= fofs - start_fofs + 1;
+/*
+ * Free the least recently used extent nodes. Trees that are busy are
+ * skipped, since the tree lock nests outside the lru lock elsewhere.
+ */
+static int f2fs_shrink_extent_cache(struct shrinker *shrink,
+					struct shrink_control *sc)
+{
+	int nr_to_scan = sc->nr_to_scan;
+	struct extent_node *en;
+	struct extent_tree *et;
+
+	if (!nr_to_scan)
+		return extent_lru_count;
+
+	spin_lock(&extent_lru_lock);
+	while (nr_to_scan-- > 0 && !list_empty(&extent_lru)) {
+		en = list_first_entry(&extent_lru, struct extent_node, list);
+		et = en->et;
+		if (!write_trylock(&et->lock)) {
+			list_move_tail(&en->list, &extent_lru);
+			continue;
 		}
-	} else {
-		need_update = false;
+		list_del(&en->list);
+		extent_lru_count--;
+		stat_inc_shrunk_ext(ET_SB(et));
+		__release_extent_node(et, en);
+		write_unlock(&et->lock);
 	}
+	spin_unlock(&extent_lru_lock);
 
-	/* Finally, if the extent is very fragmented, let's drop the cache. */
-	if (fi->ext.len < F2FS_MIN_EXTENT_LEN) {
-		fi->ext.len = 0;
-		set_inode_flag(fi, FI_NO_EXTENT);
-		need_update = true;
-	}
-end_update:
-	write_unlock(&fi->ext.ext_lock);
-	if (need_update)
-		sync_inode_page(dn);
-	return;
+	return extent_lru_count;
+}
+
+static struct shrinker extent_shrinker = {
+	.shrink = f2fs_shrink_extent_cache,
+	.seeks = DEFAULT_SEEKS,
+};
+
+int __init create_extent_caches(void)
+{
+	extent_node_slab = f2fs_kmem_cache_create("f2fs_extent_node",
+			sizeof(struct extent_node));
+	if (!extent_node_slab)
+		return -ENOMEM;
+	register_shrinker(&extent_shrinker);
+	return 0;
+}
+
+void destroy_extent_caches(void)
+{
+	unregister_shrinker(&extent_shrinker);
+	kmem_cache_destroy(extent_node_slab);
 }
 
 struct page *find_data_page(struct inode *inode, pgoff_t index, bool sync)
@@ -782,6 +1000,7 @@ int do_write_data_page(struct page *page, struct f2fs_io_info *fio)
 	 */
 	if (unlikely(old_blkaddr != NEW_ADDR &&
 			!is_cold_data(page) &&
+			!is_inode_flag_set(F2FS_I(inode), FI_ATOMIC_COMMIT) &&
 			need_inplace_update(inode))) {
 		rewrite_data_page(page, old_blkaddr, fio);
 	} else {
@@ -793,6 +1012,77 @@ out_writepage:
 	return err;
 }
 
+/*
+ * Write the held pages of an atomic write out of place, all under one
+ * f2fs_lock_op(), so that no checkpoint sees only some of them. The caller
+ * keeps FI_ATOMIC_FILE set meanwhile: writepage then leaves these pages
+ * alone, so nobody holds one of their locks while waiting for the
+ * checkpoint rwsem.
+ */
+int commit_atomic_pages(struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct address_space *mapping = inode->i_mapping;
+	loff_t i_size = i_size_read(inode);
+	const pgoff_t end_index = ((unsigned long long) i_size)
+							>> PAGE_CACHE_SHIFT;
+	unsigned offset = i_size & (PAGE_CACHE_SIZE - 1);
+	struct f2fs_io_info fio = {
+		.type = DATA,
+		.rw = WRITE_SYNC,
+	};
+	struct pagevec pvec;
+	pgoff_t index = 0;
+	int i, nr_pages, err = 0;
+
+	f2fs_balance_fs(sbi);
+
+	pagevec_init(&pvec, 0);
+	f2fs_lock_op(sbi);
+	while (!err && (nr_pages = pagevec_lookup_tag(&pvec, mapping, &index,
+				PAGECACHE_TAG_DIRTY, PAGEVEC_SIZE))) {
+		for (i = 0; i < nr_pages; i++) {
+			struct page *page = pvec.pages[i];
+
+			lock_page(page);
+			if (unlikely(page->mapping != mapping))
+				goto continue_unlock;
+
+			/* beyond i_size, see f2fs_write_data_page() */
+			if (page->index > end_index ||
+					(page->index == end_index && !offset)) {
+				cancel_dirty_page(page, PAGE_CACHE_SIZE);
+				goto continue_unlock;
+			}
+			if (page->index == end_index)
+				zero_user_segment(page, offset,
+							PAGE_CACHE_SIZE);
+
+			f2fs_wait_on_page_writeback(page, DATA);
+			if (!clear_page_dirty_for_io(page))
+				goto continue_unlock;
+
+			err = do_write_data_page(page, &fio);
+			if (err) {
+				set_page_dirty(page);
+				unlock_page(page);
+				break;
+			}
+			clear_cold_data(page);
+continue_unlock:
+			unlock_page(page);
+		}
+		pagevec_release(&pvec);
+	}
+	f2fs_unlock_op(sbi);
+
+	f2fs_submit_merged_bio(sbi, DATA, WRITE);
+
+	if (!err)
+		err = filemap_fdatawait(mapping);
+	return err;
+}
+
 static int f2fs_write_data_page(struct page *page,
 					struct writeback_control *wbc)
 {
@@ -827,6 +1117,14 @@ write:
 	if (unlikely(sbi->por_doing))
 		goto redirty_out;
 
+	/* Atomic writes stay in memory until they are committed */
+	if (f2fs_is_atomic_file(inode))
+		goto redirty_out;
+
+	/* and volatile data is only written back in the background */
+	if (f2fs_is_volatile_file(inode) && wbc->sync_mode == WB_SYNC_ALL)
+		goto redirty_out;
+
 	/* Dentry blocks are controlled by checkpoint */
 	if (S_ISDIR(inode->i_mode)) {
 		err = do_write_data_page(page, &fio);
@@ -892,6 +1190,13 @@ static int f2fs_write_data_pages(struct address_space *mapping,
 			available_free_memory(sbi, DIRTY_DENTS))
 		goto skip_write;
 
+	/* every page would be redirtied until the atomic write commits */
+	if (f2fs_is_atomic_file(inode)) {
+		wbc->pages_skipped +=
+			atomic_read(&F2FS_I(inode)->i_atomic_pages);
+		return 0;
+	}
+
 	diff = nr_pages_to_write(sbi, DATA, wbc);
 
 	if (!S_ISDIR(inode->i_mode)) {
@@ -928,6 +1233,11 @@ static int f2fs_write_begin(struct file *file, struct address_space *mapping,
 	trace_f2fs_write_begin(inode, pos, len, flags);
 
 	f2fs_balance_fs(sbi);
+
+	/* atomic writes are held in memory until commit, so bound them */
+	if (f2fs_is_atomic_file(inode) &&
+			!available_free_memory(sbi, ATOMIC_PAGES))
+		return -ENOMEM;
 repeat:
 	err = f2fs_convert_inline_data(inode, pos + len);
 	if (err)
@@ -1057,6 +1367,10 @@ static ssize_t f2fs_direct_IO(int rw, struct kiocb *iocb,
 	if (f2fs_has_inline_data(inode))
 		return 0;
 
+	/* Atomic writes have to go through the page cache as well */
+	if (rw == WRITE && f2fs_is_atomic_file(inode))
+		return 0;
+
 	if (check_direct_IO(inode, rw, iov, offset, nr_segs))
 		return 0;
 
@@ -1094,6 +1408,8 @@ static int f2fs_set_data_page_dirty(struct page *page)
 	if (!PageDirty(page)) {
 		__set_page_dirty_nobuffers(page);
 		set_dirty_dir_page(inode, page);
+		if (f2fs_is_atomic_file(inode))
+			inode_inc_atomic_pages(inode);
 		return 1;
 	}
 	return 0;
@@ -19,6 +19,7 @@
 #include <linux/magic.h>
 #include <linux/kobject.h>
 #include <linux/sched.h>
+#include <linux/rbtree.h>
 
 #ifdef CONFIG_F2FS_CHECK_FS
 #define f2fs_bug_on(condition)	BUG_ON(condition)
@@ -154,6 +155,13 @@ static inline int update_sits_in_cursum(struct f2fs_summary_block *rs, int i)
 #define F2FS_IOC_GETFLAGS               FS_IOC_GETFLAGS
 #define F2FS_IOC_SETFLAGS               FS_IOC_SETFLAGS
 
+#define F2FS_IOCTL_MAGIC		0xf5
+#define F2FS_IOC_START_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 1)
+#define F2FS_IOC_COMMIT_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 2)
+#define F2FS_IOC_START_VOLATILE_WRITE	_IO(F2FS_IOCTL_MAGIC, 3)
+#define F2FS_IOC_RELEASE_VOLATILE_WRITE	_IO(F2FS_IOCTL_MAGIC, 4)
+#define F2FS_IOC_ABORT_VOLATILE_WRITE	_IO(F2FS_IOCTL_MAGIC, 5)
+
 #if defined(__KERNEL__) && defined(CONFIG_COMPAT)
 /*
  * ioctl commands in 32 bit emulation
@@ -189,12 +197,30 @@ enum {
 #define F2FS_MIN_EXTENT_LEN	16	/* minimum extent length */
 
 struct extent_info {
-	rwlock_t ext_lock;	/* rwlock for consistency */
 	unsigned int fofs;	/* start offset in a file */
 	u32 blk_addr;		/* start block address of the extent */
 	unsigned int len;	/* length of the extent */
 };
 
+/*
+ * Extents other than the largest one are cached in a per-inode rb-tree,
+ * keyed by file offset. Every node is also on a global LRU list so that
+ * the shrinker can drop cold extents under memory pressure.
+ */
+struct extent_node {
+	struct rb_node rb_node;		/* rb node located in rb-tree */
+	struct list_head list;		/* node in global extent lru list */
+	struct extent_info ei;		/* extent info */
+	struct extent_tree *et;		/* extent tree this node belongs to */
+};
+
+struct extent_tree {
+	rwlock_t lock;			/* protect the tree and fi->ext */
+	struct rb_root root;		/* root of extent info rb-tree */
+	struct extent_node *cached_en;	/* recently accessed extent node */
+	unsigned int count;		/* # of extent nodes in rb-tree */
+};
+
 /*
  * i_advise uses FADVISE_XXX_BIT. We can add additional hints later.
  */
@@ -220,30 +246,37 @@ struct f2fs_inode_info {
 	unsigned int clevel;		/* maximum level of given file name */
 	nid_t i_xattr_nid;		/* node id that contains xattrs */
 	unsigned long long xattr_ver;	/* cp version of xattr modification */
-	struct extent_info ext;		/* in-memory extent cache entry */
+	struct extent_info ext;		/* largest extent, kept in i_ext */
+	struct extent_tree ext_tree;	/* cache of the other extents */
+	loff_t i_atomic_size;		/* i_size when atomic write started */
+	struct file *i_atomic_filp;	/* file that started the atomic write */
+	struct file *i_volatile_filp;	/* file that started volatile writes */
+	atomic_t i_atomic_pages;	/* # of pages held for atomic write */
 	struct dir_inode_entry *dirty_dir;	/* the pointer of dirty dir */
 };
 
-static inline void get_extent_info(struct extent_info *ext,
+static inline void get_extent_info(struct f2fs_inode_info *fi,
 					struct f2fs_extent i_ext)
 {
-	write_lock(&ext->ext_lock);
-	ext->fofs = le32_to_cpu(i_ext.fofs);
-	ext->blk_addr = le32_to_cpu(i_ext.blk_addr);
-	ext->len = le32_to_cpu(i_ext.len);
-	write_unlock(&ext->ext_lock);
+	write_lock(&fi->ext_tree.lock);
+	fi->ext.fofs = le32_to_cpu(i_ext.fofs);
+	fi->ext.blk_addr = le32_to_cpu(i_ext.blk_addr);
+	fi->ext.len = le32_to_cpu(i_ext.len);
+	write_unlock(&fi->ext_tree.lock);
 }
 
-static inline void set_raw_extent(struct extent_info *ext,
+static inline void set_raw_extent(struct f2fs_inode_info *fi,
 					struct f2fs_extent *i_ext)
 {
-	read_lock(&ext->ext_lock);
-	i_ext->fofs = cpu_to_le32(ext->fofs);
-	i_ext->blk_addr = cpu_to_le32(ext->blk_addr);
-	i_ext->len = cpu_to_le32(ext->len);
-	read_unlock(&ext->ext_lock);
+	read_lock(&fi->ext_tree.lock);
+	i_ext->fofs = cpu_to_le32(fi->ext.fofs);
+	i_ext->blk_addr = cpu_to_le32(fi->ext.blk_addr);
+	i_ext->len = cpu_to_le32(fi->ext.len);
+	read_unlock(&fi->ext_tree.lock);
 }
 
+#define FSYNC_DNODE_HASH_SIZE	64	/* # of fsync dnode hash buckets */
+
 struct f2fs_nm_info {
 	block_t nat_blkaddr;		/* base disk address of NAT */
 	nid_t max_nid;			/* maximum possible node ids */
@@ -267,6 +300,11 @@ struct f2fs_nm_info {
 	unsigned int fcnt;		/* the number of free node id */
 	struct mutex build_lock;	/* lock for build free nids */
 
+	/* dirty dnodes by inode number, for fsync */
+	struct list_head fsync_dnodes[FSYNC_DNODE_HASH_SIZE];
+	spinlock_t fsync_dnode_lock;	/* protect fsync_dnodes */
+	bool fsync_untracked;		/* a dirty dnode could not be tracked */
+
 	/* for checkpoint */
 	char *nat_bitmap;		/* NAT bitmap pointer */
 	int bitmap_size;		/* bitmap size */
@@ -384,6 +422,7 @@ enum count_type {
 	F2FS_DIRTY_DENTS,
 	F2FS_DIRTY_NODES,
 	F2FS_DIRTY_META,
+	F2FS_ATOMIC_PAGES,
 	NR_COUNT_TYPE,
 };
 
@@ -504,6 +543,10 @@ struct f2fs_sb_info {
 	unsigned int segment_count[2];		/* # of allocated segments */
 	unsigned int block_count[2];		/* # of allocated blocks */
 	int total_hit_ext, read_hit_ext;	/* extent cache hit ratio */
+	int read_hit_largest, read_hit_cached;	/* hits without a tree walk */
+	atomic_t total_ext_tree;		/* # of inodes with cached extents */
+	atomic_t total_ext_node;		/* # of cached extent nodes */
+	int shrunk_ext_node;			/* # of nodes freed by shrinker */
 	int inline_inode;			/* # of inline_data inodes */
 	int bg_gc;				/* background gc calls */
 	unsigned int n_dirty_dirs;		/* # of dir inodes */
@@ -712,6 +755,19 @@ static inline void inode_inc_dirty_dents(struct inode *inode)
 	atomic_inc(&F2FS_I(inode)->dirty_dents);
 }
 
+static inline void inode_inc_atomic_pages(struct inode *inode)
+{
+	inc_page_count(F2FS_SB(inode->i_sb), F2FS_ATOMIC_PAGES);
+	atomic_inc(&F2FS_I(inode)->i_atomic_pages);
+}
+
+static inline void inode_drop_atomic_pages(struct inode *inode)
+{
+	int nr = atomic_xchg(&F2FS_I(inode)->i_atomic_pages, 0);
+
+	atomic_sub(nr, &F2FS_SB(inode->i_sb)->nr_pages[F2FS_ATOMIC_PAGES]);
+}
+
 static inline void dec_page_count(struct f2fs_sb_info *sbi, int count_type)
 {
 	atomic_dec(&sbi->nr_pages[count_type]);
@@ -986,6 +1042,9 @@ enum {
 	FI_NO_EXTENT,		/* not to use the extent cache */
 	FI_INLINE_XATTR,	/* used for inline xattr */
 	FI_INLINE_DATA,		/* used for inline data*/
+	FI_ATOMIC_FILE,		/* hold dirty pages until atomic commit */
+	FI_ATOMIC_COMMIT,	/* committing atomic writes, no in-place update */
+	FI_VOLATILE_FILE,	/* fsync does not need to persist data */
 };
 
 static inline void set_inode_flag(struct f2fs_inode_info *fi, int flag)
@@ -1070,6 +1129,16 @@ static inline int f2fs_has_inline_data(struct inode *inode)
 	return is_inode_flag_set(F2FS_I(inode), FI_INLINE_DATA);
 }
 
+static inline bool f2fs_is_atomic_file(struct inode *inode)
+{
+	return is_inode_flag_set(F2FS_I(inode), FI_ATOMIC_FILE);
+}
+
+static inline bool f2fs_is_volatile_file(struct inode *inode)
+{
+	return is_inode_flag_set(F2FS_I(inode), FI_VOLATILE_FILE);
+}
+
 static inline void *inline_data_addr(struct page *page)
 {
 	struct f2fs_inode *ri = F2FS_INODE(page);
@@ -1176,6 +1245,8 @@ int get_dnode_of_data(struct dnode_of_data *, pgoff_t, int);
 int truncate_inode_blocks(struct inode *, pgoff_t);
 int truncate_xattr_node(struct inode *, struct page *);
 int wait_on_node_pages_writeback(struct f2fs_sb_info *, nid_t);
+int fsync_node_pages(struct f2fs_sb_info *, nid_t);
+void fsync_dnodes_flushed(struct f2fs_sb_info *);
 void remove_inode_page(struct inode *);
 struct page *new_inode_page(struct inode *);
 struct page *new_node_page(struct dnode_of_data *, unsigned int, struct page *);
@@ -1269,11 +1340,15 @@ void f2fs_submit_page_mbio(struct f2fs_sb_info *, struct page *, block_t,
 int reserve_new_block(struct dnode_of_data *);
 int f2fs_reserve_block(struct dnode_of_data *, pgoff_t);
 void update_extent_cache(block_t, struct dnode_of_data *);
+void f2fs_destroy_extent_tree(struct inode *);
 struct page *find_data_page(struct inode *, pgoff_t, bool);
 struct page *get_lock_data_page(struct inode *, pgoff_t);
 struct page *get_new_data_page(struct inode *, struct page *, pgoff_t, bool);
 int do_write_data_page(struct page *, struct f2fs_io_info *);
+int commit_atomic_pages(struct inode *);
 int f2fs_fiemap(struct inode *inode, struct fiemap_extent_info *, u64, u64);
+int __init create_extent_caches(void);
+void destroy_extent_caches(void);
 
 /*
  * gc.c
@@ -1302,7 +1377,8 @@ struct f2fs_stat_info {
 	struct mutex stat_lock;
 	int all_area_segs, sit_area_segs, nat_area_segs, ssa_area_segs;
 	int main_area_segs, main_area_sections, main_area_zones;
-	int hit_ext, total_ext;
+	int hit_ext, total_ext, hit_largest, hit_cached;
+	int ext_tree, ext_node, shrunk_ext;
 	int ndirty_node, ndirty_dent, ndirty_dirs, ndirty_meta;
 	int nats, sits, fnids;
 	int total_count, utilization;
@@ -1336,6 +1412,13 @@ static inline struct f2fs_stat_info *F2FS_STAT(struct f2fs_sb_info *sbi)
 #define stat_dec_dirty_dir(sbi)		((sbi)->n_dirty_dirs--)
 #define stat_inc_total_hit(sb)		((F2FS_SB(sb))->total_hit_ext++)
 #define stat_inc_read_hit(sb)		((F2FS_SB(sb))->read_hit_ext++)
+#define stat_inc_largest_hit(sb)	((F2FS_SB(sb))->read_hit_largest++)
+#define stat_inc_cached_hit(sb)		((F2FS_SB(sb))->read_hit_cached++)
+#define stat_inc_ext_tree(sbi)		(atomic_inc(&(sbi)->total_ext_tree))
+#define stat_dec_ext_tree(sbi)		(atomic_dec(&(sbi)->total_ext_tree))
+#define stat_inc_ext_node(sbi)		(atomic_inc(&(sbi)->total_ext_node))
+#define stat_dec_ext_node(sbi)		(atomic_dec(&(sbi)->total_ext_node))
+#define stat_inc_shrunk_ext(sbi)	((sbi)->shrunk_ext_node++)
 #define stat_inc_inline_inode(inode)					\
 	do {								\
 		if (f2fs_has_inline_data(inode))			\
@@ -1391,6 +1474,13 @@ void f2fs_destroy_root_stats(void);
 #define stat_dec_dirty_dir(sbi)
 #define stat_inc_total_hit(sb)
 #define stat_inc_read_hit(sb)
+#define stat_inc_largest_hit(sb)
+#define stat_inc_cached_hit(sb)
+#define stat_inc_ext_tree(sbi)
+#define stat_dec_ext_tree(sbi)
+#define stat_inc_ext_node(sbi)
+#define stat_dec_ext_node(sbi)
+#define stat_inc_shrunk_ext(sbi)
 #define stat_inc_inline_inode(inode)
 #define stat_dec_inline_inode(inode)
 #define stat_inc_seg_type(sbi, curseg)
@@ -125,15 +125,14 @@ int f2fs_sync_file(struct file *file, int datasync)
 	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
 	int ret = 0;
 	bool need_cp = false;
-	struct writeback_control wbc = {
-		.sync_mode = WB_SYNC_ALL,
-		.nr_to_write = LONG_MAX,
-		.for_reclaim = 0,
-	};
 
 	if (unlikely(f2fs_readonly(inode->i_sb)))
 		return 0;
 
+	/* data of a volatile file does not have to survive a power loss */
+	if (f2fs_is_volatile_file(inode))
+		return 0;
+
 	trace_f2fs_sync_file_enter(inode);
 
 	/* guarantee free sections for fsync */
@@ -179,8 +178,11 @@ int f2fs_sync_file(struct file *file, int datasync)
 			up_write(&fi->i_sem);
 		}
 	} else {
-		/* if there is no written node page, write its inode page */
-		while (!sync_node_pages(sbi, inode->i_ino, &wbc)) {
+		/*
+		 * Write only this inode's dirty dnodes, with fsync marks.
+		 * If there is no written node page, write its inode page.
+		 */
+		while (!fsync_node_pages(sbi, inode->i_ino)) {
 			if (fsync_mark_done(sbi, inode->i_ino))
 				goto out;
 			mark_inode_dirty_sync(inode);
@@ -756,6 +758,240 @@ static inline __u32 f2fs_mask_flags(umode_t mode, __u32 flags)
 		return flags & F2FS_OTHER_FLMASK;
 }
 
+/*
+ * Atomic writes: pages dirtied after F2FS_IOC_START_ATOMIC_WRITE are held
+ * in the page cache until F2FS_IOC_COMMIT_ATOMIC_WRITE writes them out of
+ * place. Roll-forward recovery applies each fsynced dnode on its own, so
+ * the commit is an fsync only if all the pages sit in one dnode and the
+ * file did not grow past it; otherwise it is a checkpoint. Either way a
+ * crash leaves all or none of the pages. F2FS_IOC_ABORT_VOLATILE_WRITE
+ * drops them instead. The atomic write belongs to the file that started
+ * it, and the held pages are bounded by available_free_memory().
+ *
+ * Volatile writes: after F2FS_IOC_START_VOLATILE_WRITE, fsync returns at
+ * once and the data is only written back in the background. This is meant
+ * for journals that are only needed if the application itself crashes.
+ *
+ * Both modes belong to the file that started them and end when that file
+ * is released; other files open on the inode do not affect them.
+ */
+static int f2fs_ioc_start_atomic_write(struct file *filp)
+{
+	struct inode *inode = file_inode(filp);
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	int ret = 0;
+
+	if (!S_ISREG(inode->i_mode))
+		return -EINVAL;
+	if (!inode_owner_or_capable(inode))
+		return -EACCES;
+
+	mutex_lock(&inode->i_mutex);
+	if (f2fs_is_atomic_file(inode)) {
+		if (fi->i_atomic_filp != filp)
+			ret = -EBUSY;
+		goto out;
+	}
+
+	ret = f2fs_convert_inline_data(inode, MAX_INLINE_DATA + 1);
+	if (ret)
+		goto out;
+
+	/* pages dirtied so far are not part of the atomic write */
+	ret = filemap_write_and_wait(inode->i_mapping);
+	if (ret)
+		goto out;
+
+	fi->i_atomic_size = i_size_read(inode);
+	fi->i_atomic_filp = filp;
+	set_inode_flag(fi, FI_ATOMIC_FILE);
+out:
+	mutex_unlock(&inode->i_mutex);
+	return ret;
+}
+
+/* whether every held page of an atomic write maps to the same dnode */
+static bool f2fs_atomic_in_one_dnode(struct inode *inode)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	struct pagevec pvec;
+	pgoff_t index = 0, dnode = 0;
+	bool first = true, ret = true;
+	int i, nr_pages;
+
+	pagevec_init(&pvec, 0);
+	while (ret && (nr_pages = pagevec_lookup_tag(&pvec, inode->i_mapping,
+				&index, PAGECACHE_TAG_DIRTY, PAGEVEC_SIZE))) {
+		for (i = 0; i < nr_pages; i++) {
+			pgoff_t this = PGOFS_OF_NEXT_DNODE(pvec.pages[i]->index,
+									fi);
+			if (first) {
+				dnode = this;
+				first = false;
+			} else if (this != dnode) {
+				ret = false;
+				break;
+			}
+		}
+		pagevec_release(&pvec);
+		cond_resched();
+	}
+
+	/* a dnode that grows the file is only visible with the inode page */
+	if (ret && !first && dnode != ADDRS_PER_INODE(fi) &&
+			i_size_read(inode) != fi->i_atomic_size)
+		ret = false;
+	return ret;
+}
+
+static int f2fs_ioc_commit_atomic_write(struct file *filp)
+{
+	struct inode *inode = file_inode(filp);
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	bool one_dnode;
+	int ret = 0;
+
+	if (!inode_owner_or_capable(inode))
+		return -EACCES;
+
+	ret = mnt_want_write(filp->f_path.mnt);
+	if (ret)
+		return ret;
+
+	mutex_lock(&inode->i_mutex);
+	if (!f2fs_is_atomic_file(inode) || fi->i_atomic_filp != filp) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	one_dnode = f2fs_atomic_in_one_dnode(inode);
+
+	set_inode_flag(fi, FI_ATOMIC_COMMIT);
+	ret = commit_atomic_pages(inode);
+
+	clear_inode_flag(fi, FI_ATOMIC_FILE);
+	fi->i_atomic_filp = NULL;
+	inode_drop_atomic_pages(inode);
+	if (ret)
+		goto commit_done;
+
+	if (one_dnode) {
+		ret = f2fs_sync_file(filp, 0);
+	} else {
+		ret = f2fs_write_inode(inode, NULL);
+		if (!ret)
+			ret = f2fs_sync_fs(inode->i_sb, 1);
+	}
+commit_done:
+	clear_inode_flag(fi, FI_ATOMIC_COMMIT);
+out:
+	mutex_unlock(&inode->i_mutex);
+	mnt_drop_write(filp->f_path.mnt);
+	return ret;
+}
+
+/* the caller holds i_mutex */
+static void f2fs_drop_atomic_write(struct inode *inode)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+
+	clear_inode_flag(fi, FI_ATOMIC_FILE);
+	fi->i_atomic_filp = NULL;
+	inode_drop_atomic_pages(inode);
+
+	/* nothing was written, so the on-disk blocks are still valid */
+	truncate_pagecache(inode, i_size_read(inode), 0);
+
+	if (i_size_read(inode) > fi->i_atomic_size) {
+		truncate_setsize(inode, fi->i_atomic_size);
+		f2fs_truncate(inode);
+		mark_inode_dirty(inode);
+	}
+}
+
+/* the caller holds i_mutex */
+static void f2fs_drop_volatile_write(struct inode *inode, struct file *filp)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+
+	if (f2fs_is_volatile_file(inode) && fi->i_volatile_filp == filp) {
+		clear_inode_flag(fi, FI_VOLATILE_FILE);
+		fi->i_volatile_filp = NULL;
+	}
+}
+
+static int f2fs_ioc_start_volatile_write(struct file *filp)
+{
+	struct inode *inode = file_inode(filp);
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	int ret = 0;
+
+	if (!S_ISREG(inode->i_mode))
+		return -EINVAL;
+	if (!inode_owner_or_capable(inode))
+		return -EACCES;
+
+	mutex_lock(&inode->i_mutex);
+	if (f2fs_is_volatile_file(inode)) {
+		if (fi->i_volatile_filp != filp)
+			ret = -EBUSY;
+		goto out;
+	}
+
+	fi->i_volatile_filp = filp;
+	set_inode_flag(fi, FI_VOLATILE_FILE);
+out:
+	mutex_unlock(&inode->i_mutex);
+	return ret;
+}
+
+static int f2fs_ioc_release_volatile_write(struct file *filp)
+{
+	struct inode *inode = file_inode(filp);
+	int ret = 0;
+
+	if (!inode_owner_or_capable(inode))
+		return -EACCES;
+
+	mutex_lock(&inode->i_mutex);
+	if (f2fs_is_volatile_file(inode) &&
+	    F2FS_I(inode)->i_volatile_filp != filp)
+		ret = -EINVAL;
+	else
+		f2fs_drop_volatile_write(inode, filp);
+	mutex_unlock(&inode->i_mutex);
+	return ret;
+}
+
+static int f2fs_ioc_abort_volatile_write(struct file *filp)
+{
+	struct inode *inode = file_inode(filp);
+
+	if (!inode_owner_or_capable(inode))
+		return -EACCES;
+
+	mutex_lock(&inode->i_mutex);
+	if (f2fs_is_atomic_file(inode) && F2FS_I(inode)->i_atomic_filp == filp)
+		f2fs_drop_atomic_write(inode);
+	f2fs_drop_volatile_write(inode, filp);
+	mutex_unlock(&inode->i_mutex);
+	return 0;
+}
+
+static int f2fs_release_file(struct inode *inode, struct file *filp)
+{
+	if (!f2fs_is_atomic_file(inode) && !f2fs_is_volatile_file(inode))
+		return 0;
+
+	mutex_lock(&inode->i_mutex);
+	/* other files may be open while the owner is in either mode */
+	if (f2fs_is_atomic_file(inode) && F2FS_I(inode)->i_atomic_filp == filp)
+		f2fs_drop_atomic_write(inode);
+	f2fs_drop_volatile_write(inode, filp);
+	mutex_unlock(&inode->i_mutex);
+	return 0;
+}
+
 long f2fs_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	struct inode *inode = file_inode(filp);
@@ -811,6 +1047,16 @@ out:
 		mnt_drop_write(filp->f_path.mnt);
 		return ret;
 	}
+	case F2FS_IOC_START_ATOMIC_WRITE:
+		return f2fs_ioc_start_atomic_write(filp);
+	case F2FS_IOC_COMMIT_ATOMIC_WRITE:
+		return f2fs_ioc_commit_atomic_write(filp);
+	case F2FS_IOC_START_VOLATILE_WRITE:
+		return f2fs_ioc_start_volatile_write(filp);
+	case F2FS_IOC_RELEASE_VOLATILE_WRITE:
+		return f2fs_ioc_release_volatile_write(filp);
+	case F2FS_IOC_ABORT_VOLATILE_WRITE:
+		return f2fs_ioc_abort_volatile_write(filp);
 	default:
 		return -ENOTTY;
 	}
@@ -826,6 +1072,12 @@ long f2fs_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case F2FS_IOC32_SETFLAGS:
 		cmd = F2FS_IOC_SETFLAGS;
 		break;
+	case F2FS_IOC_START_ATOMIC_WRITE:
+	case F2FS_IOC_COMMIT_ATOMIC_WRITE:
+	case F2FS_IOC_START_VOLATILE_WRITE:
+	case F2FS_IOC_RELEASE_VOLATILE_WRITE:
+	case F2FS_IOC_ABORT_VOLATILE_WRITE:
+		break;
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -840,6 +1092,7 @@ const struct file_operations f2fs_file_operations = {
 	.aio_read	= generic_file_aio_read,
 	.aio_write	= generic_file_aio_write,
 	.open		= generic_file_open,
+	.release	= f2fs_release_file,
 	.mmap		= f2fs_file_mmap,
 	.fsync		= f2fs_sync_file,
 	.fallocate	= f2fs_fallocate,
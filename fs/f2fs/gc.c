@@ -26,12 +26,50 @@
 
 static struct kmem_cache *winode_slab;
 
+/*
+ * Sleep for wait_ms. idle_time() only sees that some I/O completed since
+ * its last call, so a single long sleep would make any I/O during it look
+ * like it just happened. While there is enough to clean, wake up every
+ * idle window to sample the device. Otherwise take the whole sleep at once,
+ * so that a quiet system is not woken every window, and count idleness
+ * from the wakeup.
+ */
+static void gc_sleep(struct f2fs_sb_info *sbi, long wait_ms)
+{
+	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
+	wait_queue_head_t *wq = &gc_th->gc_wait_queue_head;
+	unsigned long end = jiffies + msecs_to_jiffies(wait_ms);
+	long sleep_ms;
+	bool poll;
+
+	for (;;) {
+		poll = gc_th->idle_window && has_enough_invalid_blocks(sbi);
+		sleep_ms = wait_ms;
+		if (poll)
+			sleep_ms = min_t(long, sleep_ms, gc_th->idle_window);
+		wait_event_interruptible_timeout(*wq, kthread_should_stop(),
+						msecs_to_jiffies(sleep_ms));
+		if (kthread_should_stop() || freezing(current))
+			return;
+
+		if (!poll) {
+			gc_th->last_ios = completed_ios(sbi);
+			gc_th->idle_since = jiffies;
+			return;
+		}
+
+		idle_time(sbi);
+		if (!time_before(jiffies, end))
+			return;
+		wait_ms = jiffies_to_msecs(end - jiffies);
+	}
+}
+
 static int gc_thread_func(void *data)
 {
 	struct f2fs_sb_info *sbi = data;
 	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
-	wait_queue_head_t *wq = &sbi->gc_thread->gc_wait_queue_head;
-	long wait_ms;
+	long wait_ms, idle_ms;
 
 	wait_ms = gc_th->min_sleep_time;
 
@@ -39,9 +77,7 @@ static int gc_thread_func(void *data)
 		if (try_to_freeze())
 			continue;
 		else
-			wait_event_interruptible_timeout(*wq,
-						kthread_should_stop(),
-						msecs_to_jiffies(wait_ms));
+			gc_sleep(sbi, wait_ms);
 		if (kthread_should_stop())
 			break;
 
@@ -54,20 +90,26 @@ static int gc_thread_func(void *data)
 		 * [GC triggering condition]
 		 * 0. GC is not conducted currently.
 		 * 1. There are enough dirty segments.
-		 * 2. IO subsystem is idle by checking the # of writeback pages.
-		 * 3. IO subsystem is idle by checking the # of requests in
+		 * 2. IO subsystem is idle by checking the # of requests in
 		 *    bdev's request list.
+		 * 3. The device has completed no I/O for idle_window ms.
 		 *
 		 * Note) We have to avoid triggering GCs too much frequently.
 		 * Because it is possible that some segments can be
 		 * invalidated soon after by user update or deletion.
 		 * So, I'd like to wait some time to collect dirty segments.
+		 * Once there is enough to clean, though, the device is polled
+		 * every idle window so that idle time is not wasted.
 		 */
 		if (!mutex_trylock(&sbi->gc_mutex))
 			continue;
 
-		if (!is_idle(sbi)) {
-			wait_ms = increase_sleep_time(gc_th, wait_ms);
+		idle_ms = idle_time(sbi);
+		if (idle_ms < 0 || idle_ms < gc_th->idle_window) {
+			if (gc_th->idle_window && has_enough_invalid_blocks(sbi))
+				wait_ms = gc_th->idle_window - max(idle_ms, 0L);
+			else
+				wait_ms = increase_sleep_time(gc_th, wait_ms);
 			mutex_unlock(&sbi->gc_mutex);
 			continue;
 		}
@@ -82,6 +124,16 @@ static int gc_thread_func(void *data)
 		/* if return value is not zero, no victim was selected */
 		if (f2fs_gc(sbi))
 			wait_ms = gc_th->no_gc_sleep_time;
+		else if (gc_th->idle_window && has_enough_invalid_blocks(sbi))
+			wait_ms = gc_th->idle_window;
+
+		/*
+		 * The reads done by gc itself do not make the device busy.
+		 * Its writes only dirty pages here; they reach the device
+		 * later through writeback and count as activity, so the next
+		 * round waits for another idle window after they complete.
+		 */
+		gc_th->last_ios = completed_ios(sbi);
 
 		/* balancing f2fs's metadata periodically */
 		f2fs_balance_fs_bg(sbi);
@@ -110,6 +162,10 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 
 	gc_th->gc_idle = 0;
 
+	gc_th->idle_window = DEF_GC_THREAD_IDLE_WINDOW;
+	gc_th->last_ios = 0;
+	gc_th->idle_since = jiffies;
+
 	sbi->gc_thread = gc_th;
 	init_waitqueue_head(&sbi->gc_thread->gc_wait_queue_head);
 	sbi->gc_thread->f2fs_gc_task = kthread_run(gc_thread_func, sbi,
@@ -250,6 +306,56 @@ static inline unsigned int get_gc_cost(struct f2fs_sb_info *sbi,
 		return get_cb_cost(sbi, segno);
 }
 
+/*
+ * Dirty sections are kept in buckets by their number of valid blocks (see
+ * __update_victim_index), so LFS victims are looked up from the cheapest
+ * bucket up instead of by scanning the whole dirty segmap. Greedy stops at
+ * the first bucket that has a usable section; cost-benefit looks at a few
+ * more, since an older section with more valid blocks may still win.
+ */
+static void lookup_victim_index(struct f2fs_sb_info *sbi, int gc_type,
+						struct victim_sel_policy *p)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int nr_buckets = (p->gc_mode == GC_GREEDY) ? 1 : GC_CB_BUCKETS;
+	unsigned int secno;
+	int nsearched = 0;
+	int i;
+
+	for (i = 0; i < NR_VICTIM_BUCKETS; i++) {
+		unsigned long *bucket = dirty_i->victim_bucket[i];
+
+		if (!dirty_i->nr_bucket[i])
+			continue;
+
+		for (secno = find_first_bit(bucket, TOTAL_SECS(sbi));
+				secno < TOTAL_SECS(sbi);
+				secno = find_next_bit(bucket, TOTAL_SECS(sbi),
+								secno + 1)) {
+			unsigned int segno = secno * sbi->segs_per_sec;
+			unsigned long cost;
+
+			if (sec_usage_check(sbi, secno))
+				continue;
+			if (gc_type == BG_GC &&
+					test_bit(secno, dirty_i->victim_secmap))
+				continue;
+
+			cost = get_gc_cost(sbi, segno, p);
+			if (p->min_cost > cost) {
+				p->min_segno = segno;
+				p->min_cost = cost;
+			}
+
+			if (++nsearched >= p->max_search)
+				return;
+		}
+
+		if (p->min_segno != NULL_SEGNO && !--nr_buckets)
+			return;
+	}
+}
+
 /*
  * This function is called from two paths.
  * One is garbage collection and the other is SSR segment selection.
@@ -280,6 +386,11 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			goto got_it;
 	}
 
+	if (p.alloc_mode == LFS) {
+		lookup_victim_index(sbi, gc_type, &p);
+		goto search_done;
+	}
+
 	while (1) {
 		unsigned long cost;
 		unsigned int segno;
@@ -320,6 +431,7 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			break;
 		}
 	}
+search_done:
 	if (p.min_segno != NULL_SEGNO) {
 got_it:
 		if (p.alloc_mode == LFS) {
@@ -531,6 +643,10 @@ static void move_data_page(struct inode *inode, struct page *page, int gc_type)
 		set_page_dirty(page);
 		set_cold_data(page);
 	} else {
+		/* a dirty page of an atomic file holds uncommitted data */
+		if (f2fs_is_atomic_file(inode) && PageDirty(page))
+			goto out;
+
 		f2fs_wait_on_page_writeback(page, DATA);
 
 		if (clear_page_dirty_for_io(page))
@@ -16,12 +16,16 @@
 #define DEF_GC_THREAD_MIN_SLEEP_TIME	30000	/* milliseconds */
 #define DEF_GC_THREAD_MAX_SLEEP_TIME	60000
 #define DEF_GC_THREAD_NOGC_SLEEP_TIME	300000	/* wait 5 min */
+#define DEF_GC_THREAD_IDLE_WINDOW	1000	/* milliseconds without I/O */
 #define LIMIT_INVALID_BLOCK	40 /* percentage over total user space */
 #define LIMIT_FREE_BLOCK	40 /* percentage over invalid + free space */
 
 /* Search max. number of dirty segments to select a victim segment */
 #define DEF_MAX_VICTIM_SEARCH 4096 /* covers 8GB */
 
+/* # of victim index buckets cost-benefit GC looks at after the first hit */
+#define GC_CB_BUCKETS		4
+
 struct f2fs_gc_kthread {
 	struct task_struct *f2fs_gc_task;
 	wait_queue_head_t gc_wait_queue_head;
@@ -33,6 +37,11 @@ struct f2fs_gc_kthread {
 
 	/* for changing gc mode */
 	unsigned int gc_idle;
+
+	/* for triggering gc when the device is idle */
+	unsigned int idle_window;	/* ms without I/O before gc runs */
+	unsigned long last_ios;		/* completed I/Os at the last check */
+	unsigned long idle_since;	/* jiffies when I/O was last seen */
 };
 
 struct inode_entry {
@@ -108,3 +117,34 @@ static inline int is_idle(struct f2fs_sb_info *sbi)
 	struct request_list *rl = &q->rq;
 	return !(rl->count[BLK_RW_SYNC]) && !(rl->count[BLK_RW_ASYNC]);
 }
+
+static inline unsigned long completed_ios(struct f2fs_sb_info *sbi)
+{
+	struct hd_struct *part = sbi->sb->s_bdev->bd_part;
+
+	return part_stat_read(part, ios[READ]) +
+		part_stat_read(part, ios[WRITE]);
+}
+
+/*
+ * Returns how long the device has been idle in milliseconds, or -1 if it
+ * has I/O in flight. Any I/O completed since the last call counts as
+ * activity, so this has to be called at least once per idle window.
+ */
+static inline long idle_time(struct f2fs_sb_info *sbi)
+{
+	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
+	unsigned long ios = completed_ios(sbi);
+
+	if (!is_idle(sbi) || part_in_flight(sbi->sb->s_bdev->bd_part)) {
+		gc_th->last_ios = ios;
+		gc_th->idle_since = jiffies;
+		return -1;
+	}
+
+	if (ios != gc_th->last_ios) {
+		gc_th->last_ios = ios;
+		gc_th->idle_since = jiffies;
+	}
+	return jiffies_to_msecs(jiffies - gc_th->idle_since);
+}
@@ -26,6 +26,7 @@
 static struct kmem_cache *nat_entry_slab;
 static struct kmem_cache *free_nid_slab;
 static struct kmem_cache *nat_entry_set_slab;
+static struct kmem_cache *fsync_dnode_slab;
 
 bool available_free_memory(struct f2fs_sb_info *sbi, int type)
 {
@@ -45,10 +46,71 @@ bool available_free_memory(struct f2fs_sb_info *sbi, int type)
 	} else if (type == DIRTY_DENTS) {
 		mem_size = get_pages(sbi, F2FS_DIRTY_DENTS);
 		res = mem_size < ((val.totalram * nm_i->ram_thresh / 100) >> 1);
+	} else if (type == ATOMIC_PAGES) {
+		mem_size = get_pages(sbi, F2FS_ATOMIC_PAGES);
+		res = mem_size < ((val.totalram * nm_i->ram_thresh / 100) >> 2);
 	}
 	return res;
 }
 
+/*
+ * Dirty dnodes are hashed by inode number, so that fsync can find the
+ * dnodes of one file without looking at every dirty node page. Entries are
+ * added when a dnode becomes dirty and dropped when it is cleaned. If an
+ * entry cannot be allocated, fsync scans the node mapping as before until
+ * the next checkpoint has written every dirty node.
+ */
+static void track_fsync_dnode(struct f2fs_sb_info *sbi, struct page *page)
+{
+	struct f2fs_nm_info *nm_i = NM_I(sbi);
+	struct fsync_dnode_entry *e;
+	nid_t ino = ino_of_node(page);
+
+	if (!IS_DNODE(page))
+		return;
+
+	e = kmem_cache_alloc(fsync_dnode_slab, GFP_ATOMIC);
+
+	spin_lock(&nm_i->fsync_dnode_lock);
+	if (unlikely(!e)) {
+		nm_i->fsync_untracked = true;
+	} else {
+		e->ino = ino;
+		e->nid = page->index;
+		list_add_tail(&e->list, &nm_i->fsync_dnodes[FSYNC_DNODE_HASH(ino)]);
+	}
+	spin_unlock(&nm_i->fsync_dnode_lock);
+
+	set_page_private(page, (unsigned long)e);
+}
+
+static void untrack_fsync_dnode(struct f2fs_sb_info *sbi, struct page *page)
+{
+	struct f2fs_nm_info *nm_i = NM_I(sbi);
+	struct fsync_dnode_entry *e;
+
+	e = (struct fsync_dnode_entry *)page_private(page);
+	if (!e)
+		return;
+
+	spin_lock(&nm_i->fsync_dnode_lock);
+	list_del(&e->list);
+	spin_unlock(&nm_i->fsync_dnode_lock);
+
+	set_page_private(page, 0);
+	kmem_cache_free(fsync_dnode_slab, e);
+}
+
+/* called by checkpoint once there are no dirty node pages left */
+void fsync_dnodes_flushed(struct f2fs_sb_info *sbi)
+{
+	struct f2fs_nm_info *nm_i = NM_I(sbi);
+
+	spin_lock(&nm_i->fsync_dnode_lock);
+	nm_i->fsync_untracked = false;
+	spin_unlock(&nm_i->fsync_dnode_lock);
+}
+
 static void clear_node_page_dirty(struct page *page)
 {
 	struct address_space *mapping = page->mapping;
@@ -64,6 +126,7 @@ static void clear_node_page_dirty(struct page *page)
 
 		clear_page_dirty_for_io(page);
 		dec_page_count(sbi, F2FS_DIRTY_NODES);
+		untrack_fsync_dnode(sbi, page);
 	}
 	ClearPageUptodate(page);
 }
@@ -1194,6 +1257,107 @@ int wait_on_node_pages_writeback(struct f2fs_sb_info *sbi, nid_t ino)
 	return ret;
 }
 
+static bool fsync_one_dnode(struct f2fs_sb_info *sbi, nid_t ino, nid_t nid,
+				struct writeback_control *wbc)
+{
+	struct page *page;
+
+	page = find_get_page(NODE_MAPPING(sbi), nid);
+	if (!page)
+		return false;
+
+	lock_page(page);
+	if (unlikely(page->mapping != NODE_MAPPING(sbi)))
+		goto out;
+
+	if (!PageDirty(page) || !clear_page_dirty_for_io(page)) {
+		/* someone wrote it for us */
+		untrack_fsync_dnode(sbi, page);
+		goto out;
+	}
+
+	set_fsync_mark(page, 1);
+	if (IS_INODE(page))
+		set_dentry_mark(page, !is_checkpointed_node(sbi, ino));
+	NODE_MAPPING(sbi)->a_ops->writepage(page, wbc);
+	page_cache_release(page);
+	return true;
+out:
+	unlock_page(page);
+	page_cache_release(page);
+	return false;
+}
+
+/*
+ * Like sync_node_pages() for one inode, but only the file's own dnodes are
+ * looked at: write them with fsync marks, starting with the inode page,
+ * and return how many were written. The caller still has to wait with
+ * wait_on_node_pages_writeback(), which also covers dnodes that were
+ * already under writeback.
+ */
+int fsync_node_pages(struct f2fs_sb_info *sbi, nid_t ino)
+{
+	struct f2fs_nm_info *nm_i = NM_I(sbi);
+	struct list_head *head = &nm_i->fsync_dnodes[FSYNC_DNODE_HASH(ino)];
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_ALL,
+		.nr_to_write = LONG_MAX,
+		.for_reclaim = 0,
+	};
+	struct fsync_dnode_entry *e;
+	nid_t nids[PAGEVEC_SIZE];
+	int budget = 0, nwritten = 0;
+	bool untracked, inode_dirty = false;
+	int i, nr;
+
+	spin_lock(&nm_i->fsync_dnode_lock);
+	untracked = nm_i->fsync_untracked;
+	list_for_each_entry(e, head, list) {
+		if (e->ino != ino)
+			continue;
+		if (e->nid == ino)
+			inode_dirty = true;
+		budget++;
+	}
+	spin_unlock(&nm_i->fsync_dnode_lock);
+
+	if (untracked)
+		return sync_node_pages(sbi, ino, &wbc);
+
+	/* recovery has to see the inode before the rest of its dnodes */
+	if (inode_dirty) {
+		if (fsync_one_dnode(sbi, ino, ino, &wbc))
+			nwritten++;
+		budget--;
+	}
+
+	/* entries are dropped as their pages are written, so rescan */
+	while (budget > 0) {
+		nr = 0;
+		spin_lock(&nm_i->fsync_dnode_lock);
+		list_for_each_entry(e, head, list) {
+			if (e->ino != ino)
+				continue;
+			nids[nr++] = e->nid;
+			if (nr == min_t(int, budget, PAGEVEC_SIZE))
+				break;
+		}
+		spin_unlock(&nm_i->fsync_dnode_lock);
+		if (!nr)
+			break;
+
+		for (i = 0; i < nr; i++)
+			if (fsync_one_dnode(sbi, ino, nids[i], &wbc))
+				nwritten++;
+		budget -= nr;
+		cond_resched();
+	}
+
+	if (nwritten)
+		f2fs_submit_merged_bio(sbi, NODE, WRITE);
+	return nwritten;
+}
+
 static int f2fs_write_node_page(struct page *page,
 				struct writeback_control *wbc)
 {
@@ -1222,6 +1386,7 @@ static int f2fs_write_node_page(struct page *page,
 	/* This page is already truncated */
 	if (unlikely(ni.blk_addr == NULL_ADDR)) {
 		dec_page_count(sbi, F2FS_DIRTY_NODES);
+		untrack_fsync_dnode(sbi, page);
 		unlock_page(page);
 		return 0;
 	}
@@ -1234,6 +1399,7 @@ static int f2fs_write_node_page(struct page *page,
 	write_node_page(sbi, page, &fio, nid, ni.blk_addr, &new_addr);
 	set_node_addr(sbi, &ni, new_addr, is_fsync_dnode(page));
 	dec_page_count(sbi, F2FS_DIRTY_NODES);
+	untrack_fsync_dnode(sbi, page);
 	mutex_unlock(&sbi->node_write);
 	unlock_page(page);
 	return 0;
@@ -1281,6 +1447,8 @@ static int f2fs_set_node_page_dirty(struct page *page)
 		__set_page_dirty_nobuffers(page);
 		inc_page_count(sbi, F2FS_DIRTY_NODES);
 		SetPagePrivate(page);
+		untrack_fsync_dnode(sbi, page);
+		track_fsync_dnode(sbi, page);
 		return 1;
 	}
 	return 0;
@@ -1292,11 +1460,13 @@ static void f2fs_invalidate_node_page(struct page *page, unsigned long offset)
 	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
 	if (PageDirty(page))
 		dec_page_count(sbi, F2FS_DIRTY_NODES);
+	untrack_fsync_dnode(sbi, page);
 	ClearPagePrivate(page);
 }
 
 static int f2fs_release_node_page(struct page *page, gfp_t wait)
 {
+	untrack_fsync_dnode(F2FS_SB(page->mapping->host->i_sb), page);
 	ClearPagePrivate(page);
 	return 1;
 }
@@ -1956,6 +2126,7 @@ static int init_node_manager(struct f2fs_sb_info *sbi)
 	struct f2fs_nm_info *nm_i = NM_I(sbi);
 	unsigned char *version_bitmap;
 	unsigned int nat_segs, nat_blocks;
+	int i;
 
 	nm_i->nat_blkaddr = le32_to_cpu(sb_raw->nat_blkaddr);
 
@@ -1978,6 +2149,11 @@ static int init_node_manager(struct f2fs_sb_info *sbi)
 	INIT_LIST_HEAD(&nm_i->dirty_nat_entries);
 	INIT_LIST_HEAD(&nm_i->nat_entry_set);
 
+	for (i = 0; i < FSYNC_DNODE_HASH_SIZE; i++)
+		INIT_LIST_HEAD(&nm_i->fsync_dnodes[i]);
+	spin_lock_init(&nm_i->fsync_dnode_lock);
+	nm_i->fsync_untracked = false;
+
 	mutex_init(&nm_i->build_lock);
 	spin_lock_init(&nm_i->free_nid_list_lock);
 	rwlock_init(&nm_i->nat_tree_lock);
@@ -2068,8 +2244,15 @@ int __init create_node_manager_caches(void)
 			sizeof(struct nat_entry_set));
 	if (!nat_entry_set_slab)
 		goto destory_free_nid;
+
+	fsync_dnode_slab = f2fs_kmem_cache_create("f2fs_fsync_dnode",
+			sizeof(struct fsync_dnode_entry));
+	if (!fsync_dnode_slab)
+		goto destory_nat_entry_set;
 	return 0;
 
+destory_nat_entry_set:
+	kmem_cache_destroy(nat_entry_set_slab);
 destory_free_nid:
 	kmem_cache_destroy(free_nid_slab);
 destory_nat_entry:
@@ -2080,6 +2263,7 @@ fail:
 
 void destroy_node_manager_caches(void)
 {
+	kmem_cache_destroy(fsync_dnode_slab);
 	kmem_cache_destroy(nat_entry_set_slab);
 	kmem_cache_destroy(free_nid_slab);
 	kmem_cache_destroy(nat_entry_slab);
@@ -86,7 +86,8 @@ static inline void raw_nat_from_node_info(struct f2fs_nat_entry *raw_ne,
 enum mem_type {
 	FREE_NIDS,	/* indicates the free nid list */
 	NAT_ENTRIES,	/* indicates the cached nat entry */
-	DIRTY_DENTS	/* indicates dirty dentry pages */
+	DIRTY_DENTS,	/* indicates dirty dentry pages */
+	ATOMIC_PAGES	/* indicates pages held by atomic writes */
 };
 
 struct nat_entry_set {
@@ -110,6 +111,18 @@ struct free_nid {
 	int state;		/* in use or not: NID_NEW or NID_ALLOC */
 };
 
+/*
+ * For dirty dnode tracking: a dirty dnode page points to its entry
+ * through page->private.
+ */
+struct fsync_dnode_entry {
+	struct list_head list;	/* in fsync_dnodes[] of f2fs_nm_info */
+	nid_t ino;		/* inode number of the dnode */
+	nid_t nid;		/* node id of the dnode */
+};
+
+#define FSYNC_DNODE_HASH(ino)	((ino) & (FSYNC_DNODE_HASH_SIZE - 1))
+
 static inline int next_free_nid(struct f2fs_sb_info *sbi, nid_t *nid)
 {
 	struct f2fs_nm_info *nm_i = NM_I(sbi);
@@ -322,6 +322,46 @@ void destroy_flush_cmd_control(struct f2fs_sb_info *sbi)
 	sbi->sm_info->cmd_control_info = NULL;
 }
 
+static unsigned int victim_bucket(struct f2fs_sb_info *sbi,
+						unsigned int valid_blocks)
+{
+	unsigned int bucket = (valid_blocks * NR_VICTIM_BUCKETS) /
+				(sbi->blocks_per_seg * sbi->segs_per_sec);
+
+	return min_t(unsigned int, bucket, NR_VICTIM_BUCKETS - 1);
+}
+
+/*
+ * Move the section of segno to the bucket that matches its valid blocks,
+ * or take it out of the index when none of its segments is dirty.
+ */
+static void __update_victim_index(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int secno = GET_SECNO(sbi, segno);
+	unsigned int start = secno * sbi->segs_per_sec;
+	unsigned int end = start + sbi->segs_per_sec;
+	unsigned int old = dirty_i->sec_bucket[secno];
+	unsigned int new = NO_VICTIM_BUCKET;
+
+	if (find_next_bit(dirty_i->dirty_segmap[DIRTY], end, start) < end)
+		new = victim_bucket(sbi, get_valid_blocks(sbi, start,
+							sbi->segs_per_sec));
+	if (new == old)
+		return;
+
+	if (old != NO_VICTIM_BUCKET) {
+		clear_bit(secno, dirty_i->victim_bucket[old]);
+		dirty_i->nr_bucket[old]--;
+	}
+	if (new != NO_VICTIM_BUCKET) {
+		set_bit(secno, dirty_i->victim_bucket[new]);
+		dirty_i->nr_bucket[new]++;
+	}
+	dirty_i->sec_bucket[secno] = new;
+}
+
 static void __locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 		enum dirty_type dirty_type)
 {
@@ -340,6 +380,8 @@ static void __locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 
 		if (!test_and_set_bit(segno, dirty_i->dirty_segmap[t]))
 			dirty_i->nr_dirty[t]++;
+
+		__update_victim_index(sbi, segno);
 	}
 }
 
@@ -361,6 +403,8 @@ static void __remove_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 		if (get_valid_blocks(sbi, segno, sbi->segs_per_sec) == 0)
 			clear_bit(GET_SECNO(sbi, segno),
 						dirty_i->victim_secmap);
+
+		__update_victim_index(sbi, segno);
 	}
 }
 
@@ -1846,10 +1890,30 @@ static int init_victim_secmap(struct f2fs_sb_info *sbi)
 	return 0;
 }
 
+static int init_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int bitmap_size = f2fs_bitmap_size(TOTAL_SECS(sbi));
+	int i;
+
+	for (i = 0; i < NR_VICTIM_BUCKETS; i++) {
+		dirty_i->victim_bucket[i] = kzalloc(bitmap_size, GFP_KERNEL);
+		if (!dirty_i->victim_bucket[i])
+			return -ENOMEM;
+	}
+
+	dirty_i->sec_bucket = vmalloc(TOTAL_SECS(sbi));
+	if (!dirty_i->sec_bucket)
+		return -ENOMEM;
+	memset(dirty_i->sec_bucket, NO_VICTIM_BUCKET, TOTAL_SECS(sbi));
+	return 0;
+}
+
 static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i;
 	unsigned int bitmap_size, i;
+	int err;
 
 	/* allocate memory for dirty segments list information */
 	dirty_i = kzalloc(sizeof(struct dirty_seglist_info), GFP_KERNEL);
@@ -1867,6 +1931,10 @@ static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 			return -ENOMEM;
 	}
 
+	err = init_victim_index(sbi);
+	if (err)
+		return err;
+
 	init_dirty_segmap(sbi);
 	return init_victim_secmap(sbi);
 }
@@ -1973,6 +2041,16 @@ static void destroy_victim_secmap(struct f2fs_sb_info *sbi)
 	kfree(dirty_i->victim_secmap);
 }
 
+static void destroy_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	int i;
+
+	for (i = 0; i < NR_VICTIM_BUCKETS; i++)
+		kfree(dirty_i->victim_bucket[i]);
+	vfree(dirty_i->sec_bucket);
+}
+
 static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
@@ -1986,6 +2064,7 @@ static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
 		discard_dirty_segmap(sbi, i);
 
 	destroy_victim_secmap(sbi);
+	destroy_victim_index(sbi);
 	SM_I(sbi)->dirty_info = NULL;
 	kfree(dirty_i);
 }
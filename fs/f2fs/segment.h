@@ -212,12 +212,22 @@ enum dirty_type {
 	NR_DIRTY_TYPE
 };
 
+/*
+ * Sections with dirty segments are also indexed by their number of valid
+ * blocks, so that GC can look at the cheapest victims first.
+ */
+#define NR_VICTIM_BUCKETS	32
+#define NO_VICTIM_BUCKET	0xff
+
 struct dirty_seglist_info {
 	const struct victim_selection *v_ops;	/* victim selction operation */
 	unsigned long *dirty_segmap[NR_DIRTY_TYPE];
 	struct mutex seglist_lock;		/* lock for segment bitmaps */
 	int nr_dirty[NR_DIRTY_TYPE];		/* # of dirty segments */
 	unsigned long *victim_secmap;		/* background GC victims */
+	unsigned long *victim_bucket[NR_VICTIM_BUCKETS];	/* by vblocks */
+	unsigned int nr_bucket[NR_VICTIM_BUCKETS];	/* # of sections */
+	unsigned char *sec_bucket;		/* bucket of each section */
 };
 
 /* victim selection function for cleaning and SSR */
@@ -26,27 +26,28 @@
 struct squashfs_decompressor {
 	void	*(*init)(struct squashfs_sb_info *, void *, int);
 	void	(*free)(void *);
-	int	(*decompress)(struct squashfs_sb_info *, void **,
+	int	(*decompress)(struct squashfs_sb_info *, void *, void **,
 		struct buffer_head **, int, int, int, int, int);
 	int	id;
 	char	*name;
 	int	supported;
 };
 
-static inline void squashfs_decompressor_free(struct squashfs_sb_info *msblk,
-	void *s)
-{
-	if (msblk->decompressor)
-		msblk->decompressor->free(s);
-}
+/*
+ * How readers share decompressor streams, chosen with the threads= mount
+ * option.  The default comes from the kernel configuration.
+ */
+#define SQUASHFS_DECOMP_SINGLE	0	/* one stream, readers take turns */
+#define SQUASHFS_DECOMP_MULTI	1	/* pool of up to 2 streams per cpu */
+#define SQUASHFS_DECOMP_PERCPU	2	/* one stream per cpu */
 
-static inline int squashfs_decompress(struct squashfs_sb_info *msblk,
-	void **buffer, struct buffer_head **bh, int b, int offset, int length,
-	int srclength, int pages)
-{
-	return msblk->decompressor->decompress(msblk, buffer, bh, b, offset,
-		length, srclength, pages);
-}
+#if defined(CONFIG_SQUASHFS_DECOMP_MULTI)
+#define SQUASHFS_DECOMP_DEFAULT	SQUASHFS_DECOMP_MULTI
+#elif defined(CONFIG_SQUASHFS_DECOMP_MULTI_PERCPU)
+#define SQUASHFS_DECOMP_DEFAULT	SQUASHFS_DECOMP_PERCPU
+#else
+#define SQUASHFS_DECOMP_DEFAULT	SQUASHFS_DECOMP_SINGLE
+#endif
 
 #ifdef CONFIG_SQUASHFS_XZ
 extern const struct squashfs_decompressor squashfs_xz_comp_ops;
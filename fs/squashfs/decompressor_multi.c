@@ -0,0 +1,265 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * decompressor_multi.c
+ */
+
+#include <linux/types.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/buffer_head.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "decompressor.h"
+#include "squashfs.h"
+
+/*
+ * This file shares decompressor streams between concurrent readers.
+ *
+ * In the single and multi modes idle streams are kept on a free list.  A
+ * reader takes one, or allocates a new one if the pool has not reached its
+ * limit, or else sleeps until one is returned.  The single mode limits the
+ * pool to one stream, which serialises decompression as Squashfs always
+ * has.  The multi mode allows two streams per online cpu.
+ *
+ * In the percpu mode every possible cpu gets a stream at mount time.  A
+ * reader may sleep in the decompressor waiting for its buffers, and may be
+ * migrated meanwhile, so each stream still has a mutex, which is
+ * uncontended unless that happens.
+ */
+
+struct decomp_stream {
+	void			*stream;
+	struct list_head	list;
+};
+
+struct percpu_stream {
+	void			*stream;
+	struct mutex		mutex;
+};
+
+struct squashfs_stream {
+	int			mode;
+	void			*comp_opts;
+	int			comp_opts_len;
+	/* single and multi modes */
+	struct mutex		mutex;
+	struct list_head	free;
+	wait_queue_head_t	wait;
+	int			avail;
+	int			max;
+	/* percpu mode */
+	struct percpu_stream __percpu *percpu;
+};
+
+
+static struct decomp_stream *alloc_decomp_stream(struct squashfs_sb_info *msblk,
+	struct squashfs_stream *s)
+{
+	struct decomp_stream *ds;
+	void *strm;
+
+	ds = kmalloc(sizeof(*ds), GFP_KERNEL);
+	if (ds == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	strm = msblk->decompressor->init(msblk, s->comp_opts,
+		s->comp_opts_len);
+	if (IS_ERR(strm)) {
+		kfree(ds);
+		return strm;
+	}
+
+	ds->stream = strm;
+	return ds;
+}
+
+
+static struct decomp_stream *get_decomp_stream(struct squashfs_sb_info *msblk,
+	struct squashfs_stream *s)
+{
+	struct decomp_stream *ds;
+
+	while (1) {
+		mutex_lock(&s->mutex);
+
+		if (!list_empty(&s->free)) {
+			ds = list_entry(s->free.next, struct decomp_stream,
+				list);
+			list_del(&ds->list);
+			mutex_unlock(&s->mutex);
+			return ds;
+		}
+
+		if (s->avail < s->max) {
+			/* claim the slot, then allocate without the lock */
+			s->avail++;
+			mutex_unlock(&s->mutex);
+
+			ds = alloc_decomp_stream(msblk, s);
+			if (!IS_ERR(ds))
+				return ds;
+
+			/*
+			 * Out of memory.  The stream allocated at mount time
+			 * is still around, so wait for it or another one.
+			 */
+			mutex_lock(&s->mutex);
+			s->avail--;
+		}
+
+		mutex_unlock(&s->mutex);
+		wait_event(s->wait, !list_empty(&s->free));
+	}
+}
+
+
+static void put_decomp_stream(struct squashfs_stream *s,
+	struct decomp_stream *ds)
+{
+	mutex_lock(&s->mutex);
+	list_add(&ds->list, &s->free);
+	mutex_unlock(&s->mutex);
+	wake_up(&s->wait);
+}
+
+
+void *squashfs_decompressor_create(struct squashfs_sb_info *msblk,
+	void *comp_opts, int length)
+{
+	struct squashfs_stream *s;
+	struct decomp_stream *ds;
+	int cpu, err = -ENOMEM;
+
+	s = kzalloc(sizeof(*s), GFP_KERNEL);
+	if (s == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	s->mode = msblk->decomp_mode;
+	mutex_init(&s->mutex);
+	INIT_LIST_HEAD(&s->free);
+	init_waitqueue_head(&s->wait);
+
+	/* streams allocated after mount need the compressor options too */
+	if (comp_opts) {
+		s->comp_opts = kmemdup(comp_opts, length, GFP_KERNEL);
+		if (s->comp_opts == NULL)
+			goto failed;
+	}
+	s->comp_opts_len = length;
+
+	if (s->mode == SQUASHFS_DECOMP_PERCPU) {
+		s->percpu = alloc_percpu(struct percpu_stream);
+		if (s->percpu == NULL)
+			goto failed;
+
+		for_each_possible_cpu(cpu) {
+			struct percpu_stream *ps = per_cpu_ptr(s->percpu, cpu);
+			void *strm;
+
+			mutex_init(&ps->mutex);
+			strm = msblk->decompressor->init(msblk, s->comp_opts,
+				s->comp_opts_len);
+			if (IS_ERR(strm)) {
+				err = PTR_ERR(strm);
+				goto failed;
+			}
+			ps->stream = strm;
+		}
+
+		return s;
+	}
+
+	s->max = s->mode == SQUASHFS_DECOMP_MULTI ? num_online_cpus() * 2 : 1;
+
+	/* allocate one stream now, to check the options and so there is one */
+	ds = alloc_decomp_stream(msblk, s);
+	if (IS_ERR(ds)) {
+		err = PTR_ERR(ds);
+		goto failed;
+	}
+	list_add(&ds->list, &s->free);
+	s->avail = 1;
+
+	return s;
+
+failed:
+	squashfs_decompressor_free(msblk, s);
+	return ERR_PTR(err);
+}
+
+
+void squashfs_decompressor_free(struct squashfs_sb_info *msblk, void *strm)
+{
+	struct squashfs_stream *s = strm;
+	struct decomp_stream *ds;
+	int cpu;
+
+	if (s == NULL)
+		return;
+
+	if (s->percpu) {
+		for_each_possible_cpu(cpu)
+			msblk->decompressor->free(
+				per_cpu_ptr(s->percpu, cpu)->stream);
+		free_percpu(s->percpu);
+	}
+
+	while (!list_empty(&s->free)) {
+		ds = list_entry(s->free.next, struct decomp_stream, list);
+		list_del(&ds->list);
+		msblk->decompressor->free(ds->stream);
+		kfree(ds);
+	}
+
+	kfree(s->comp_opts);
+	kfree(s);
+}
+
+
+int squashfs_decompress(struct squashfs_sb_info *msblk, void **buffer,
+	struct buffer_head **bh, int b, int offset, int length, int srclength,
+	int pages)
+{
+	struct squashfs_stream *s = msblk->stream;
+	struct percpu_stream *ps;
+	struct decomp_stream *ds;
+	int res;
+
+	if (s->mode == SQUASHFS_DECOMP_PERCPU) {
+		ps = per_cpu_ptr(s->percpu, get_cpu());
+		put_cpu();
+
+		mutex_lock(&ps->mutex);
+		res = msblk->decompressor->decompress(msblk, ps->stream, buffer,
+			bh, b, offset, length, srclength, pages);
+		mutex_unlock(&ps->mutex);
+		return res;
+	}
+
+	ds = get_decomp_stream(msblk, s);
+	res = msblk->decompressor->decompress(msblk, ds->stream, buffer, bh, b,
+		offset, length, srclength, pages);
+	put_decomp_stream(s, ds);
+
+	return res;
+}
@@ -36,6 +36,9 @@
 #include <linux/module.h>
 #include <linux/magic.h>
 #include <linux/xattr.h>
+#include <linux/parser.h>
+#include <linux/mount.h>
+#include <linux/seq_file.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -74,6 +77,63 @@ static const struct squashfs_decompressor *supported_squashfs_filesystem(short
 }
 
 
+static const char * const squashfs_decomp_modes[] = {
+	[SQUASHFS_DECOMP_SINGLE]	= "single",
+	[SQUASHFS_DECOMP_MULTI]		= "multi",
+	[SQUASHFS_DECOMP_PERCPU]	= "percpu",
+};
+
+enum {
+	Opt_threads, Opt_err
+};
+
+static const match_table_t squashfs_tokens = {
+	{Opt_threads, "threads=%s"},
+	{Opt_err, NULL}
+};
+
+/*
+ * Squashfs used to ignore its mount data, so options it does not know are
+ * still ignored rather than failing the mount.
+ */
+static int squashfs_parse_options(struct squashfs_sb_info *msblk,
+	char *options)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *p;
+	int i;
+
+	msblk->decomp_mode = SQUASHFS_DECOMP_DEFAULT;
+
+	if (options == NULL)
+		return 0;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		if (!*p)
+			continue;
+
+		switch (match_token(p, squashfs_tokens, args)) {
+		case Opt_threads:
+			for (i = 0; i < ARRAY_SIZE(squashfs_decomp_modes); i++)
+				if (!strcmp(args[0].from,
+						squashfs_decomp_modes[i]))
+					break;
+			if (i == ARRAY_SIZE(squashfs_decomp_modes)) {
+				ERROR("unknown threads=%s, expected single, "
+					"multi or percpu\n", args[0].from);
+				return -EINVAL;
+			}
+			msblk->decomp_mode = i;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
+
+
 static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 {
 	struct squashfs_sb_info *msblk;
@@ -98,9 +158,12 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	msblk->devblksize = sb_min_blocksize(sb, BLOCK_SIZE);
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
-	mutex_init(&msblk->read_data_mutex);
 	mutex_init(&msblk->meta_index_mutex);
 
+	err = squashfs_parse_options(msblk, data);
+	if (err)
+		goto failed_mount;
+
 	/*
 	 * msblk->bytes_used is checked in squashfs_read_table to ensure reads
 	 * are not beyond filesystem end.  But as we're using
@@ -365,6 +428,17 @@ static int squashfs_statfs(struct dentry *dentry, struct kstatfs *buf)
 }
 
 
+static int squashfs_show_options(struct seq_file *seq, struct vfsmount *vfs)
+{
+	struct squashfs_sb_info *msblk = vfs->mnt_sb->s_fs_info;
+
+	if (msblk->decomp_mode != SQUASHFS_DECOMP_DEFAULT)
+		seq_printf(seq, ",threads=%s",
+			squashfs_decomp_modes[msblk->decomp_mode]);
+	return 0;
+}
+
+
 static int squashfs_remount(struct super_block *sb, int *flags, char *data)
 {
 	*flags |= MS_RDONLY;
@@ -486,6 +560,7 @@ static const struct super_operations squashfs_super_ops = {
 	.alloc_inode = squashfs_alloc_inode,
 	.destroy_inode = squashfs_destroy_inode,
 	.statfs = squashfs_statfs,
+	.show_options = squashfs_show_options,
 	.put_super = squashfs_put_super,
 	.remount_fs = squashfs_remount
 };
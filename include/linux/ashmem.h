@@ -32,6 +32,24 @@ struct ashmem_pin {
 	__u32 len;	/* length forward from offset, in bytes, page-aligned */
 };
 
+/* Operations for ASHMEM_PIN_BATCH */
+#define ASHMEM_BATCH_PIN		0
+#define ASHMEM_BATCH_UNPIN		1
+#define ASHMEM_BATCH_GET_PIN_STATUS	2
+
+struct ashmem_pin_range {
+	__u32 offset;	/* as in struct ashmem_pin */
+	__u32 len;	/* as in struct ashmem_pin */
+	__u32 op;	/* ASHMEM_BATCH_* */
+	__s32 result;	/* out: what the single range ioctl would return */
+};
+
+struct ashmem_pin_batch {
+	__u64 ranges;	/* user pointer to an array of struct ashmem_pin_range */
+	__u32 count;	/* number of entries in the array */
+	__u32 __reserved;
+};
+
 #define __ASHMEMIOC		0x77
 
 #define ASHMEM_SET_NAME		_IOW(__ASHMEMIOC, 1, char[ASHMEM_NAME_LEN])
@@ -44,5 +62,6 @@ struct ashmem_pin {
 #define ASHMEM_UNPIN		_IOW(__ASHMEMIOC, 8, struct ashmem_pin)
 #define ASHMEM_GET_PIN_STATUS	_IO(__ASHMEMIOC, 9)
 #define ASHMEM_PURGE_ALL_CACHES	_IO(__ASHMEMIOC, 10)
+#define ASHMEM_PIN_BATCH	_IOW(__ASHMEMIOC, 11, struct ashmem_pin_batch)
 
 #endif	/* _LINUX_ASHMEM_H */
@@ -20,6 +20,7 @@
 #include <linux/completion.h>
 #include <linux/workqueue.h>
 #include <linux/cpumask.h>
+#include <asm/cputime.h>
 #include <asm/div64.h>
 
 #define CPUFREQ_NAME_LEN 16
@@ -309,6 +310,21 @@ __ATTR(_name, 0644, show_##_name, store_##_name)
  *                        CPUFREQ 2.6. INTERFACE                     *
  *********************************************************************/
 u64 get_cpu_idle_time(unsigned int cpu, u64 *wall, int io_busy);
+
+/*
+ * Per-cpu load sampling shared by the sampling governors: the idle, wall and
+ * nice times seen at the previous sample.
+ */
+struct cpufreq_load_sample {
+	u64 idle;
+	u64 wall;
+	cputime64_t nice;
+};
+
+void cpufreq_load_sample_init(struct cpufreq_load_sample *sample,
+			      unsigned int cpu, int io_busy);
+int cpufreq_load_sample(struct cpufreq_load_sample *sample, unsigned int cpu,
+			int io_busy, int ignore_nice);
 int cpufreq_get_policy(struct cpufreq_policy *policy, unsigned int cpu);
 int cpufreq_update_policy(unsigned int cpu);
 
@@ -63,6 +63,7 @@ struct ion_buffer;
  * @name:	used for debug purposes
  * @base:	base address of heap in physical memory if applicable
  * @size:	size of the heap in bytes if applicable
+ * @flags:	ION_HEAP_FLAG_* flags for the heap
  *
  * Provided by the board file.
  */
@@ -72,8 +73,15 @@ struct ion_platform_heap {
 	const char *name;
 	ion_phys_addr_t base;
 	size_t size;
+	unsigned long flags;
 };
 
+/*
+ * Free the heap's buffers from a background thread instead of in the
+ * context of whoever dropped the last reference.
+ */
+#define ION_HEAP_FLAG_DEFER_FREE	(1 << 0)
+
 /**
  * struct ion_platform_data - array of platform heaps passed from board file
  * @nr:		number of structures in the array
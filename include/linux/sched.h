@@ -1166,6 +1166,23 @@ struct sched_statistics {
 };
 #endif
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+/*
+ * Recent busy time of a task, tracked for cpufreq governors
+ * @window_start:	start of the window @sum belongs to
+ * @sum:		time the task has run in that window
+ * @demand:		busy time as a fraction of a window, out of
+ *			SCHED_LOAD_SCALE
+ * @counted:		@demand is included in the runqueue's demand
+ */
+struct ravg {
+	u64			window_start;
+	u64			sum;
+	unsigned long		demand;
+	int			counted;
+};
+#endif
+
 struct sched_entity {
 	struct load_weight	load;		/* for load-balancing */
 	struct rb_node		run_node;
@@ -1183,6 +1200,10 @@ struct sched_entity {
 	struct sched_statistics statistics;
 #endif
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	struct ravg		ravg;
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct sched_entity	*parent;
 	/* rq on which this entity is (to be) queued: */
@@ -1926,6 +1947,18 @@ extern int sched_clock_stable;
 extern void sched_clock_tick(void);
 extern void sched_clock_idle_sleep_event(void);
 extern void sched_clock_idle_wakeup_event(u64 delta_ns);
+
+#ifdef CONFIG_SCHED_FREQ_INPUT
+/*
+ * The recent busy time of the tasks runnable on a cpu, in percent of a cpu
+ * at its current speed; more than 100 when they need more than one cpu.
+ * The notifiers are called, with the cpu, whenever it changes and must not
+ * sleep or take the runqueue lock.
+ */
+extern unsigned int sched_get_cpu_load(int cpu);
+extern int sched_freq_input_register_notifier(struct notifier_block *nb);
+extern int sched_freq_input_unregister_notifier(struct notifier_block *nb);
+#endif
 #endif
 
 #ifdef CONFIG_IRQ_TIME_ACCOUNTING
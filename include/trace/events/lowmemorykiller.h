@@ -0,0 +1,69 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lowmemorykiller
+
+#if !defined(_TRACE_LOWMEMORYKILLER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LOWMEMORYKILLER_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(lowmem_scan,
+	TP_PROTO(int min_adj, int selected_adj, int nr_scanned,
+		 bool fallback, u64 duration_ns),
+	TP_ARGS(min_adj, selected_adj, nr_scanned, fallback, duration_ns),
+
+	TP_STRUCT__entry(
+	    __field(int,  min_adj	)
+	    __field(int,  selected_adj	)
+	    __field(int,  nr_scanned	)
+	    __field(bool, fallback	)
+	    __field(u64,  duration_ns	)
+	),
+
+	TP_fast_assign(
+	    __entry->min_adj = min_adj;
+	    __entry->selected_adj = selected_adj;
+	    __entry->nr_scanned = nr_scanned;
+	    __entry->fallback = fallback;
+	    __entry->duration_ns = duration_ns;
+	),
+
+	TP_printk("min_adj=%d selected_adj=%d scanned=%d fallback=%d ns=%llu",
+	      __entry->min_adj, __entry->selected_adj, __entry->nr_scanned,
+	      __entry->fallback, __entry->duration_ns)
+);
+
+TRACE_EVENT(lowmem_kill,
+	TP_PROTO(struct task_struct *task, int oom_adj, int tasksize,
+		 int min_adj, int other_free, int other_file),
+	TP_ARGS(task, oom_adj, tasksize, min_adj, other_free, other_file),
+
+	TP_STRUCT__entry(
+	    __array(char, comm, TASK_COMM_LEN	)
+	    __field(pid_t, pid			)
+	    __field(int,   oom_adj		)
+	    __field(int,   tasksize		)
+	    __field(int,   min_adj		)
+	    __field(int,   other_free		)
+	    __field(int,   other_file		)
+	),
+
+	TP_fast_assign(
+	    memcpy(__entry->comm, task->comm, TASK_COMM_LEN);
+	    __entry->pid = task->pid;
+	    __entry->oom_adj = oom_adj;
+	    __entry->tasksize = tasksize;
+	    __entry->min_adj = min_adj;
+	    __entry->other_free = other_free;
+	    __entry->other_file = other_file;
+	),
+
+	TP_printk("%s pid=%d adj=%d size=%d min_adj=%d free=%d file=%d",
+	      __entry->comm, __entry->pid, __entry->oom_adj,
+	      __entry->tasksize, __entry->min_adj, __entry->other_free,
+	      __entry->other_file)
+);
+
+#endif /* _TRACE_LOWMEMORYKILLER_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
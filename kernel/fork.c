@@ -1539,6 +1539,10 @@ long do_fork(unsigned long clone_flags,
 		audit_finish_fork(p);
 		tracehook_report_clone(regs, clone_flags, nr, p);
 
+		/* a new process starts with its parent's oom_adj */
+		if (!(clone_flags & CLONE_THREAD))
+			oom_adj_changed(p);
+
 		/*
 		 * We set PF_STARTING at creation in case tracing wants to
 		 * use this to distinguish a fully live task from one that
@@ -63,6 +63,8 @@
 #include <linux/sched.h>
 #include <linux/types.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/percpu.h>
 #include <linux/stddef.h>
@@ -72,6 +74,7 @@
 #include <linux/compiler.h>
 #include <linux/irqflags.h>
 #include <linux/rcupdate.h>
+#include <linux/spinlock.h>
 
 #include <asm/system.h>
 
@@ -148,10 +151,25 @@ static struct rcu_stats {
        unsigned nmis;          /* #passes discarded due to NMI */
        atomic_t nbarriers;     /* #rcu barriers processed */
        atomic_t nsyncs;        /* #rcu syncs processed */
+       atomic_t nexpedited;    /* #expedited rcu syncs processed */
        s64 ninvoked;           /* #invoked (ie, finished) callbacks */
        unsigned nforced;       /* #forced eobs (should be zero) */
+       unsigned nkicked;       /* #cpus kicked to expedite an eob */
+       unsigned noffloaded;    /* #batches handed to callback threads */
 } rcu_stats;
 
+/*
+ * How long synchronize_sched() callers waited, for the normal [0] and
+ * the expedited [1] flavors.
+ */
+static struct rcu_gp_stats {
+       unsigned long count;
+       u64 total_us;
+       u64 max_us;
+} rcu_gp_stats[2];
+
+static DEFINE_SPINLOCK(rcu_gp_stats_lock);
+
 #define RCU_HZ                 (20)
 #define RCU_HZ_PERIOD_US       (USEC_PER_SEC / RCU_HZ)
 #define RCU_HZ_DELTA_US                (USEC_PER_SEC / HZ)
@@ -161,6 +179,15 @@ static int rcu_hz_delta_us = RCU_HZ_DELTA_US;
 
 static int rcu_hz_precise;
 
+/*
+ * While anyone waits in synchronize_sched_expedited(), passes are made
+ * every RCU_EXPEDITE_PERIOD_US and CPUs holding up end-of-batch are
+ * kicked at once rather than after the watchdog interval.
+ */
+#define RCU_EXPEDITE_PERIOD_US (100)
+
+static atomic_t rcu_expedite;
+
 int rcu_scheduler_active __read_mostly;
 int rcu_nmi_seen __read_mostly;
 
@@ -232,25 +259,65 @@ void rcu_note_might_resched(void)
 }
 EXPORT_SYMBOL(rcu_note_might_resched);
 
-void synchronize_sched(void)
+static void rcu_expedite_kick(void);
+static void rcu_offload_flush(void);
+
+static void __synchronize_sched(int expedited)
 {
        struct rcu_synchronize rcu;
+       struct rcu_gp_stats *gs = &rcu_gp_stats[expedited];
+       ktime_t start;
+       u64 us;
 
-       if (!rcu_scheduler_active)
-               return;
-
+       start = ktime_get();
        init_completion(&rcu.completion);
        call_rcu(&rcu.head, wakeme_after_rcu);
+       if (expedited) {
+               atomic_inc(&rcu_expedite);
+               rcu_expedite_kick();
+       }
        wait_for_completion(&rcu.completion);
-       atomic_inc(&rcu_stats.nsyncs);
+       if (expedited)
+               atomic_dec(&rcu_expedite);
+       us = ktime_us_delta(ktime_get(), start);
+
+       spin_lock(&rcu_gp_stats_lock);
+       gs->count++;
+       gs->total_us += us;
+       if (us > gs->max_us)
+               gs->max_us = us;
+       spin_unlock(&rcu_gp_stats_lock);
+}
+
+void synchronize_sched(void)
+{
+       if (!rcu_scheduler_active)
+               return;
 
+       __synchronize_sched(0);
+       atomic_inc(&rcu_stats.nsyncs);
 }
 EXPORT_SYMBOL_GPL(synchronize_sched);
 
+/*
+ * Like synchronize_sched(), but rather than wait for end-of-batch at the
+ * jRCU frame rate, force it by kicking the CPUs that hold it up.
+ */
+void synchronize_sched_expedited(void)
+{
+       if (!rcu_scheduler_active)
+               return;
+
+       __synchronize_sched(1);
+       atomic_inc(&rcu_stats.nexpedited);
+}
+EXPORT_SYMBOL_GPL(synchronize_sched_expedited);
+
 void rcu_barrier(void)
 {
        synchronize_sched();
        synchronize_sched();
+       rcu_offload_flush();
        atomic_inc(&rcu_stats.nbarriers);
 }
 EXPORT_SYMBOL_GPL(rcu_barrier);
@@ -292,11 +359,12 @@ void call_rcu_sched(struct rcu_head *cb, void (*func)(struct rcu_head *rcu))
 EXPORT_SYMBOL_GPL(call_rcu_sched);
 
 /*
- * Invoke all callbacks on the passed-in list.
+ * Invoke all callbacks on the passed-in list.  Returns the number invoked.
  */
-static void rcu_invoke_callbacks(struct rcu_list *pending)
+static int rcu_invoke_callbacks(struct rcu_list *pending)
 {
        struct rcu_head *curr, *next;
+       int n = 0;
 
        for (curr = pending->head; curr;) {
                unsigned long offset = (unsigned long)curr->func;
@@ -306,8 +374,9 @@ static void rcu_invoke_callbacks(struct rcu_list *pending)
                else
                        curr->func(curr);
                curr = next;
-               rcu_stats.ninvoked++;
+               n++;
        }
+       return n;
 }
 
 /*
@@ -326,7 +395,7 @@ static void __rcu_delimit_batches(struct rcu_list *pending)
 {
        struct rcu_data *rd;
        struct rcu_list *plist;
-       int cpu, eob, prev;
+       int cpu, eob, prev, expedite;
 
        if (!rcu_scheduler_active)
                return;
@@ -346,6 +415,7 @@ static void __rcu_delimit_batches(struct rcu_list *pending)
         * Find out if the current batch has ended
         * (end-of-batch).
         */
+       expedite = atomic_read(&rcu_expedite);
        eob = 1;
        for_each_online_cpu(cpu) {
                rd = &rcu_data[cpu];
@@ -353,7 +423,11 @@ static void __rcu_delimit_batches(struct rcu_list *pending)
                        rd->wait = preempt_count_cpu(cpu) > idle_cpu(cpu);
                        if (rd->wait) {
                                eob = 0;
-                               break;
+                               if (!expedite)
+                                       break;
+                               /* get it through a context switch */
+                               force_cpu_resched(cpu);
+                               rcu_stats.nkicked++;
                        }
                }
        }
@@ -371,7 +445,8 @@ static void __rcu_delimit_batches(struct rcu_list *pending)
                                        force_cpu_resched(cpu);
                        }
                }
-               rcu_wdog_ctr += rcu_hz_period_us;
+               rcu_wdog_ctr += expedite ?
+                       RCU_EXPEDITE_PERIOD_US : rcu_hz_period_us;
                return;
        }
 
@@ -418,6 +493,173 @@ static void __rcu_delimit_batches(struct rcu_list *pending)
        rcu_wdog_ctr = 0;
 }
 
+/* ------------------ callback offload section ------------------ */
+
+#ifdef CONFIG_JRCU_DAEMON
+#define RCU_OFFLOAD_MAX                CONFIG_JRCU_OFFLOAD_THREADS
+#else
+#define RCU_OFFLOAD_MAX                0
+#endif
+
+#if RCU_OFFLOAD_MAX > 0
+
+/*
+ * Batches of at least rcu_offload_batch callbacks are split evenly among
+ * rcu_offload_threads kernel threads instead of being invoked by jrcud.
+ * Each thread invokes what it is given in order, so rcu_barrier() need
+ * only wait for every thread to finish what it had been given so far.
+ */
+#include <linux/err.h>
+#include <linux/wait.h>
+#include <linux/kthread.h>
+
+static struct rcu_offload {
+       spinlock_t lock;
+       struct rcu_list queue;
+       struct task_struct *task;
+       s64 nqueued;            /* #callbacks handed to this thread */
+       s64 ninvoked;           /* #callbacks it has invoked */
+} rcu_offload[RCU_OFFLOAD_MAX];
+
+static int rcu_offload_started;        /* #threads running */
+static int rcu_offload_threads;        /* #threads in use, 0 = offload off */
+static int rcu_offload_batch = 256;
+static DECLARE_WAIT_QUEUE_HEAD(rcu_offload_wq);
+
+static int jrcuo_func(void *arg)
+{
+       struct rcu_offload *ro = arg;
+       struct rcu_list list;
+       int n;
+
+       current->flags |= PF_NOFREEZE;
+
+       while (!kthread_should_stop()) {
+               set_current_state(TASK_INTERRUPTIBLE);
+               spin_lock_irq(&ro->lock);
+               list = ro->queue;
+               rcu_list_init(&ro->queue);
+               spin_unlock_irq(&ro->lock);
+
+               if (!list.head) {
+                       schedule();
+                       continue;
+               }
+               __set_current_state(TASK_RUNNING);
+
+               n = rcu_invoke_callbacks(&list);
+
+               spin_lock_irq(&ro->lock);
+               ro->ninvoked += n;
+               spin_unlock_irq(&ro->lock);
+               if (waitqueue_active(&rcu_offload_wq))
+                       wake_up_all(&rcu_offload_wq);
+       }
+       __set_current_state(TASK_RUNNING);
+       return 0;
+}
+
+/*
+ * Hand a batch of callbacks to the callback threads, if it is large
+ * enough.  Returns 0 if the caller is to invoke them itself.
+ */
+static int rcu_offload_callbacks(struct rcu_list *pending)
+{
+       int nthreads = ACCESS_ONCE(rcu_offload_threads);
+       struct rcu_head *h = pending->head;
+       unsigned long flags;
+       int i, chunk;
+
+       if (nthreads < 1 || pending->count < rcu_offload_batch)
+               return 0;
+
+       chunk = DIV_ROUND_UP(pending->count, nthreads);
+       for (i = 0; i < nthreads && h; i++) {
+               struct rcu_offload *ro = &rcu_offload[i];
+               struct rcu_list part;
+
+               part.head = h;
+               for (part.count = 1; part.count < chunk && h->next;
+                    part.count++)
+                       h = h->next;
+               part.tail = &h->next;
+               h = h->next;
+               *part.tail = NULL;
+
+               spin_lock_irqsave(&ro->lock, flags);
+               rcu_list_join(&ro->queue, &part);
+               ro->nqueued += part.count;
+               spin_unlock_irqrestore(&ro->lock, flags);
+               wake_up_process(ro->task);
+       }
+       rcu_stats.noffloaded++;
+       return 1;
+}
+
+static int rcu_offload_caught_up(struct rcu_offload *ro, s64 nqueued)
+{
+       int done;
+
+       spin_lock_irq(&ro->lock);
+       done = ro->ninvoked >= nqueued;
+       spin_unlock_irq(&ro->lock);
+       return done;
+}
+
+/* wait until every callback handed to the threads so far has been invoked */
+static void rcu_offload_flush(void)
+{
+       int i;
+
+       for (i = 0; i < rcu_offload_started; i++) {
+               struct rcu_offload *ro = &rcu_offload[i];
+               s64 nqueued;
+
+               spin_lock_irq(&ro->lock);
+               nqueued = ro->nqueued;
+               spin_unlock_irq(&ro->lock);
+               wait_event(rcu_offload_wq, rcu_offload_caught_up(ro, nqueued));
+       }
+}
+
+static void __init rcu_offload_start(void)
+{
+       struct task_struct *p;
+       int i;
+
+       for (i = 0; i < RCU_OFFLOAD_MAX; i++) {
+               struct rcu_offload *ro = &rcu_offload[i];
+
+               spin_lock_init(&ro->lock);
+               rcu_list_init(&ro->queue);
+               p = kthread_run(jrcuo_func, ro, "jrcuo/%d", i);
+               if (IS_ERR(p)) {
+                       pr_warn("JRCU: cannot start callback thread %d\n", i);
+                       break;
+               }
+               ro->task = p;
+       }
+       rcu_offload_started = i;
+       rcu_offload_threads = i;
+}
+
+#else /* RCU_OFFLOAD_MAX == 0 */
+
+static inline int rcu_offload_callbacks(struct rcu_list *pending)
+{
+       return 0;
+}
+
+static void rcu_offload_flush(void)
+{
+}
+
+static inline void rcu_offload_start(void)
+{
+}
+
+#endif /* RCU_OFFLOAD_MAX */
+
 static void rcu_delimit_batches(void)
 {
        unsigned long flags;
@@ -432,8 +674,8 @@ static void rcu_delimit_batches(void)
        smp_mb();
        raw_local_irq_restore(flags);
 
-       if (pending.head)
-               rcu_invoke_callbacks(&pending);
+       if (pending.head && !rcu_offload_callbacks(&pending))
+               rcu_stats.ninvoked += rcu_invoke_callbacks(&pending);
 }
 
 /* ------------------ interrupt driver section ------------------ */
@@ -498,6 +740,11 @@ void __init rcu_scheduler_starting(void)
 
 #ifndef CONFIG_JRCU_DAEMON
 
+/* expedited grace periods just wait for the timer */
+static void rcu_expedite_kick(void)
+{
+}
+
 void __init int rcu_start_callback_processing(void)
 {
        rcu_timer_start();
@@ -522,6 +769,7 @@ void __init int rcu_start_callback_processing(void)
 
 static int rcu_priority;
 static struct task_struct *rcu_daemon;
+static ktime_t rcu_last_pass;
 
 static int jrcu_set_priority(int priority)
 {
@@ -541,6 +789,40 @@ static int jrcu_set_priority(int priority)
        return param.sched_priority;
 }
 
+/* get jrcud to make its next pass now, if it is sleeping */
+static void rcu_expedite_kick(void)
+{
+       struct task_struct *p = ACCESS_ONCE(rcu_daemon);
+
+       if (p)
+               wake_up_process(p);
+}
+
+static void jrcud_sleep(void)
+{
+       s64 since;
+
+       if (atomic_read(&rcu_expedite)) {
+               usleep_range(RCU_EXPEDITE_PERIOD_US,
+                       RCU_EXPEDITE_PERIOD_US);
+       } else if (rcu_hz_precise) {
+               usleep_range(rcu_hz_period_us,
+                       rcu_hz_period_us);
+       } else {
+               usleep_range(rcu_hz_period_us,
+                       rcu_hz_period_us + rcu_hz_delta_us);
+       }
+
+       /*
+        * rcu_expedite_kick() may have cut the sleep short.  Passes must
+        * still be far enough apart for the previous batch to quiesce.
+        */
+       while ((since = ktime_us_delta(ktime_get(), rcu_last_pass)) <
+                       RCU_EXPEDITE_PERIOD_US)
+               usleep_range(RCU_EXPEDITE_PERIOD_US - since,
+                       RCU_EXPEDITE_PERIOD_US - since);
+}
+
 static int jrcud_func(void *arg)
 {
        current->flags |= PF_NOFREEZE;
@@ -550,13 +832,8 @@ static int jrcud_func(void *arg)
        pr_info("JRCU: callback processing via daemon started.\n");
 
        while (!kthread_should_stop()) {
-               if (rcu_hz_precise) {
-                       usleep_range(rcu_hz_period_us,
-                               rcu_hz_period_us);
-               } else {
-                       usleep_range(rcu_hz_period_us,
-                               rcu_hz_period_us + rcu_hz_delta_us);
-               }
+               jrcud_sleep();
+               rcu_last_pass = ktime_get();
                rcu_delimit_batches();
        }
 
@@ -577,6 +854,7 @@ static __init int rcu_start_callback_processing(void)
                return -ENODEV;
        }
        rcu_daemon = p;
+       rcu_offload_start();
        rcu_scheduler_active = 1;
 
        pr_info("JRCU: callback processing now allowed.\n");
@@ -596,14 +874,35 @@ subsys_initcall_sync(rcu_start_callback_processing);
 
 static int rcu_hz = RCU_HZ;
 
-static int rcu_debugfs_show(struct seq_file *m, void *unused)
+static s64 rcu_nqueued(void)
 {
-       int cpu, q;
-       s64 nqueued;
+       s64 nqueued = 0;
+       int cpu;
 
-       nqueued = 0;
        for_each_present_cpu(cpu)
                nqueued += rcu_data[cpu].nqueued;
+       return nqueued;
+}
+
+static s64 rcu_ninvoked(void)
+{
+       s64 ninvoked = rcu_stats.ninvoked;
+#if RCU_OFFLOAD_MAX > 0
+       int i;
+
+       for (i = 0; i < rcu_offload_started; i++)
+               ninvoked += rcu_offload[i].ninvoked;
+#endif
+       return ninvoked;
+}
+
+static int rcu_debugfs_show(struct seq_file *m, void *unused)
+{
+       int cpu, q;
+       s64 nqueued, ninvoked;
+
+       nqueued = rcu_nqueued();
+       ninvoked = rcu_ninvoked();
 
        seq_printf(m, "%14u: hz, %s\n",
                rcu_hz,
@@ -640,9 +939,9 @@ static int rcu_debugfs_show(struct seq_file *m, void *unused)
        seq_printf(m, "%14u: #syncs\n",
                atomic_read(&rcu_stats.nsyncs));
        seq_printf(m, "%14llu: #callbacks invoked\n",
-               rcu_stats.ninvoked);
+               ninvoked);
        seq_printf(m, "%14d: #callbacks left to invoke\n",
-               (int)(nqueued - rcu_stats.ninvoked));
+               (int)(nqueued - ninvoked));
        seq_printf(m, "\n");
 
        for_each_online_cpu(cpu)
@@ -727,6 +1026,20 @@ next:
                if (wdog < 3 || wdog > 1000)
                        return -EINVAL;
                rcu_wdog_lim = wdog * USEC_PER_SEC;
+#if RCU_OFFLOAD_MAX > 0
+       } else if (!strncmp(token, "offload=", 8)) {
+               int threads = -1;
+               sscanf(&token[8], "%d", &threads);
+               if (threads < 0 || threads > rcu_offload_started)
+                       return -EINVAL;
+               rcu_offload_threads = threads;
+       } else if (!strncmp(token, "offload_batch=", 14)) {
+               int batch = -1;
+               sscanf(&token[14], "%d", &batch);
+               if (batch < 1)
+                       return -EINVAL;
+               rcu_offload_batch = batch;
+#endif
        } else
                return -EINVAL;
        goto next;
@@ -746,6 +1059,82 @@ static const struct file_operations rcu_debugfs_fops = {
        .release = single_release,
 };
 
+static void rcu_gp_stats_show(struct seq_file *m, int expedited,
+       const char *what)
+{
+       struct rcu_gp_stats gs;
+
+       spin_lock(&rcu_gp_stats_lock);
+       gs = rcu_gp_stats[expedited];
+       spin_unlock(&rcu_gp_stats_lock);
+
+       seq_printf(m, "%14lu: #%s\n", gs.count, what);
+       seq_printf(m, "%14llu: avg wait (usecs)\n",
+               gs.count ? div64_u64(gs.total_us, gs.count) : 0);
+       seq_printf(m, "%14llu: max wait (usecs)\n", gs.max_us);
+}
+
+/*
+ * Grace-period latency as seen by synchronize_sched() callers, and
+ * how far callback invocation lags behind call_rcu().
+ */
+static int rcu_stats_show(struct seq_file *m, void *unused)
+{
+       s64 nqueued, ninvoked;
+#if RCU_OFFLOAD_MAX > 0
+       int i;
+#endif
+
+       nqueued = rcu_nqueued();
+       ninvoked = rcu_ninvoked();
+
+       rcu_gp_stats_show(m, 0, "syncs");
+       seq_printf(m, "\n");
+       rcu_gp_stats_show(m, 1, "expedited syncs");
+       seq_printf(m, "%14u: #cpus kicked to expedite end-of-batch\n",
+               rcu_stats.nkicked);
+
+       seq_printf(m, "\n");
+       seq_printf(m, "%14lld: #callbacks queued\n", nqueued);
+       seq_printf(m, "%14lld: #callbacks invoked\n", ninvoked);
+       seq_printf(m, "%14lld: #callbacks left to invoke\n",
+               nqueued - ninvoked);
+
+#if RCU_OFFLOAD_MAX > 0
+       seq_printf(m, "\n");
+       seq_printf(m, "%14d: callback threads in use (of %d)\n",
+               rcu_offload_threads, rcu_offload_started);
+       seq_printf(m, "%14d: offload batch (callbacks)\n",
+               rcu_offload_batch);
+       seq_printf(m, "%14u: #batches offloaded\n",
+               rcu_stats.noffloaded);
+       for (i = 0; i < rcu_offload_started; i++) {
+               struct rcu_offload *ro = &rcu_offload[i];
+               s64 backlog;
+
+               spin_lock_irq(&ro->lock);
+               backlog = ro->nqueued - ro->ninvoked;
+               spin_unlock_irq(&ro->lock);
+               seq_printf(m, "%14lld: #callbacks left to invoke by jrcuo/%d\n",
+                       backlog, i);
+       }
+#endif
+       return 0;
+}
+
+static int rcu_stats_open(struct inode *inode, struct file *file)
+{
+       return single_open(file, rcu_stats_show, NULL);
+}
+
+static const struct file_operations rcu_stats_fops = {
+       .owner = THIS_MODULE,
+       .open = rcu_stats_open,
+       .read = seq_read,
+       .llseek = seq_lseek,
+       .release = single_release,
+};
+
 static struct dentry *rcudir;
 
 static int __init rcu_debugfs_init(void)
@@ -761,6 +1150,11 @@ static int __init rcu_debugfs_init(void)
        if (!retval)
                goto error;
 
+       retval = debugfs_create_file("rcustats", 0444, rcudir,
+                       NULL, &rcu_stats_fops);
+       if (!retval)
+               goto error;
+
        return 0;
 
 error:
@@ -474,6 +474,11 @@ struct rq {
 	unsigned long nr_load_updates;
 	u64 nr_switches;
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	/* sum of the ravg.demand of the fair tasks on this cpu */
+	unsigned long cumulative_demand;
+#endif
+
 	struct cfs_rq cfs;
 	struct rt_rq rt;
 
@@ -2828,6 +2833,10 @@ static void __sched_fork(struct task_struct *p)
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
 #endif
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+	memset(&p->se.ravg, 0, sizeof(p->se.ravg));
+#endif
+
 	INIT_LIST_HEAD(&p->rt.run_list);
 
 #ifdef CONFIG_PREEMPT_NOTIFIERS
@@ -549,6 +549,120 @@ static u64 sched_vslice(struct cfs_rq *cfs_rq, struct sched_entity *se)
 static void update_cfs_load(struct cfs_rq *cfs_rq, int global_update);
 static void update_cfs_shares(struct cfs_rq *cfs_rq);
 
+#ifdef CONFIG_SCHED_FREQ_INPUT
+/*
+ * Frequency governors look at the busy time of the tasks runnable on a cpu,
+ * rather than at how long the cpu was idle over their last sampling period.
+ * A task's demand is its busy time in the last window it ran in, or in the
+ * current one once that is more, so a task that gets busier raises it
+ * within a tick. It is added to a runqueue's demand on enqueue and removed
+ * on dequeue, so it moves with the task when it migrates and a woken task
+ * brings its demand to the cpu it wakes up on.
+ */
+#define RAVG_WINDOW_SHIFT	24	/* about 16.8ms */
+#define RAVG_WINDOW		(1ULL << RAVG_WINDOW_SHIFT)
+
+static ATOMIC_NOTIFIER_HEAD(sched_freq_input_notifier);
+
+int sched_freq_input_register_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_register(&sched_freq_input_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(sched_freq_input_register_notifier);
+
+int sched_freq_input_unregister_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_unregister(&sched_freq_input_notifier,
+						nb);
+}
+EXPORT_SYMBOL_GPL(sched_freq_input_unregister_notifier);
+
+unsigned int sched_get_cpu_load(int cpu)
+{
+	unsigned long demand = ACCESS_ONCE(cpu_rq(cpu)->cumulative_demand);
+
+	return (demand * 100) >> SCHED_LOAD_SHIFT;
+}
+EXPORT_SYMBOL_GPL(sched_get_cpu_load);
+
+static void cumulative_demand_changed(struct rq *rq)
+{
+	atomic_notifier_call_chain(&sched_freq_input_notifier, cpu_of(rq),
+				   NULL);
+}
+
+static void inc_cumulative_demand(struct rq *rq, struct task_struct *p)
+{
+	struct ravg *ra = &p->se.ravg;
+
+	ra->counted = 1;
+	if (ra->demand) {
+		rq->cumulative_demand += ra->demand;
+		cumulative_demand_changed(rq);
+	}
+}
+
+static void dec_cumulative_demand(struct rq *rq, struct task_struct *p)
+{
+	struct ravg *ra = &p->se.ravg;
+
+	ra->counted = 0;
+	if (ra->demand) {
+		rq->cumulative_demand -= ra->demand;
+		cumulative_demand_changed(rq);
+	}
+}
+
+static void set_task_demand(struct rq *rq, struct task_struct *p, u64 busy)
+{
+	struct ravg *ra = &p->se.ravg;
+	unsigned long demand;
+
+	demand = min(busy, RAVG_WINDOW) >>
+		(RAVG_WINDOW_SHIFT - SCHED_LOAD_SHIFT);
+	if (demand == ra->demand)
+		return;
+
+	if (ra->counted)
+		rq->cumulative_demand += demand - ra->demand;
+	ra->demand = demand;
+	if (ra->counted)
+		cumulative_demand_changed(rq);
+}
+
+/* account delta_exec of runtime to p, which just ran on rq */
+static void update_task_ravg(struct rq *rq, struct task_struct *p,
+			     unsigned long delta_exec)
+{
+	struct ravg *ra = &p->se.ravg;
+	u64 now = rq->clock_task;
+	u64 window_start = now & ~(RAVG_WINDOW - 1);
+
+	if (ra->window_start != window_start) {
+		/* the runtime before this window closes the last one */
+		u64 in_window = min((u64)delta_exec, now - window_start);
+
+		set_task_demand(rq, p, ra->sum + delta_exec - in_window);
+		ra->window_start = window_start;
+		ra->sum = in_window;
+	} else {
+		ra->sum += delta_exec;
+	}
+
+	if (min(ra->sum, RAVG_WINDOW) >> (RAVG_WINDOW_SHIFT - SCHED_LOAD_SHIFT)
+	    > ra->demand)
+		set_task_demand(rq, p, ra->sum);
+}
+#else
+static inline void
+inc_cumulative_demand(struct rq *rq, struct task_struct *p) { }
+static inline void
+dec_cumulative_demand(struct rq *rq, struct task_struct *p) { }
+static inline void
+update_task_ravg(struct rq *rq, struct task_struct *p,
+		 unsigned long delta_exec) { }
+#endif
+
 /*
  * Update the current task's runtime statistics. Skip current tasks that
  * are not in our scheduling class.
@@ -601,6 +715,7 @@ static void update_curr(struct cfs_rq *cfs_rq)
 		trace_sched_stat_runtime(curtask, delta_exec, curr->vruntime);
 		cpuacct_charge(curtask, delta_exec);
 		account_group_exec_runtime(curtask, delta_exec);
+		update_task_ravg(rq_of(cfs_rq), curtask, delta_exec);
 	}
 }
 
@@ -1342,6 +1457,7 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_cfs_shares(cfs_rq);
 	}
 
+	inc_cumulative_demand(rq, p);
 	hrtick_update(rq);
 }
 
@@ -1382,6 +1498,7 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_cfs_shares(cfs_rq);
 	}
 
+	dec_cumulative_demand(rq, p);
 	hrtick_update(rq);
 }
 
@@ -214,3 +214,64 @@ void gen_pool_free(struct gen_pool *pool, unsigned long addr, size_t size)
 	read_unlock(&pool->lock);
 }
 EXPORT_SYMBOL(gen_pool_free);
+
+/**
+ * gen_pool_avail - get available free space of the pool
+ * @pool: pool to get available free space
+ * @largest: if not NULL, set to the size of the largest free block
+ *
+ * Return available free space of the specified pool. The largest free
+ * block is the biggest allocation that can currently succeed, so the two
+ * together tell how fragmented the pool is.
+ */
+size_t gen_pool_avail(struct gen_pool *pool, size_t *largest)
+{
+	struct gen_pool_chunk *chunk;
+	unsigned long flags;
+	int order = pool->min_alloc_order;
+	int start_bit, end_bit, bit;
+	size_t avail = 0, max = 0;
+
+	read_lock(&pool->lock);
+	list_for_each_entry(chunk, &pool->chunks, next_chunk) {
+		end_bit = (chunk->end_addr - chunk->start_addr) >> order;
+
+		spin_lock_irqsave(&chunk->lock, flags);
+		start_bit = find_next_zero_bit(chunk->bits, end_bit, 0);
+		while (start_bit < end_bit) {
+			bit = find_next_bit(chunk->bits, end_bit, start_bit);
+			avail += bit - start_bit;
+			if (bit - start_bit > max)
+				max = bit - start_bit;
+			start_bit = find_next_zero_bit(chunk->bits, end_bit,
+						       bit);
+		}
+		spin_unlock_irqrestore(&chunk->lock, flags);
+	}
+	read_unlock(&pool->lock);
+
+	if (largest)
+		*largest = max << order;
+	return avail << order;
+}
+EXPORT_SYMBOL(gen_pool_avail);
+
+/**
+ * gen_pool_size - get size in bytes of memory managed by the pool
+ * @pool: pool to get size
+ *
+ * Return size in bytes of memory managed by the pool.
+ */
+size_t gen_pool_size(struct gen_pool *pool)
+{
+	struct gen_pool_chunk *chunk;
+	size_t size = 0;
+
+	read_lock(&pool->lock);
+	list_for_each_entry(chunk, &pool->chunks, next_chunk)
+		size += chunk->end_addr - chunk->start_addr;
+	read_unlock(&pool->lock);
+
+	return size;
+}
+EXPORT_SYMBOL(gen_pool_size);
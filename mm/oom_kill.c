@@ -586,6 +586,35 @@ int unregister_oom_notifier(struct notifier_block *nb)
 }
 EXPORT_SYMBOL_GPL(unregister_oom_notifier);
 
+static BLOCKING_NOTIFIER_HEAD(oom_adj_notify_list);
+
+int register_oom_adj_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_register(&oom_adj_notify_list, nb);
+}
+EXPORT_SYMBOL_GPL(register_oom_adj_notifier);
+
+int unregister_oom_adj_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_unregister(&oom_adj_notify_list, nb);
+}
+EXPORT_SYMBOL_GPL(unregister_oom_adj_notifier);
+
+/**
+ * oom_adj_changed() - notify that a task's oom_adj has been set
+ * @task: task whose signal->oom_adj was written, or a new process that
+ *	inherited it from its parent
+ *
+ * Called from process context without locks held; the caller must hold a
+ * reference to @task. Listeners should read signal->oom_adj again under
+ * their own lock, as a fork and a write may notify in either order.
+ */
+void oom_adj_changed(struct task_struct *task)
+{
+	blocking_notifier_call_chain(&oom_adj_notify_list,
+				     task->signal->oom_adj, task);
+}
+
 /*
  * Try to acquire the OOM killer lock for the zones in zonelist.  Returns zero
  * if a parallel OOM killing is already taking place that includes a zone in
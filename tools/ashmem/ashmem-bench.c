@@ -0,0 +1,198 @@
+/*
+ * ashmem-bench: measure ASHMEM_PIN/ASHMEM_UNPIN throughput and latency
+ * from several threads while memory pressure forces the ashmem shrinker
+ * to run.
+ *
+ * Each worker owns an ashmem region and repeatedly unpins and re-pins
+ * random page ranges of it. Unless disabled, one more thread keeps
+ * allocating and touching memory so that reclaim purges unpinned ranges
+ * concurrently.
+ *
+ * Compile by:
+ *
+ * gcc -O2 -o ashmem-bench ashmem-bench.c -lpthread
+ *
+ * Usage: ashmem-bench [-t threads] [-s seconds] [-p pages] [-m pressure_mb]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/types.h>
+#include "../../include/linux/ashmem.h"
+
+#define MAX_THREADS	64
+
+static int nr_threads = 4;
+static int seconds = 10;
+static int nr_pages = 256;
+static int pressure_mb = 64;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned long ops;
+	unsigned long purged;
+	unsigned long long total_ns;
+	unsigned long long max_ns;
+};
+
+static struct worker workers[MAX_THREADS];
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static int timed_ioctl(struct worker *w, int fd, int cmd,
+		       struct ashmem_pin *pin)
+{
+	unsigned long long t0, dt;
+	int ret;
+
+	t0 = now_ns();
+	ret = ioctl(fd, cmd, pin);
+	dt = now_ns() - t0;
+	if (ret < 0)
+		fatal("ioctl");
+
+	w->ops++;
+	w->total_ns += dt;
+	if (dt > w->max_ns)
+		w->max_ns = dt;
+	return ret;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	size_t size = (size_t)nr_pages * getpagesize();
+	unsigned int seed = (unsigned long)w;
+	struct ashmem_pin pin;
+	char *map;
+	int fd, ret;
+
+	fd = open("/dev/ashmem", O_RDWR);
+	if (fd < 0)
+		fatal("open /dev/ashmem");
+	if (ioctl(fd, ASHMEM_SET_SIZE, size) < 0)
+		fatal("ASHMEM_SET_SIZE");
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		fatal("mmap");
+	memset(map, 1, size);
+
+	while (!stop) {
+		int first = rand_r(&seed) % nr_pages;
+		int len = 1 + rand_r(&seed) % (nr_pages - first);
+
+		pin.offset = first * getpagesize();
+		pin.len = len * getpagesize();
+		timed_ioctl(w, fd, ASHMEM_UNPIN, &pin);
+		ret = timed_ioctl(w, fd, ASHMEM_PIN, &pin);
+		if (ret == ASHMEM_WAS_PURGED) {
+			w->purged++;
+			memset(map + pin.offset, 1, pin.len);
+		}
+	}
+
+	munmap(map, size);
+	close(fd);
+	return NULL;
+}
+
+static void *pressure_fn(void *arg)
+{
+	size_t chunk = (size_t)pressure_mb << 20;
+
+	while (!stop) {
+		char *p = mmap(NULL, chunk, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (p == MAP_FAILED)
+			continue;
+		memset(p, 1, chunk);
+		munmap(p, chunk);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long ops = 0, purged = 0;
+	unsigned long long total_ns = 0, max_ns = 0;
+	pthread_t pressure;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "t:s:p:m:")) != -1) {
+		switch (c) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			nr_pages = atoi(optarg);
+			break;
+		case 'm':
+			pressure_mb = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-t threads] [-s seconds] "
+				"[-p pages] [-m pressure_mb (0 = off)]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (nr_threads < 1 || nr_threads > MAX_THREADS || nr_pages < 1 ||
+	    seconds < 1) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	if (pressure_mb && pthread_create(&pressure, NULL, pressure_fn, NULL))
+		fatal("pthread_create");
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i]))
+			fatal("pthread_create");
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		ops += workers[i].ops;
+		purged += workers[i].purged;
+		total_ns += workers[i].total_ns;
+		if (workers[i].max_ns > max_ns)
+			max_ns = workers[i].max_ns;
+	}
+	if (pressure_mb)
+		pthread_join(pressure, NULL);
+
+	printf("threads %d pages %d pressure %dMB\n",
+	       nr_threads, nr_pages, pressure_mb);
+	printf("ioctls %lu (%lu/s) purged-on-pin %lu\n",
+	       ops, ops / seconds, purged);
+	printf("latency avg %llu ns max %llu ns\n",
+	       ops ? total_ns / ops : 0, max_ns);
+	return 0;
+}
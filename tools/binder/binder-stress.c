@@ -0,0 +1,480 @@
+/*
+ * binder-stress: measure binder call latency with N client/server pairs
+ * calling at the same time, with the driver's unlocked_copy parameter
+ * cleared (binder_lock held across buffer allocation and copy, as before)
+ * and set.
+ *
+ * Every pair is two processes: a server with a single looper thread that
+ * echoes each call back, and a client that makes count calls to it and
+ * times each one. The servers are found through a small context manager
+ * that this program runs itself, so it needs a binder device whose context
+ * manager is free, such as a test image without servicemanager.
+ *
+ * Switching the lock mode needs root; when the parameter cannot be written
+ * only the current mode is measured.
+ *
+ * Compile by:
+ *
+ * gcc -O2 -o binder-stress binder-stress.c
+ *
+ * Usage: binder-stress [-d device] [-p pairs] [-n count] [-s size]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "../../drivers/staging/android/binder.h"
+
+#define MAP_SIZE	(128 * 1024)
+#define PARAM		"/sys/module/binder/parameters/unlocked_copy"
+
+enum {
+	CODE_ADD = 1,	/* server registers its node under an index */
+	CODE_GET,	/* client asks for the handle of an index */
+	CODE_ECHO,
+};
+
+/* what a server sends with CODE_ADD */
+struct add_msg {
+	long index;
+	struct flat_binder_object obj;
+};
+
+static const char *dev = "/dev/binder";
+static int pairs = 4;
+static int count = 10000;
+static size_t size = 128;
+
+static unsigned long long *lat;	/* shared, pairs * count entries */
+
+static int fd;
+static char rbuf[256];
+static size_t rpos, rlen;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void binder_open(void)
+{
+	fd = open(dev, O_RDWR);
+	if (fd < 0)
+		fatal(dev);
+	if (mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) == MAP_FAILED)
+		fatal("mmap");
+	rpos = rlen = 0;
+}
+
+static void binder_write(const void *data, size_t len)
+{
+	struct binder_write_read bwr;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_size = len;
+	bwr.write_buffer = (unsigned long)data;
+	while (bwr.write_consumed < bwr.write_size)
+		if (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0 && errno != EINTR)
+			fatal("BINDER_WRITE_READ write");
+}
+
+static void put(char **p, const void *data, size_t len)
+{
+	memcpy(*p, data, len);
+	*p += len;
+}
+
+static void put_cmd(char **p, uint32_t cmd)
+{
+	put(p, &cmd, sizeof(cmd));
+}
+
+/* send a transaction or reply with one optional object at offset off */
+static void send_txn(uint32_t cmd, uint32_t handle, uint32_t code,
+		     const void *data, size_t len, const size_t *off)
+{
+	struct binder_transaction_data tr;
+	char buf[sizeof(uint32_t) + sizeof(tr)], *p = buf;
+
+	memset(&tr, 0, sizeof(tr));
+	tr.target.handle = handle;
+	tr.code = code;
+	tr.data_size = len;
+	tr.data.ptr.buffer = data;
+	if (off) {
+		tr.offsets_size = sizeof(*off);
+		tr.data.ptr.offsets = off;
+	}
+	put_cmd(&p, cmd);
+	put(&p, &tr, sizeof(tr));
+	binder_write(buf, p - buf);
+}
+
+/* give back a received buffer, first taking a strong ref on handle */
+static void free_buffer(const void *data, long handle)
+{
+	char buf[32], *p = buf;
+	uint32_t desc = handle;
+
+	if (handle >= 0) {
+		put_cmd(&p, BC_ACQUIRE);
+		put(&p, &desc, sizeof(desc));
+	}
+	put_cmd(&p, BC_FREE_BUFFER);
+	put(&p, &data, sizeof(data));
+	binder_write(buf, p - buf);
+}
+
+/*
+ * Read until a transaction or reply arrives and return its command,
+ * answering reference count requests for our own node on the way.
+ */
+static uint32_t binder_wait(struct binder_transaction_data *tr)
+{
+	struct binder_write_read bwr;
+	struct binder_ptr_cookie pc;
+	char buf[32], *p;
+	uint32_t cmd;
+
+	for (;;) {
+		if (rpos >= rlen) {
+			memset(&bwr, 0, sizeof(bwr));
+			bwr.read_size = sizeof(rbuf);
+			bwr.read_buffer = (unsigned long)rbuf;
+			if (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0) {
+				if (errno == EINTR)
+					continue;
+				fatal("BINDER_WRITE_READ read");
+			}
+			rpos = 0;
+			rlen = bwr.read_consumed;
+		}
+
+		memcpy(&cmd, rbuf + rpos, sizeof(cmd));
+		rpos += sizeof(cmd);
+		switch (cmd) {
+		case BR_TRANSACTION:
+		case BR_REPLY:
+			memcpy(tr, rbuf + rpos, sizeof(*tr));
+			rpos += sizeof(*tr);
+			return cmd;
+		case BR_INCREFS:
+		case BR_ACQUIRE:
+			memcpy(&pc, rbuf + rpos, sizeof(pc));
+			p = buf;
+			put_cmd(&p, cmd == BR_INCREFS ?
+				BC_INCREFS_DONE : BC_ACQUIRE_DONE);
+			put(&p, &pc, sizeof(pc));
+			binder_write(buf, p - buf);
+			break;
+		case BR_DEAD_REPLY:
+		case BR_FAILED_REPLY:
+			return cmd;
+		}
+		rpos += _IOC_SIZE(cmd);
+	}
+}
+
+static void enter_looper(void)
+{
+	char buf[4], *p = buf;
+
+	put_cmd(&p, BC_ENTER_LOOPER);
+	binder_write(buf, p - buf);
+}
+
+static void run_manager(long unused)
+{
+	struct binder_transaction_data tr;
+	struct flat_binder_object obj;
+	long *handles, index;
+	size_t off = 0;
+	int i;
+
+	handles = calloc(pairs, sizeof(*handles));
+	if (!handles)
+		fatal("calloc");
+
+	binder_open();
+	/* the previous run's manager node may not be released yet */
+	for (i = 0; ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0; i++) {
+		if (errno != EBUSY || i == 5000)
+			fatal("BINDER_SET_CONTEXT_MGR");
+		usleep(1000);
+	}
+	enter_looper();
+
+	for (;;) {
+		if (binder_wait(&tr) != BR_TRANSACTION)
+			continue;
+		index = *(const long *)tr.data.ptr.buffer;
+		if (index < 0 || index >= pairs) {
+			free_buffer(tr.data.ptr.buffer, -1);
+			send_txn(BC_REPLY, 0, 0, NULL, 0, NULL);
+			continue;
+		}
+
+		if (tr.code == CODE_ADD) {
+			const struct add_msg *msg = tr.data.ptr.buffer;
+
+			handles[index] = msg->obj.handle;
+			free_buffer(tr.data.ptr.buffer, handles[index]);
+			send_txn(BC_REPLY, 0, 0, NULL, 0, NULL);
+		} else if (handles[index]) {
+			free_buffer(tr.data.ptr.buffer, -1);
+			memset(&obj, 0, sizeof(obj));
+			obj.type = BINDER_TYPE_HANDLE;
+			obj.handle = handles[index];
+			send_txn(BC_REPLY, 0, 0, &obj, sizeof(obj), &off);
+		} else {
+			/* not registered yet, the client asks again */
+			free_buffer(tr.data.ptr.buffer, -1);
+			send_txn(BC_REPLY, 0, 0, NULL, 0, NULL);
+		}
+	}
+}
+
+static void run_server(long index)
+{
+	static char node;
+	struct binder_transaction_data tr;
+	struct add_msg msg;
+	size_t off = offsetof(struct add_msg, obj);
+	char *echo;
+	uint32_t cmd;
+
+	echo = malloc(size);
+	if (!echo)
+		fatal("malloc");
+
+	binder_open();
+	memset(&msg, 0, sizeof(msg));
+	msg.index = index;
+	msg.obj.type = BINDER_TYPE_BINDER;
+	msg.obj.binder = &node;
+	do {
+		send_txn(BC_TRANSACTION, 0, CODE_ADD, &msg, sizeof(msg), &off);
+		cmd = binder_wait(&tr);
+		if (cmd == BR_REPLY)
+			free_buffer(tr.data.ptr.buffer, -1);
+		else
+			usleep(1000);	/* no context manager yet */
+	} while (cmd != BR_REPLY);
+	enter_looper();
+
+	for (;;) {
+		if (binder_wait(&tr) != BR_TRANSACTION)
+			continue;
+		memcpy(echo, tr.data.ptr.buffer,
+		       tr.data_size < size ? tr.data_size : size);
+		free_buffer(tr.data.ptr.buffer, -1);
+		send_txn(BC_REPLY, 0, 0, echo, size, NULL);
+	}
+}
+
+static void run_client(long index)
+{
+	struct binder_transaction_data tr;
+	unsigned long long t0;
+	uint32_t handle = 0;
+	char *payload;
+	int i;
+
+	payload = malloc(size);
+	if (!payload)
+		fatal("malloc");
+	memset(payload, 'c', size);
+
+	binder_open();
+	while (!handle) {
+		send_txn(BC_TRANSACTION, 0, CODE_GET, &index, sizeof(index),
+			 NULL);
+		if (binder_wait(&tr) != BR_REPLY) {
+			usleep(1000);
+			continue;
+		}
+		if (tr.data_size) {
+			const struct flat_binder_object *obj =
+				tr.data.ptr.buffer;
+
+			handle = obj->handle;
+			free_buffer(tr.data.ptr.buffer, handle);
+		} else {
+			free_buffer(tr.data.ptr.buffer, -1);
+			usleep(1000);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		t0 = now_ns();
+		send_txn(BC_TRANSACTION, handle, CODE_ECHO, payload, size,
+			 NULL);
+		if (binder_wait(&tr) != BR_REPLY) {
+			fprintf(stderr, "pair %ld: call %d failed\n", index, i);
+			exit(1);
+		}
+		free_buffer(tr.data.ptr.buffer, -1);
+		lat[index * count + i] = now_ns() - t0;
+	}
+	exit(0);
+}
+
+static pid_t start(void (*fn)(long), long arg)
+{
+	pid_t pid = fork();
+
+	if (pid < 0)
+		fatal("fork");
+	if (!pid) {
+		fn(arg);
+		exit(0);
+	}
+	return pid;
+}
+
+static void run(const char *mode)
+{
+	unsigned long long total = 0;
+	long n = (long)pairs * count;
+	pid_t mgr, *servers, *clients;
+	int i, status, failed = 0;
+
+	servers = malloc(pairs * sizeof(*servers));
+	clients = malloc(pairs * sizeof(*clients));
+	if (!servers || !clients)
+		fatal("malloc");
+
+	mgr = start(run_manager, 0);
+	for (i = 0; i < pairs; i++)
+		servers[i] = start(run_server, i);
+	for (i = 0; i < pairs; i++)
+		clients[i] = start(run_client, i);
+
+	for (i = 0; i < pairs; i++) {
+		waitpid(clients[i], &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed = 1;
+	}
+	for (i = 0; i < pairs; i++) {
+		kill(servers[i], SIGKILL);
+		waitpid(servers[i], NULL, 0);
+	}
+	kill(mgr, SIGKILL);
+	waitpid(mgr, NULL, 0);
+	free(servers);
+	free(clients);
+
+	if (failed) {
+		fprintf(stderr, "%s: a client failed\n", mode);
+		exit(1);
+	}
+
+	qsort(lat, n, sizeof(*lat), cmp_ull);
+	for (i = 0; i < n; i++)
+		total += lat[i];
+	printf("%-16s avg %6llu us  p50 %6llu us  p90 %6llu us  "
+	       "p99 %6llu us  max %6llu us\n", mode,
+	       total / n / 1000, lat[n / 2] / 1000, lat[n * 9 / 10] / 1000,
+	       lat[n * 99 / 100] / 1000, lat[n - 1] / 1000);
+}
+
+/* returns the old value of the parameter, or -1 if it can't be set */
+static int set_mode(int unlocked)
+{
+	char old = 0;
+	int pfd, ret;
+
+	pfd = open(PARAM, O_RDONLY);
+	if (pfd < 0)
+		return -1;
+	ret = read(pfd, &old, 1);
+	close(pfd);
+	if (ret != 1)
+		return -1;
+
+	pfd = open(PARAM, O_WRONLY);
+	if (pfd < 0)
+		return -1;
+	ret = write(pfd, unlocked ? "Y" : "N", 1);
+	close(pfd);
+	if (ret != 1)
+		return -1;
+	return old == 'Y';
+}
+
+int main(int argc, char *argv[])
+{
+	int c, old;
+
+	while ((c = getopt(argc, argv, "d:p:n:s:")) != -1) {
+		switch (c) {
+		case 'd':
+			dev = optarg;
+			break;
+		case 'p':
+			pairs = atoi(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-d device] [-p pairs] "
+				"[-n count] [-s size]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (pairs < 1 || count < 1 || size < 1 ||
+	    size > MAP_SIZE / 4) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	lat = mmap(NULL, (size_t)pairs * count * sizeof(*lat),
+		   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (lat == MAP_FAILED)
+		fatal("mmap");
+
+	printf("%s, %d pairs, %d calls each, %zu byte payload\n", dev, pairs,
+	       count, size);
+	old = set_mode(0);
+	if (old < 0) {
+		run("current mode");
+		return 0;
+	}
+	run("unlocked_copy=N");
+	set_mode(1);
+	run("unlocked_copy=Y");
+	set_mode(old);
+	return 0;
+}
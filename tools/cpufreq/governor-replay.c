@@ -0,0 +1,691 @@
+/*
+ * governor-replay: replay a CPU demand trace through the decisions of the
+ * interactive (with and without the scheduler load input), ondemand, lazy,
+ * wheatley and hotplug cpufreq governors and compare what each would have
+ * cost and how well it kept up.
+ *
+ * The trace is either lines of "<time in us> <demand in kHz>", where the
+ * demand is the speed that would just have kept up with the work, holding
+ * until the next line, or the cpufreq_interactive_target, _already and
+ * _notyet events of an ftrace dump, from which the demand is taken as
+ * load * cur / 100. The latter cannot show demand above the speed the
+ * traced CPU ran at.
+ *
+ * Time advances a tick at a time. Work arrives at the trace's demand and
+ * runs at the governor's current speed; what does not fit in a tick is
+ * carried over to the next one, and the CPU idles once nothing is left.
+ * Each governor then sees the busy time it would have measured: the dbs
+ * governors every sampling period, interactive every timer_rate and, with
+ * the scheduler input, also every tick. The frequency tables, thresholds
+ * and defaults follow the kernel code; CPU hotplug by the hotplug governor
+ * is modelled only as far as it changes the frequency decisions, and
+ * wheatley counts every idle period as a deep one.
+ *
+ * For each governor this reports
+ *
+ *	energy%	 the sum of freq^2 * time, relative to staying at the
+ *		 highest frequency
+ *	avg MHz	 the average speed
+ *	behind%	 the time during which there was work left over
+ *	lat ms	 the average and longest such stretch, i.e. how long the
+ *		 governor took to catch up with a rise in demand
+ *	missed	 the deadlines (every deadline_us, a 60 Hz frame by default)
+ *		 at which there was work left over
+ *	evals	 the number of times the governor ran
+ *
+ * Compile by:
+ *
+ * gcc -O2 -o governor-replay governor-replay.c
+ *
+ * Usage: governor-replay [-G governor,...] [-c cpu] [-f freq,freq,...]
+ *	  [-t tick_us] [-D deadline_us] [-R sampling_rate_us]
+ *	  [-r timer_rate_us] [-s hispeed_freq] [-g go_hispeed_load]
+ *	  [-l target_load] [-d above_hispeed_delay_us]
+ *	  [-m min_sample_time_us] trace
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#define MAX_FREQS		32
+#define DOWN_LOW_LOAD_THRESHOLD	5
+#define RAVG_WINDOW		16777	/* us, as in kernel/sched_fair.c */
+#define HOTPLUG_PERIODS		20
+
+struct sample {
+	unsigned long long time;
+	unsigned int demand;
+};
+
+static struct sample *trace;
+static int ntrace;
+
+static unsigned int freqs[MAX_FREQS] = { 350000, 700000, 920000, 1200000 };
+static int nfreqs = 4;
+static int trace_cpu = -1;
+static unsigned int tick = 7812;	/* HZ=128 */
+static unsigned int deadline = 16667;
+static unsigned int sampling_rate;	/* 0: each governor's default */
+static char *only;
+
+/* interactive */
+static unsigned int timer_rate = 20000;
+static unsigned int hispeed_freq;
+static unsigned int go_hispeed_load = 99;
+static unsigned int target_load = 90;
+static unsigned int above_hispeed_delay = 20000;
+static unsigned int min_sample_time = 80000;
+
+struct governor;
+
+struct governor_type {
+	const char *name;
+	/* default sampling period, in us */
+	unsigned int rate;
+	/* up_threshold and down_differential with idle micro accounting */
+	unsigned int up_threshold;
+	unsigned int down_differential;
+	void (*evaluate)(struct governor *g, unsigned long long now);
+	int use_sched_load;
+};
+
+struct governor {
+	const struct governor_type *type;
+	unsigned int cur;
+	unsigned int rate;
+	unsigned long long next_sample;
+	unsigned long evals;
+
+	/* busy time and busy time * speed since the last evaluation */
+	unsigned long long last_sample;
+	unsigned long long busy;
+	unsigned long long busy_freq;
+
+	/* completed idle periods since the last evaluation, for wheatley */
+	unsigned long long idle_len;
+	unsigned long long idle_time;
+	unsigned long idle_periods;
+	unsigned int num_misses;
+
+	/* interactive */
+	unsigned int floor_freq;
+	unsigned long long floor_validate_time;
+	unsigned long long hispeed_validate_time;
+	unsigned long long window_start;
+	unsigned long long window_busy;
+	unsigned long long last_window_busy;
+
+	/* hotplug */
+	unsigned int online;
+	unsigned int history[HOTPLUG_PERIODS];
+	unsigned int history_index;
+};
+
+struct result {
+	double energy;
+	double speed;
+	unsigned long long total_time;
+	unsigned long long behind_time;
+	unsigned long long lat_sum;
+	unsigned long long lat_max;
+	unsigned long lat_count;
+	unsigned long deadlines;
+	unsigned long missed;
+};
+
+static void fatal(const char *msg)
+{
+	fprintf(stderr, "%s\n", msg);
+	exit(1);
+}
+
+static void add_sample(unsigned long long time, unsigned int demand)
+{
+	static int size;
+
+	if (ntrace && time < trace[ntrace - 1].time)
+		fatal("trace is not in time order");
+	if (ntrace == size) {
+		size = size ? size * 2 : 1024;
+		trace = realloc(trace, size * sizeof(*trace));
+		if (!trace)
+			fatal("out of memory");
+	}
+	trace[ntrace].time = time;
+	trace[ntrace].demand = demand;
+	ntrace++;
+}
+
+static void read_trace(const char *path)
+{
+	char line[512];
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long time;
+		unsigned long cpu, load, cur;
+		double secs;
+		char *ev, *p;
+
+		if (line[0] == '#')
+			continue;
+
+		ev = strstr(line, ": cpufreq_interactive_");
+		if (!ev) {
+			unsigned int demand;
+
+			if (sscanf(line, "%llu %u", &time, &demand) == 2)
+				add_sample(time, demand);
+			continue;
+		}
+
+		if (!strstr(ev, "_target:") && !strstr(ev, "_already:") &&
+		    !strstr(ev, "_notyet:"))
+			continue;
+		/* the timestamp is the last field before the event name */
+		*ev = '\0';
+		p = strrchr(line, ' ');
+		if (!p || sscanf(p, "%lf", &secs) != 1)
+			continue;
+		p = strstr(ev + 1, "cpu=");
+		if (!p || sscanf(p, "cpu=%lu load=%lu cur=%lu", &cpu, &load,
+				 &cur) != 3)
+			continue;
+		if (trace_cpu >= 0 && cpu != (unsigned long)trace_cpu)
+			continue;
+		add_sample((unsigned long long)(secs * 1000000), load * cur / 100);
+	}
+	fclose(f);
+
+	if (ntrace < 2)
+		fatal("trace has fewer than two samples");
+}
+
+/* average demand over [start, end) */
+static unsigned int demand_between(unsigned long long start,
+				   unsigned long long end)
+{
+	static int i;
+	unsigned long long sum = 0, t = start;
+	int j;
+
+	while (i > 0 && trace[i].time > start)
+		i--;
+	while (i + 1 < ntrace && trace[i + 1].time <= start)
+		i++;
+
+	for (j = i; t < end; j++) {
+		unsigned long long next = j + 1 < ntrace ?
+			trace[j + 1].time : end;
+
+		if (next > end)
+			next = end;
+		if (next > t) {
+			sum += (unsigned long long)trace[j].demand * (next - t);
+			t = next;
+		}
+		if (j + 1 >= ntrace)
+			break;
+	}
+	if (t < end)
+		sum += (unsigned long long)trace[ntrace - 1].demand * (end - t);
+	return sum / (end - start);
+}
+
+/* CPUFREQ_RELATION_L: lowest frequency at or above freq, else the highest */
+static unsigned int table_l(unsigned int freq)
+{
+	int i;
+
+	for (i = 0; i < nfreqs; i++)
+		if (freqs[i] >= freq)
+			return freqs[i];
+	return freqs[nfreqs - 1];
+}
+
+/* CPUFREQ_RELATION_H: highest frequency at or below freq, else the lowest */
+static unsigned int table_h(unsigned int freq)
+{
+	int i;
+
+	for (i = nfreqs - 1; i >= 0; i--)
+		if (freqs[i] <= freq)
+			return freqs[i];
+	return freqs[0];
+}
+
+/* percentage of the time since the last evaluation the CPU was busy */
+static unsigned int sample_load(struct governor *g, unsigned long long now)
+{
+	unsigned long long wall = now - g->last_sample;
+
+	return wall ? g->busy * 100 / wall : 0;
+}
+
+/* the same search as choose_freq() in cpufreq_interactive.c */
+static unsigned int choose_freq(unsigned int cur, unsigned int loadadjfreq)
+{
+	unsigned int freq = cur, prevfreq, freqmin = 0, freqmax = ~0U;
+
+	do {
+		prevfreq = freq;
+		freq = table_l(loadadjfreq / target_load);
+
+		if (freq > prevfreq) {
+			freqmin = prevfreq;
+			if (freq >= freqmax) {
+				freq = table_h(freqmax - 1);
+				if (freq == freqmin) {
+					freq = freqmax;
+					break;
+				}
+			}
+		} else if (freq < prevfreq) {
+			freqmax = prevfreq;
+			if (freq <= freqmin) {
+				freq = table_l(freqmin + 1);
+				if (freq == freqmax)
+					break;
+			}
+		}
+	} while (freq != prevfreq);
+
+	return freq;
+}
+
+static unsigned int sched_load(struct governor *g)
+{
+	unsigned long long busy = g->window_busy > g->last_window_busy ?
+		g->window_busy : g->last_window_busy;
+
+	if (busy > RAVG_WINDOW)
+		busy = RAVG_WINDOW;
+	return busy * 100 / RAVG_WINDOW;
+}
+
+/* cpufreq_interactive_timer(), without input boost */
+static void interactive_evaluate(struct governor *g, unsigned long long now)
+{
+	unsigned int loadadjfreq, cpu_load, new_freq;
+
+	loadadjfreq = now > g->last_sample ?
+		g->busy_freq * 100 / (now - g->last_sample) : 0;
+	if (g->type->use_sched_load && sched_load(g) * g->cur > loadadjfreq)
+		loadadjfreq = sched_load(g) * g->cur;
+
+	cpu_load = loadadjfreq / g->cur;
+	if (cpu_load >= go_hispeed_load) {
+		if (g->cur < hispeed_freq) {
+			new_freq = hispeed_freq;
+		} else {
+			new_freq = choose_freq(g->cur, loadadjfreq);
+			if (new_freq < hispeed_freq)
+				new_freq = hispeed_freq;
+		}
+	} else if (cpu_load <= DOWN_LOW_LOAD_THRESHOLD) {
+		new_freq = freqs[0];
+	} else {
+		new_freq = choose_freq(g->cur, loadadjfreq);
+	}
+
+	if (g->cur >= hispeed_freq && new_freq > g->cur &&
+	    now - g->hispeed_validate_time < above_hispeed_delay)
+		return;
+	g->hispeed_validate_time = now;
+
+	new_freq = table_l(new_freq);
+	if (new_freq < g->floor_freq &&
+	    now - g->floor_validate_time < min_sample_time)
+		return;
+
+	g->floor_freq = new_freq;
+	g->floor_validate_time = now;
+	g->cur = new_freq;
+}
+
+/*
+ * The frequency decrease of dbs_check_cpu(): the lowest frequency that
+ * would have run the load below up_threshold - down_differential.
+ * Returns whether the frequency changed.
+ */
+static int dbs_decrease(struct governor *g, unsigned int max_load_freq)
+{
+	unsigned int low = g->type->up_threshold - g->type->down_differential;
+
+	if (g->cur == freqs[0] || max_load_freq >= low * g->cur)
+		return 0;
+	g->cur = table_l(max_load_freq / low);
+	return 1;
+}
+
+/* dbs_check_cpu() of cpufreq_ondemand.c, with sampling_down_factor 1 */
+static void ondemand_evaluate(struct governor *g, unsigned long long now)
+{
+	unsigned int max_load_freq = sample_load(g, now) * g->cur;
+
+	if (max_load_freq > g->type->up_threshold * g->cur)
+		g->cur = freqs[nfreqs - 1];
+	else
+		dbs_decrease(g, max_load_freq);
+}
+
+/*
+ * dbs_check_cpu() of cpufreq_lazy.c: ondemand, except that after changing
+ * the frequency it waits min_timeinstate (30 ms on OMAP4) before the next
+ * sample.
+ */
+static void lazy_evaluate(struct governor *g, unsigned long long now)
+{
+	unsigned int max_load_freq = sample_load(g, now) * g->cur;
+	unsigned int fmax = freqs[nfreqs - 1];
+	int changed;
+
+	if (max_load_freq > g->type->up_threshold * g->cur) {
+		changed = g->cur != fmax;
+		g->cur = fmax;
+	} else {
+		changed = dbs_decrease(g, max_load_freq);
+	}
+	if (changed)
+		g->next_sample = now + 30000;
+}
+
+/*
+ * dbs_check_cpu() of cpufreq_wheatley.c: ondemand, but go to the highest
+ * frequency while the average idle period has recently been at least
+ * target_residency (10 ms), as racing to idle then pays off.
+ */
+static void wheatley_evaluate(struct governor *g, unsigned long long now)
+{
+	unsigned int max_load_freq = sample_load(g, now) * g->cur;
+
+	if (g->idle_periods && g->idle_time / g->idle_periods >= 10000) {
+		if (g->num_misses > 0)
+			g->num_misses--;
+	} else {
+		if (g->num_misses <= 5)
+			g->num_misses++;
+	}
+
+	if (max_load_freq > g->type->up_threshold * g->cur ||
+	    g->num_misses <= 5)
+		g->cur = freqs[nfreqs - 1];
+	else
+		dbs_decrease(g, max_load_freq);
+}
+
+/*
+ * dbs_check_cpu() of cpufreq_hotplug.c for one CPU that does all the work:
+ * a second CPU is brought up, and the sample skipped, once the load has
+ * averaged above up_threshold over 5 samples, and taken down again at the
+ * lowest frequency once it has averaged below down_threshold (35) over 20.
+ */
+static void hotplug_evaluate(struct governor *g, unsigned long long now)
+{
+	unsigned int load = sample_load(g, now);
+	unsigned int avg_load = load / g->online;
+	unsigned int in_avg = 0, out_avg = 0;
+	unsigned int i, j;
+
+	g->history[g->history_index] = avg_load;
+	for (i = 0, j = g->history_index; i < HOTPLUG_PERIODS; i++) {
+		if (i < 5)
+			in_avg += g->history[j];
+		out_avg += g->history[j];
+		j = j ? j - 1 : HOTPLUG_PERIODS - 1;
+	}
+	in_avg /= 5;
+	out_avg /= HOTPLUG_PERIODS;
+	g->history_index = (g->history_index + 1) % HOTPLUG_PERIODS;
+
+	if (avg_load > g->type->up_threshold && g->online < 2 &&
+	    in_avg > g->type->up_threshold) {
+		g->online++;
+		return;
+	}
+
+	if (load > g->type->up_threshold) {
+		g->cur = freqs[nfreqs - 1];
+		return;
+	}
+
+	if (avg_load < 35 && g->cur == freqs[0]) {
+		if (g->online > 1 && out_avg < 35)
+			g->online--;
+		return;
+	}
+
+	dbs_decrease(g, load * g->cur);
+}
+
+static const struct governor_type governors[] = {
+	{ "interactive", 0, 0, 0, interactive_evaluate, 0 },
+	{ "interactive-sched", 0, 0, 0, interactive_evaluate, 1 },
+	{ "ondemand", 30000, 95, 3, ondemand_evaluate, 0 },
+	{ "lazy", 15000, 90, 3, lazy_evaluate, 0 },
+	{ "wheatley", 30000, 95, 3, wheatley_evaluate, 0 },
+	{ "hotplug", 100000, 80, 10, hotplug_evaluate, 0 },
+};
+
+static void evaluate(struct governor *g, unsigned long long now)
+{
+	g->evals++;
+	g->next_sample = (now / g->rate + 1) * g->rate;
+	g->type->evaluate(g, now);
+	g->last_sample = now;
+	g->busy = g->busy_freq = 0;
+	g->idle_time = g->idle_periods = 0;
+}
+
+static void run(struct governor *g, struct result *r)
+{
+	unsigned long long start = trace[0].time, end = trace[ntrace - 1].time;
+	unsigned long long now, behind_since = 0, next_deadline;
+	unsigned long long pending = 0;
+	unsigned int fmax = freqs[nfreqs - 1];
+	int behind = 0;
+
+	memset(r, 0, sizeof(*r));
+	g->cur = g->floor_freq = fmax;
+	g->floor_validate_time = g->hispeed_validate_time = start;
+	g->last_sample = start;
+	g->next_sample = start + g->rate;
+	g->window_start = start - start % RAVG_WINDOW;
+	g->online = 1;
+	next_deadline = start + deadline;
+
+	for (now = start; now + tick <= end; now += tick) {
+		unsigned long long work, busy;
+
+		/* run what is pending, in kHz * us, at the current speed */
+		pending += (unsigned long long)demand_between(now, now + tick) *
+			tick;
+		work = pending < (unsigned long long)g->cur * tick ?
+			pending : (unsigned long long)g->cur * tick;
+		pending -= work;
+		busy = (work + g->cur - 1) / g->cur;
+
+		g->busy += busy;
+		g->busy_freq += work;
+		if (now >= g->window_start + RAVG_WINDOW) {
+			g->last_window_busy = now >= g->window_start +
+				2 * RAVG_WINDOW ? 0 : g->window_busy;
+			g->window_start = now - now % RAVG_WINDOW;
+			g->window_busy = 0;
+		}
+		g->window_busy += busy;
+
+		/* the CPU runs first and idles for the rest of the tick */
+		if (busy && g->idle_len) {
+			g->idle_time += g->idle_len;
+			g->idle_periods++;
+			g->idle_len = 0;
+		}
+		g->idle_len += tick - busy;
+
+		r->energy += (double)g->cur / fmax * g->cur / fmax * tick;
+		r->speed += (double)g->cur * tick;
+		r->total_time += tick;
+		if (pending) {
+			r->behind_time += tick;
+			if (!behind) {
+				behind = 1;
+				behind_since = now;
+			}
+		} else if (behind) {
+			behind = 0;
+			r->lat_sum += now + tick - behind_since;
+			if (now + tick - behind_since > r->lat_max)
+				r->lat_max = now + tick - behind_since;
+			r->lat_count++;
+		}
+		while (now + tick >= next_deadline) {
+			r->deadlines++;
+			if (pending)
+				r->missed++;
+			next_deadline += deadline;
+		}
+
+		/* then what happens at the end of the tick */
+		if (now + tick >= g->next_sample)
+			evaluate(g, now + tick);
+		else if (g->type->use_sched_load && g->cur < fmax &&
+			 sched_load(g) > target_load)
+			evaluate(g, now + tick);
+	}
+}
+
+static void report(struct governor *g, struct result *r)
+{
+	printf("%-17s %8.1f %8.0f %8.2f %8.2f %8.2f %6lu/%-6lu %7lu\n",
+	       g->type->name, 100 * r->energy / r->total_time,
+	       r->speed / r->total_time / 1000,
+	       100.0 * r->behind_time / r->total_time,
+	       r->lat_count ? r->lat_sum / 1000.0 / r->lat_count : 0,
+	       r->lat_max / 1000.0, r->missed, r->deadlines, g->evals);
+}
+
+static int selected(const char *name)
+{
+	const char *p = only;
+	size_t len = strlen(name);
+
+	if (!p)
+		return 1;
+	while ((p = strstr(p, name))) {
+		if ((p == only || p[-1] == ',') &&
+		    (p[len] == ',' || p[len] == '\0'))
+			return 1;
+		p += len;
+	}
+	return 0;
+}
+
+static void parse_freqs(char *list)
+{
+	char *tok;
+
+	nfreqs = 0;
+	for (tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+		if (nfreqs == MAX_FREQS)
+			fatal("too many frequencies");
+		freqs[nfreqs] = strtoul(tok, NULL, 0);
+		if (!freqs[nfreqs] || (nfreqs && freqs[nfreqs] <=
+				       freqs[nfreqs - 1]))
+			fatal("frequencies must be increasing");
+		nfreqs++;
+	}
+	if (!nfreqs)
+		fatal("no frequencies");
+}
+
+int main(int argc, char *argv[])
+{
+	struct result res;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "G:c:f:t:D:R:r:s:g:l:d:m:")) != -1) {
+		switch (c) {
+		case 'G':
+			only = optarg;
+			break;
+		case 'c':
+			trace_cpu = atoi(optarg);
+			break;
+		case 'f':
+			parse_freqs(optarg);
+			break;
+		case 't':
+			tick = atoi(optarg);
+			break;
+		case 'D':
+			deadline = atoi(optarg);
+			break;
+		case 'R':
+			sampling_rate = atoi(optarg);
+			break;
+		case 'r':
+			timer_rate = atoi(optarg);
+			break;
+		case 's':
+			hispeed_freq = atoi(optarg);
+			break;
+		case 'g':
+			go_hispeed_load = atoi(optarg);
+			break;
+		case 'l':
+			target_load = atoi(optarg);
+			break;
+		case 'd':
+			above_hispeed_delay = atoi(optarg);
+			break;
+		case 'm':
+			min_sample_time = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-G governor,...] [-c cpu] "
+				"[-f freq,freq,...] [-t tick_us] "
+				"[-D deadline_us] [-R sampling_rate_us] "
+				"[-r timer_rate_us] [-s hispeed_freq] "
+				"[-g go_hispeed_load] [-l target_load] "
+				"[-d above_hispeed_delay_us] "
+				"[-m min_sample_time_us] trace\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1 || !tick || !deadline || !timer_rate ||
+	    !target_load) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+	if (!hispeed_freq)
+		hispeed_freq = freqs[nfreqs - 1];
+
+	read_trace(argv[optind]);
+
+	printf("%d samples, %.1f s, tick %u us, deadline %u us\n", ntrace,
+	       (trace[ntrace - 1].time - trace[0].time) / 1e6, tick,
+	       deadline);
+	printf("%-17s %8s %8s %8s %8s %8s %13s %7s\n", "governor", "energy%",
+	       "avg MHz", "behind%", "lat ms", "max ms", "missed", "evals");
+	for (i = 0; i < sizeof(governors) / sizeof(governors[0]); i++) {
+		struct governor g = { .type = &governors[i] };
+
+		if (!selected(g.type->name))
+			continue;
+		if (g.type->evaluate == interactive_evaluate)
+			g.rate = timer_rate;
+		else
+			g.rate = sampling_rate ? sampling_rate : g.type->rate;
+		run(&g, &res);
+		report(&g, &res);
+	}
+	return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * fsync-bench: measure fsync() latency for a file that grows by small
+ * appends, the way databases and logs write on a phone.
+ *
+ * Each iteration appends one record to the file and calls fsync() (or
+ * fdatasync() with -d), timing only the sync. Optionally another file on
+ * the same filesystem is kept dirty in the background (-b), which shows
+ * whether fsync writes node pages that belong to other files.
+ *
+ * Compile by:
+ *
+ * gcc -O2 -o fsync-bench fsync-bench.c
+ *
+ * Usage: fsync-bench [-f file] [-n count] [-s size] [-d] [-b]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+static const char *path = "/data/local/tmp/fsync-bench.dat";
+static int count = 1000;
+static size_t size = 512;
+static int datasync;
+static int background;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* keep rewriting a second file without ever syncing it */
+static pid_t start_background(void)
+{
+	char name[4096], buf[4096];
+	pid_t pid;
+	int fd;
+
+	snprintf(name, sizeof(name), "%s.bg", path);
+	pid = fork();
+	if (pid < 0)
+		fatal("fork");
+	if (pid)
+		return pid;
+
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		fatal("open background file");
+	memset(buf, 'b', sizeof(buf));
+	for (;;) {
+		off_t off = (rand() % 4096) * (off_t)sizeof(buf);
+
+		if (pwrite(fd, buf, sizeof(buf), off) != sizeof(buf))
+			fatal("pwrite background file");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long *lat, total = 0, t0;
+	pid_t bg = 0;
+	char *buf;
+	int c, i, fd;
+
+	while ((c = getopt(argc, argv, "f:n:s:db")) != -1) {
+		switch (c) {
+		case 'f':
+			path = optarg;
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		case 'd':
+			datasync = 1;
+			break;
+		case 'b':
+			background = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-f file] [-n count] "
+				"[-s size] [-d (fdatasync)] "
+				"[-b (dirty another file)]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (count < 1 || size < 1) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	buf = malloc(size);
+	lat = malloc(count * sizeof(*lat));
+	if (!buf || !lat)
+		fatal("malloc");
+	memset(buf, 'a', size);
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+	if (fd < 0)
+		fatal("open");
+	/* start from a file whose inode is already on disk */
+	if (fsync(fd) < 0)
+		fatal("fsync");
+
+	if (background)
+		bg = start_background();
+
+	for (i = 0; i < count; i++) {
+		if (write(fd, buf, size) != (ssize_t)size)
+			fatal("write");
+		t0 = now_ns();
+		if ((datasync ? fdatasync(fd) : fsync(fd)) < 0)
+			fatal(datasync ? "fdatasync" : "fsync");
+		lat[i] = now_ns() - t0;
+		total += lat[i];
+	}
+	close(fd);
+
+	if (bg) {
+		kill(bg, SIGKILL);
+		waitpid(bg, NULL, 0);
+	}
+
+	qsort(lat, count, sizeof(*lat), cmp_ull);
+	printf("%s, %d %s calls after %zu byte appends%s\n", path, count,
+	       datasync ? "fdatasync" : "fsync", size,
+	       background ? ", another file dirty" : "");
+	printf("avg %8llu us  p50 %8llu us  p99 %8llu us  max %8llu us\n",
+	       total / count / 1000, lat[count / 2] / 1000,
+	       lat[count * 99 / 100] / 1000, lat[count - 1] / 1000);
+	return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * logger-bench: measure how long it takes to dump a whole Android log,
+ * reading one entry per read() and in batches (LOGGER_SET_READ_BATCH).
+ *
+ * Unless told not to, the log is first filled by writing entries of
+ * random length to it. Each dump then opens a new reader, which starts at
+ * the oldest entry, and reads until the log is empty.
+ *
+ * Compile by:
+ *
+ * gcc -O2 -o logger-bench logger-bench.c
+ *
+ * Usage: logger-bench [-l log] [-n] [-r rounds] [-b bufsize]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include "../../drivers/staging/android/logger.h"
+
+static const char *log_path = "/dev/log/main";
+static int fill = 1;
+static int rounds = 5;
+static size_t bufsize = 64 * 1024;
+
+struct result {
+	unsigned long reads;
+	unsigned long entries;
+	unsigned long bytes;
+	unsigned long long ns;
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+/* write about two buffers' worth of entries so that the log wraps */
+static void fill_log(void)
+{
+	char msg[512];
+	long size, written = 0;
+	unsigned int seed = 1;
+	int fd;
+
+	fd = open(log_path, O_RDONLY);
+	if (fd < 0)
+		fatal("open log");
+	size = ioctl(fd, LOGGER_GET_LOG_BUF_SIZE);
+	if (size < 0)
+		fatal("LOGGER_GET_LOG_BUF_SIZE");
+	close(fd);
+
+	fd = open(log_path, O_WRONLY);
+	if (fd < 0)
+		fatal("open log for writing");
+
+	while (written < 2 * size) {
+		/* priority, tag and message, as liblog writes them */
+		int len = 32 + rand_r(&seed) % (sizeof(msg) - 32);
+
+		memset(msg, 'x', len);
+		msg[0] = 4;
+		memcpy(msg + 1, "logger-bench", 13);
+		msg[len - 1] = '\0';
+		if (write(fd, msg, len) != len)
+			fatal("write");
+		written += sizeof(struct logger_entry) + len;
+	}
+	close(fd);
+}
+
+static void dump(int batch, char *buf, struct result *res)
+{
+	unsigned long long t0;
+	ssize_t n;
+	int fd;
+
+	fd = open(log_path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		fatal("open log");
+	if (ioctl(fd, LOGGER_SET_VERSION, &(int){ 2 }) < 0)
+		fatal("LOGGER_SET_VERSION");
+	if (batch && ioctl(fd, LOGGER_SET_READ_BATCH, 1) < 0)
+		fatal("LOGGER_SET_READ_BATCH");
+
+	t0 = now_ns();
+	for (;;) {
+		char *p;
+
+		n = read(fd, buf, bufsize);
+		if (n < 0) {
+			if (errno == EAGAIN)
+				break;
+			if (errno == EINTR)
+				continue;
+			fatal("read");
+		}
+		res->reads++;
+		res->bytes += n;
+		for (p = buf; p < buf + n;) {
+			struct logger_entry *entry = (struct logger_entry *) p;
+
+			res->entries++;
+			p += entry->hdr_size + entry->len;
+		}
+	}
+	res->ns += now_ns() - t0;
+	close(fd);
+}
+
+static void report(const char *mode, struct result *res)
+{
+	printf("%-7s %8lu reads %8lu entries %9lu bytes %8llu us/dump\n",
+	       mode, res->reads / rounds, res->entries / rounds,
+	       res->bytes / rounds, res->ns / rounds / 1000);
+}
+
+int main(int argc, char *argv[])
+{
+	struct result single = { 0 }, batched = { 0 };
+	char *buf;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "l:nr:b:")) != -1) {
+		switch (c) {
+		case 'l':
+			log_path = optarg;
+			break;
+		case 'n':
+			fill = 0;
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'b':
+			bufsize = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-l log] [-n (don't fill)] "
+				"[-r rounds] [-b bufsize]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (rounds < 1 || bufsize < LOGGER_ENTRY_MAX_PAYLOAD +
+	    sizeof(struct logger_entry)) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	buf = malloc(bufsize);
+	if (!buf)
+		fatal("malloc");
+
+	if (fill)
+		fill_log();
+
+	for (i = 0; i < rounds; i++) {
+		dump(0, buf, &single);
+		dump(1, buf, &batched);
+	}
+
+	printf("%s, %d rounds, %zu byte buffer\n", log_path, rounds, bufsize);
+	report("single", &single);
+	report("batch", &batched);
+	return 0;
+}
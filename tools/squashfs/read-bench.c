@@ -0,0 +1,190 @@
+/*
+ * read-bench: measure how fast a tree of files is read with 1, 2, 4, ...
+ * threads, as when apps start and read from a read-only image together.
+ *
+ * All regular files under the directory are listed first. For each thread
+ * count the page cache is dropped, then the threads take files from the
+ * list in turn and read each one to the end, like cat. On Squashfs, compare
+ * mounts with threads=single, multi and percpu.
+ *
+ * Dropping the page cache needs root; with -n it is not dropped, which
+ * only makes sense for a tree that does not fit in memory.
+ *
+ * Compile by:
+ *
+ * gcc -O2 -pthread -o read-bench read-bench.c
+ *
+ * Usage: read-bench [-t maxthreads] [-b bufsize] [-n] dir
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+static int max_threads = 4;
+static size_t bufsize = 128 * 1024;
+static int drop = 1;
+
+static char **files;
+static int nr_files, files_size;
+static int next_file;
+static unsigned long long total_bytes;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static int add_file(const char *path, const struct stat *st, int type,
+		    struct FTW *ftw)
+{
+	if (type != FTW_F || !S_ISREG(st->st_mode))
+		return 0;
+
+	if (nr_files == files_size) {
+		files_size = files_size ? files_size * 2 : 1024;
+		files = realloc(files, files_size * sizeof(*files));
+		if (!files)
+			fatal("realloc");
+	}
+	files[nr_files] = strdup(path);
+	if (!files[nr_files])
+		fatal("strdup");
+	nr_files++;
+	return 0;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0)
+		fatal("open /proc/sys/vm/drop_caches");
+	if (write(fd, "3", 1) != 1)
+		fatal("drop_caches");
+	close(fd);
+}
+
+static void *reader(void *arg)
+{
+	unsigned long long bytes = 0;
+	char *buf;
+	ssize_t n;
+	int i, fd;
+
+	buf = malloc(bufsize);
+	if (!buf)
+		fatal("malloc");
+
+	while ((i = __sync_fetch_and_add(&next_file, 1)) < nr_files) {
+		fd = open(files[i], O_RDONLY);
+		if (fd < 0) {
+			/* skip what we are not allowed to read */
+			if (errno == EACCES)
+				continue;
+			fatal(files[i]);
+		}
+		while ((n = read(fd, buf, bufsize)) > 0)
+			bytes += n;
+		if (n < 0)
+			fatal(files[i]);
+		close(fd);
+	}
+
+	__sync_fetch_and_add(&total_bytes, bytes);
+	free(buf);
+	return NULL;
+}
+
+static void run(int threads)
+{
+	pthread_t *tids;
+	unsigned long long t0, ns;
+	int i;
+
+	tids = malloc(threads * sizeof(*tids));
+	if (!tids)
+		fatal("malloc");
+
+	if (drop)
+		drop_caches();
+	next_file = 0;
+	total_bytes = 0;
+
+	t0 = now_ns();
+	for (i = 0; i < threads; i++) {
+		errno = pthread_create(&tids[i], NULL, reader, NULL);
+		if (errno)
+			fatal("pthread_create");
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	ns = now_ns() - t0;
+
+	printf("%3d threads %12llu bytes %8llu ms %8.1f MB/s\n", threads,
+	       total_bytes, ns / 1000000,
+	       total_bytes * 1000.0 / ns);
+	free(tids);
+}
+
+int main(int argc, char *argv[])
+{
+	int c, threads;
+
+	while ((c = getopt(argc, argv, "t:b:n")) != -1) {
+		switch (c) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'b':
+			bufsize = atoi(optarg);
+			break;
+		case 'n':
+			drop = 0;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1)
+		goto usage;
+	if (max_threads < 1 || bufsize < 1) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	if (nftw(argv[optind], add_file, 64, FTW_PHYS | FTW_MOUNT) < 0)
+		fatal("nftw");
+
+	printf("%s, %d files, %zu byte reads\n", argv[optind], nr_files,
+	       bufsize);
+	for (threads = 1; threads < max_threads; threads *= 2)
+		run(threads);
+	run(max_threads);
+	return 0;
+
+usage:
+	fprintf(stderr, "Usage: %s [-t maxthreads] [-b bufsize] "
+		"[-n (don't drop caches)] dir\n", argv[0]);
+	return 1;
+}